@@ -0,0 +1,60 @@
+#include "buffer_pool.h"
+
+Buffer_Pool::Buffer_Pool() {}
+
+Buffer_Pool::~Buffer_Pool() {
+    for(int i = 0; i < BUFFER_CLASS_NUM; i++) {
+        for(size_t j = 0; j < m_free[i].size(); j++) {
+            delete [] m_free[i][j];
+        }
+    }
+}
+
+Buffer_Pool & Buffer_Pool::local() {
+    // 每个线程一个，线程退出时释放空闲的缓冲区
+    static thread_local Buffer_Pool pool;
+    return pool;
+}
+
+int Buffer_Pool::class_of(int size) {
+    int cls = 0;
+    int cls_size = BUFFER_MIN_SIZE;
+    while(cls_size < size) {
+        cls_size <<= 1;
+        cls++;
+    }
+    return (cls < BUFFER_CLASS_NUM) ? cls : -1;
+}
+
+char * Buffer_Pool::acquire(int size, int * real_size) {
+    int cls = class_of(size);
+    if(cls == -1) {
+        *real_size = size;
+        return new char[size];
+    }
+    *real_size = BUFFER_MIN_SIZE << cls;
+    vector<char *> & free_list = local().m_free[cls];
+    if(free_list.empty()) {
+        return new char[*real_size];
+    }
+    char * buf = free_list.back();
+    free_list.pop_back();
+    return buf;
+}
+
+void Buffer_Pool::release(char * buf, int size) {
+    if(!buf) {
+        return;
+    }
+    int cls = class_of(size);
+    if(cls == -1 || (BUFFER_MIN_SIZE << cls) != size) {
+        delete [] buf;
+        return;
+    }
+    vector<char *> & free_list = local().m_free[cls];
+    if((int)free_list.size() >= BUFFER_MAX_FREE) {
+        delete [] buf;
+        return;
+    }
+    free_list.push_back(buf);
+}
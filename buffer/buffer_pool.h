@@ -0,0 +1,43 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stdlib.h>
+#include <vector>
+using namespace std;
+
+const int BUFFER_MIN_SIZE = 1024;       // 最小的一档缓冲区大小
+const int BUFFER_CLASS_NUM = 8;         // 缓冲区大小分档的数量（1KB、2KB、4KB ... 128KB）
+const int BUFFER_MAX_FREE = 64;         // 每个线程每一档最多缓存多少块空闲的缓冲区
+
+/**
+ * 按大小分档的线程本地缓冲区池
+ * 连接只在有数据收发的时候才从池里借读写缓冲区，空闲的keep-alive连接不占用缓冲区，
+ * 这样users数组就不需要为每个fd都预留固定大小的缓冲区了
+ * - 每个线程有自己的空闲链表，借和还都不需要加锁
+ * - 缓冲区可以在一个线程借、在另一个线程还（比如Proactor模式下事件循环线程读、工作线程处理），
+ *   还的时候放到当前线程的空闲链表里，超过BUFFER_MAX_FREE就直接释放
+ * - 超过最大一档的缓冲区不缓存，直接new/delete
+*/
+class Buffer_Pool {
+public:
+    // 借一块至少size字节的缓冲区，real_size返回实际的大小（向上取整到所在的档）
+    static char * acquire(int size, int * real_size);
+
+    // 还回一块缓冲区，size是acquire返回的实际大小；不是某一档的大小时（调用者只用了其中一部分）直接释放
+    static void release(char * buf, int size);
+
+private:
+    Buffer_Pool();
+    ~Buffer_Pool();
+
+    // 当前线程的缓冲区池
+    static Buffer_Pool & local();
+
+    // 大小为size的缓冲区在哪一档，超过最大一档返回-1
+    static int class_of(int size);
+
+private:
+    vector<char *> m_free[BUFFER_CLASS_NUM];    // 每一档的空闲缓冲区
+};
+
+#endif
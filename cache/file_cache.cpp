@@ -0,0 +1,434 @@
+#include "file_cache.h"
+
+// 扩展名和Content-Type的对应关系，compressible表示是否是值得压缩的文本类型
+struct Mime_Type {
+    const char * ext;
+    const char * type;
+    bool compressible;
+};
+
+static const Mime_Type mime_types[] = {
+    { ".html", "text/html", true },
+    { ".htm", "text/html", true },
+    { ".css", "text/css", true },
+    { ".js", "application/javascript", true },
+    { ".json", "application/json", true },
+    { ".xml", "application/xml", true },
+    { ".svg", "image/svg+xml", true },
+    { ".txt", "text/plain", true },
+    { ".jpg", "image/jpeg", false },
+    { ".jpeg", "image/jpeg", false },
+    { ".png", "image/png", false },
+    { ".gif", "image/gif", false },
+    { ".webp", "image/webp", false },
+    { ".ico", "image/x-icon", false },
+    { ".mp4", "video/mp4", false },
+    { ".pdf", "application/pdf", false },
+    { ".gz", "application/gzip", false },
+    { ".br", "application/octet-stream", false },
+};
+
+// 预压缩文件的后缀和编码名，按优先级排列（同样都接受时优先br）
+struct Encoding_Type {
+    int encoding;
+    const char * suffix;
+    const char * name;
+};
+
+static const Encoding_Type encoding_types[] = {
+    { ENCODING_BR, ".br", "br" },
+    { ENCODING_GZIP, ".gz", "gzip" },
+};
+
+File_Cache::File_Cache() : m_max_bytes(0), m_max_entries(0) {
+    for(int i = 0; i < FILE_CACHE_SHARDS; i++) {
+        m_shards[i].hand = 0;
+        m_shards[i].bytes = 0;
+    }
+}
+
+File_Cache::~File_Cache() {
+    for(int i = 0; i < FILE_CACHE_SHARDS; i++) {
+        Shard & shard = m_shards[i];
+        for(size_t j = 0; j < shard.clock.size(); j++) {
+            release(shard.clock[j]);
+        }
+    }
+}
+
+File_Cache * File_Cache::get_instance() {
+    // C++11以后局部静态变量的初始化是线程安全的
+    static File_Cache instance;
+    return &instance;
+}
+
+void File_Cache::init(const char * root, long max_bytes) {
+    m_root = root;
+    m_max_bytes = max_bytes / FILE_CACHE_SHARDS;
+    // 内存上限为0表示关闭缓存，每次请求都重新打开文件
+    m_max_entries = (max_bytes > 0) ? FILE_CACHE_MAX_ENTRIES / FILE_CACHE_SHARDS : 0;
+}
+
+bool File_Cache::normalize(const char * url, char * out, int out_len) {
+    if(!url || url[0] != '/') {
+        return false;
+    }
+    int len = 0;
+    const char * p = url;
+    // 查询参数和片段不属于文件路径
+    while(*p && *p != '?' && *p != '#') {
+        // 跳过连续的'/'
+        while(*p == '/') {
+            p++;
+        }
+        const char * seg = p;
+        while(*p && *p != '/' && *p != '?' && *p != '#') {
+            p++;
+        }
+        int seg_len = p - seg;
+        if(seg_len == 0 || (seg_len == 1 && seg[0] == '.')) {
+            continue;
+        }
+        if(seg_len == 2 && seg[0] == '.' && seg[1] == '.') {
+            // 回到上一级目录，已经在根目录就停在根目录
+            while(len > 0 && out[len - 1] != '/') {
+                len--;
+            }
+            if(len > 0) {
+                len--;
+            }
+            continue;
+        }
+        if(len + 1 + seg_len >= out_len) {
+            return false;
+        }
+        out[len++] = '/';
+        memcpy(out + len, seg, seg_len);
+        len += seg_len;
+    }
+    if(len == 0) {
+        out[len++] = '/';
+    }
+    out[len] = '\0';
+    return true;
+}
+
+File_Cache::Shard & File_Cache::shard_of(const string & key) {
+    return m_shards[hash<string>()(key) % FILE_CACHE_SHARDS];
+}
+
+const char * File_Cache::mime_of(const char * path, bool * compressible) {
+    const char * ext = strrchr(path, '.');
+    if(ext && !strchr(ext, '/')) {
+        for(size_t i = 0; i < sizeof(mime_types) / sizeof(mime_types[0]); i++) {
+            if(strcasecmp(ext, mime_types[i].ext) == 0) {
+                *compressible = mime_types[i].compressible;
+                return mime_types[i].type;
+            }
+        }
+    }
+    *compressible = false;
+    return "application/octet-stream";
+}
+
+int File_Cache::find_variants(const string & path, const struct stat & st) {
+    int variants = 0;
+    for(size_t i = 0; i < sizeof(encoding_types) / sizeof(encoding_types[0]); i++) {
+        struct stat vst;
+        string vpath = m_root + path + encoding_types[i].suffix;
+        // 比原文件旧的预压缩文件说明原文件改过了但没有重新压缩，不能用
+        if(stat(vpath.c_str(), &vst) == 0 && S_ISREG(vst.st_mode) && (vst.st_mode & S_IROTH)
+           && vst.st_mtime >= st.st_mtime) {
+            variants |= encoding_types[i].encoding;
+        }
+    }
+    return variants;
+}
+
+File_Entry * File_Cache::load(const string & key, const string & path, int encoding, int & err) {
+    string full_path = m_root + path;
+    int fd = open(full_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        err = (errno == EACCES) ? EACCES : ENOENT;
+        return NULL;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        close(fd);
+        err = ENOENT;
+        return NULL;
+    }
+    // 判断是否有读的访问权限
+    if(!(st.st_mode & S_IROTH)) {
+        close(fd);
+        err = EACCES;
+        return NULL;
+    }
+    // 判断是否是目录
+    if(S_ISDIR(st.st_mode)) {
+        close(fd);
+        err = EISDIR;
+        return NULL;
+    }
+
+    File_Entry * entry = new File_Entry;
+    entry->key = key;
+    entry->path = path;
+    entry->encoding = encoding;
+    // 预压缩版本的Content-Type和原文件一样，所以去掉.br/.gz后缀再取
+    string original = (encoding == ENCODING_IDENTITY) ? path : path.substr(0, path.rfind('.'));
+    entry->mime = mime_of(original.c_str(), &entry->compressible);
+    entry->fd = fd;
+    entry->st = st;
+    entry->data = NULL;
+    entry->refcount = 1;
+    entry->referenced = true;
+    entry->checked = Coarse_Clock::now();
+
+    // 小文件直接读到内存里，文件可以关闭，之后发送时不需要sendfile也不需要mmap
+    // 用读出来的快照而不是mmap，这样文件在这期间被截断也不会和Content-Length对不上
+    // 读到内存里的文件不超过分片内存上限的1/FILE_CACHE_PIN_SHARE，缓存很小时一个文件也不会挤掉整个分片
+    if(m_max_bytes > 0 && st.st_size <= FILE_CACHE_PIN_MAX && st.st_size <= m_max_bytes / FILE_CACHE_PIN_SHARE) {
+        entry->data = new char[st.st_size > 0 ? st.st_size : 1];
+        long done = 0;
+        while(done < st.st_size) {
+            ssize_t n = pread(fd, entry->data + done, st.st_size - done, done);
+            if(n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        if(done == st.st_size) {
+            close(fd);
+            entry->fd = -1;
+        } else {
+            delete [] entry->data;
+            entry->data = NULL;
+        }
+    }
+
+    // 文本类型的原文件才去找预压缩版本
+    entry->variants = (encoding == ENCODING_IDENTITY && entry->compressible) ? find_variants(path, st) : 0;
+
+    // 校验器，文件被替换（inode变）、修改（mtime变）或截断（size变）后都会不同
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx.%lx\"", (unsigned long)st.st_ino, (unsigned long)st.st_size,
+             (unsigned long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec);
+    entry->etag = etag;
+    entry->last_modified = http_date(st.st_mtime);
+
+    // 预先生成响应头，Connection和空行每个请求自己加
+    char headers[512];
+    int len = 0;
+    for(size_t i = 0; i < sizeof(encoding_types) / sizeof(encoding_types[0]); i++) {
+        if(encoding == encoding_types[i].encoding) {
+            len += snprintf(headers + len, sizeof(headers) - len, "Content-Encoding: %s\r\n", encoding_types[i].name);
+        }
+    }
+    // 同一个URL按Accept-Encoding可能返回不同的内容，告诉缓存代理要区分
+    if(entry->compressible) {
+        len += snprintf(headers + len, sizeof(headers) - len, "Vary: Accept-Encoding\r\n");
+    }
+    snprintf(headers + len, sizeof(headers) - len, "Accept-Ranges: bytes\r\nETag: %s\r\nLast-Modified: %s\r\n",
+             entry->etag.c_str(), entry->last_modified.c_str());
+    entry->common_headers = headers;
+    snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length: %ld\r\nContent-Type:%s\r\n",
+             (long)st.st_size, entry->mime);
+    entry->headers = headers + entry->common_headers;
+
+    entry->charge = sizeof(File_Entry) + entry->key.size() + entry->headers.size() + entry->common_headers.size()
+                    + entry->etag.size() + entry->last_modified.size();
+    if(entry->data) {
+        entry->charge += st.st_size;
+    }
+    return entry;
+}
+
+bool File_Cache::is_stale(File_Entry * entry) {
+    time_t now = Coarse_Clock::now();
+    if(now - entry->checked < FILE_CACHE_REVALIDATE) {
+        return false;
+    }
+    entry->checked = now;
+    struct stat st;
+    string path = m_root + entry->path;
+    if(stat(path.c_str(), &st) < 0) {
+        return true;
+    }
+    if(st.st_ino != entry->st.st_ino || st.st_size != entry->st.st_size
+        || st.st_mtim.tv_sec != entry->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != entry->st.st_mtim.tv_nsec
+        || st.st_mode != entry->st.st_mode) {
+        return true;
+    }
+    // 预压缩文件新增或者删除了也要重新加载
+    return entry->encoding == ENCODING_IDENTITY && entry->compressible && find_variants(entry->path, st) != entry->variants;
+}
+
+int File_Cache::acquire(const char * url, int accept_encoding, File_Entry ** entry) {
+    char key[FILE_CACHE_MAX_PATH];
+    if(!normalize(url, key, sizeof(key))) {
+        return ENOENT;
+    }
+    string k(key);
+    File_Entry * original = NULL;
+    int err = acquire_key(k, k, ENCODING_IDENTITY, &original);
+    if(err != 0) {
+        return err;
+    }
+
+    // 客户端接受、并且磁盘上有预压缩版本，就返回预压缩版本
+    // 预压缩版本加载失败（比如刚被删除）就回退到原文件
+    int usable = original->variants & accept_encoding;
+    for(size_t i = 0; usable && i < sizeof(encoding_types) / sizeof(encoding_types[0]); i++) {
+        const Encoding_Type & enc = encoding_types[i];
+        if(!(usable & enc.encoding)) {
+            continue;
+        }
+        File_Entry * variant = NULL;
+        if(acquire_key(string(enc.name) + ":" + k, k + enc.suffix, enc.encoding, &variant) == 0) {
+            release(original);
+            *entry = variant;
+            return 0;
+        }
+    }
+    *entry = original;
+    return 0;
+}
+
+int File_Cache::acquire_key(const string & k, const string & path, int encoding, File_Entry ** entry) {
+    Shard & shard = shard_of(k);
+
+    // 1.命中：只增加引用计数和设置访问位，文件系统的调用都不需要
+    shard.lock.lock();
+    unordered_map<string, File_Entry *>::iterator it = shard.table.find(k);
+    if(it != shard.table.end()) {
+        File_Entry * cached = it->second;
+        cached->refcount++;
+        cached->referenced = true;
+        shard.lock.unlock();
+        if(!is_stale(cached)) {
+            *entry = cached;
+            return 0;
+        }
+        // 文件被修改了，从缓存中删除，重新加载
+        shard.lock.lock();
+        it = shard.table.find(k);
+        if(it != shard.table.end() && it->second == cached) {
+            remove(shard, cached);
+        }
+        shard.lock.unlock();
+        release(cached);
+    } else {
+        shard.lock.unlock();
+    }
+
+    // 2.未命中：在锁外打开文件
+    int err = 0;
+    File_Entry * loaded = load(k, path, encoding, err);
+    if(!loaded) {
+        return err;
+    }
+
+    // 3.插入到缓存中，如果别的线程已经先插入了就用它的
+    shard.lock.lock();
+    it = shard.table.find(k);
+    if(it != shard.table.end()) {
+        File_Entry * cached = it->second;
+        cached->refcount++;
+        cached->referenced = true;
+        shard.lock.unlock();
+        release(loaded);
+        *entry = cached;
+        return 0;
+    }
+    if(m_max_entries > 0) {
+        insert(shard, loaded);
+    }
+    shard.lock.unlock();
+    *entry = loaded;
+    return 0;
+}
+
+void File_Cache::release(File_Entry * entry) {
+    if(!entry) {
+        return;
+    }
+    if(--entry->refcount == 0) {
+        if(entry->fd != -1) {
+            close(entry->fd);
+        }
+        delete [] entry->data;
+        delete entry;
+    }
+}
+
+void File_Cache::insert(Shard & shard, File_Entry * entry) {
+    // 整个分片都放不下的不缓存，这次请求用完就释放
+    if(entry->charge > m_max_bytes) {
+        return;
+    }
+    while(!shard.clock.empty() && ((int)shard.clock.size() >= m_max_entries || shard.bytes + entry->charge > m_max_bytes)) {
+        evict(shard);
+    }
+    // 缓存持有一个引用
+    entry->refcount++;
+    shard.table[entry->key] = entry;
+    shard.clock.push_back(entry);
+    shard.bytes += entry->charge;
+}
+
+void File_Cache::remove(Shard & shard, File_Entry * entry) {
+    shard.table.erase(entry->key);
+    for(size_t i = 0; i < shard.clock.size(); i++) {
+        if(shard.clock[i] == entry) {
+            shard.clock[i] = shard.clock.back();
+            shard.clock.pop_back();
+            break;
+        }
+    }
+    shard.bytes -= entry->charge;
+    // 正在发送它的连接还持有引用，等它们都发送完才真正释放
+    release(entry);
+}
+
+void File_Cache::evict(Shard & shard) {
+    // CLOCK：访问位为1的给第二次机会（清零后跳过），遇到访问位为0的就淘汰
+    while(!shard.clock.empty()) {
+        if(shard.hand >= shard.clock.size()) {
+            shard.hand = 0;
+        }
+        File_Entry * entry = shard.clock[shard.hand];
+        if(entry->referenced) {
+            entry->referenced = false;
+            shard.hand++;
+        } else {
+            remove(shard, entry);
+            return;
+        }
+    }
+}
+
+string File_Cache::http_date(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+time_t File_Cache::parse_http_date(const char * text, int len) {
+    // 只接受RFC 7231推荐的IMF-fixdate格式，过时的格式当作无法解析（按没有这个头部处理）
+    char buf[64];
+    if(len <= 0 || len >= (int)sizeof(buf)) {
+        return -1;
+    }
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char * end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end || *end != '\0') {
+        return -1;
+    }
+    return timegm(&tm);
+}
@@ -0,0 +1,133 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../locker/locker.h"
+#include "../timer/coarse_clock.h"
+using namespace std;
+
+const int FILE_CACHE_SHARDS = 16;               // 分片数量，每个分片一把锁，减少工作线程之间的竞争
+const int FILE_CACHE_MAX_ENTRIES = 1024;        // 最多缓存多少个文件（也就是最多占用多少个文件描述符）
+const long FILE_CACHE_PIN_MAX = 256 * 1024;     // 小于这个大小的文件，内容直接读到内存里
+const int FILE_CACHE_PIN_SHARE = 4;             // 读到内存里的文件还不能超过每个分片内存上限的几分之一
+const int FILE_CACHE_REVALIDATE = 2;            // 每隔多少秒最多stat一次，检查文件是否被修改
+const int FILE_CACHE_MAX_PATH = 512;            // 规范化后URL路径的最大长度
+
+// 内容编码，按位组合表示客户端接受哪些编码（Accept-Encoding）或者文件有哪些预压缩版本
+enum CONTENT_ENCODING { ENCODING_IDENTITY = 0, ENCODING_GZIP = 1, ENCODING_BR = 2 };
+
+/**
+ * 缓存的一个文件
+ * 通过引用计数管理生命周期：缓存本身持有一个引用，每个正在发送它的连接各持有一个引用，
+ * 被淘汰或者失效后从表里删除，最后一个引用释放时才关闭文件、释放内存
+*/
+struct File_Entry {
+    string key;                 // 缓存的key，原文件是规范化后的URL路径，预压缩版本前面加上编码名
+    string path;                // 相对于根目录的文件路径（预压缩版本带.gz/.br后缀）
+    int encoding;               // 文件内容的编码（CONTENT_ENCODING）
+    int variants;               // 原文件旁边存在哪些预压缩版本（CONTENT_ENCODING按位或）
+    const char * mime;          // 原文件的Content-Type
+    bool compressible;          // 是否是值得压缩的文本类型（响应需要带Vary: Accept-Encoding）
+    int fd;                     // 打开的文件，-1表示文件内容已经全部在data里了
+    struct stat st;             // 文件的状态信息
+    char * data;                // 小文件的内容（读到内存里的快照，和st、headers永远一致）
+    string etag;                // 强校验器，由inode、大小和修改时间生成（带引号）
+    string last_modified;       // 修改时间（HTTP-date格式）
+    string headers;             // 预先生成的响应头（状态行、Content-Length、Content-Type、common_headers，不含Connection和空行）
+    string common_headers;      // 和状态、长度、类型无关的响应头（Content-Encoding、Vary、Accept-Ranges、ETag、Last-Modified），206响应也用
+    long charge;                // 占用的缓存内存
+    atomic<int> refcount;       // 引用计数
+    atomic<bool> referenced;    // CLOCK算法的访问位
+    atomic<time_t> checked;     // 上一次检查文件是否被修改的时间
+};
+
+/**
+ * 进程内共享的打开文件缓存（单例）
+ * 以规范化后的URL路径为key，保存文件描述符、stat信息、小文件内容和预先生成的响应头，
+ * 热点文件预热之后，每次请求都不需要再stat/open/mmap
+ * - 分片 + 每个分片一把Locker，保证并发安全
+ * - 条目数量和内存都有上限，超过后用CLOCK算法淘汰
+ * - 每隔FILE_CACHE_REVALIDATE秒最多stat一次，mtime/size/inode变了就重新加载
+ * - 文本类型的文件旁边如果有不比它旧的.br/.gz预压缩文件，按客户端的Accept-Encoding优先返回预压缩版本
+*/
+class File_Cache {
+public:
+    static File_Cache * get_instance();
+
+    // 初始化，root为网站资源的根目录，max_bytes为缓存小文件内容的内存上限（0表示不缓存）
+    void init(const char * root, long max_bytes);
+
+    // 获取url对应的文件，成功返回0并增加引用计数，用完后必须调用release
+    // accept_encoding为客户端接受的编码，有对应的预压缩版本时返回预压缩版本
+    // 失败返回 ENOENT（不存在） EACCES（没有权限） EISDIR（是目录）
+    int acquire(const char * url, int accept_encoding, File_Entry ** entry);
+
+    // 释放一个引用
+    void release(File_Entry * entry);
+
+    // 把url规范化：去掉查询参数，合并多余的'/'，处理'.'和'..'（不能跳出根目录）
+    static bool normalize(const char * url, char * out, int out_len);
+
+    // 根据扩展名获取Content-Type，compressible返回是否值得压缩
+    static const char * mime_of(const char * path, bool * compressible);
+
+    // 把时间格式化为HTTP-date（Sun, 06 Nov 1994 08:49:37 GMT），解析失败返回-1
+    static string http_date(time_t t);
+    static time_t parse_http_date(const char * text, int len);
+
+private:
+    File_Cache();
+    ~File_Cache();
+
+    // 一个分片
+    struct Shard {
+        Locker lock;
+        unordered_map<string, File_Entry *> table;
+        vector<File_Entry *> clock;     // CLOCK算法的环
+        size_t hand;                    // CLOCK算法的指针
+        long bytes;                     // 本分片占用的内存
+    };
+
+    Shard & shard_of(const string & key);
+
+    // 按缓存的key获取条目，未命中就从path加载
+    int acquire_key(const string & key, const string & path, int encoding, File_Entry ** entry);
+
+    // 打开文件并生成一个新的条目（不加锁）
+    File_Entry * load(const string & key, const string & path, int encoding, int & err);
+
+    // 检查原文件旁边有哪些不比它旧的预压缩版本
+    int find_variants(const string & path, const struct stat & st);
+
+    // 文件是否被修改了
+    bool is_stale(File_Entry * entry);
+
+    // 插入到分片中，必要时淘汰其他条目（调用者持有分片的锁）
+    void insert(Shard & shard, File_Entry * entry);
+
+    // 从分片中删除（调用者持有分片的锁）
+    void remove(Shard & shard, File_Entry * entry);
+
+    // 用CLOCK算法淘汰一个条目（调用者持有分片的锁）
+    void evict(Shard & shard);
+
+private:
+    string m_root;                      // 网站资源的根目录
+    long m_max_bytes;                   // 每个分片的内存上限
+    int m_max_entries;                  // 每个分片的条目上限
+    Shard m_shards[FILE_CACHE_SHARDS];
+};
+
+#endif
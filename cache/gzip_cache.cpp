@@ -0,0 +1,207 @@
+#include "gzip_cache.h"
+
+Gzip_Cache::Gzip_Cache() : m_max_bytes(0), m_bytes(0), m_hand(0), m_pool(NULL) {}
+
+Gzip_Cache::~Gzip_Cache() {
+    // 线程池属于服务器，析构时已经执行完了所有压缩任务
+    for(size_t i = 0; i < m_clock.size(); i++) {
+        release(m_clock[i]);
+    }
+}
+
+Gzip_Cache * Gzip_Cache::get_instance() {
+    static Gzip_Cache instance;
+    return &instance;
+}
+
+void Gzip_Cache::init(long max_bytes) {
+    m_max_bytes = max_bytes;
+}
+
+bool Gzip_Cache::eligible(File_Entry * file) {
+    return m_max_bytes > 0 && file->encoding == ENCODING_IDENTITY && file->compressible
+        && file->st.st_size >= GZIP_MIN_SIZE && file->st.st_size <= GZIP_MAX_SIZE;
+}
+
+string Gzip_Cache::key_of(File_Entry * file) {
+    // 文件修改后mtime或大小会变，key也就变了，不需要主动让旧的结果失效
+    char suffix[96];
+    snprintf(suffix, sizeof(suffix), "|%ld.%09ld|%ld|gzip", (long)file->st.st_mtim.tv_sec,
+             (long)file->st.st_mtim.tv_nsec, (long)file->st.st_size);
+    return file->key + suffix;
+}
+
+Gzip_Entry * Gzip_Cache::acquire(File_Entry * file, bool wait) {
+    string key = key_of(file);
+
+    m_lock.lock();
+    unordered_map<string, Gzip_Entry *>::iterator it = m_table.find(key);
+    if(it != m_table.end()) {
+        Gzip_Entry * entry = it->second;
+        entry->referenced = true;
+        if(!entry->data) {
+            // 压缩过了但没有变小
+            m_lock.unlock();
+            return NULL;
+        }
+        entry->refcount++;
+        m_lock.unlock();
+        return entry;
+    }
+    if(m_pending.count(key) || (!wait && (!m_pool || (int)m_pending.size() >= GZIP_MAX_PENDING))) {
+        // 其他线程正在压缩，或者排队的压缩任务太多了，这一次先不压缩
+        m_lock.unlock();
+        return NULL;
+    }
+    m_pending.insert(key);
+    m_lock.unlock();
+
+    if(wait) {
+        Gzip_Entry * entry = compress(file, key);
+        if(entry && !entry->data) {
+            release(entry);
+            return NULL;
+        }
+        return entry;
+    }
+
+    // 交给线程池压缩，任务持有文件的一个引用
+    // 只捕获两个指针，提交时不分配内存；key由文件的属性决定，在工作线程里重新生成
+    file->refcount++;
+    bool queued = m_pool->submit([this, file] {
+        release(compress(file, key_of(file)));
+        File_Cache::get_instance()->release(file);
+    }, TASK_EXPENSIVE);
+    if(!queued) {
+        // 队列满了就放弃这次压缩，下次请求再试
+        file->refcount--;
+        m_lock.lock();
+        m_pending.erase(key);
+        m_lock.unlock();
+    }
+    return NULL;
+}
+
+Gzip_Entry * Gzip_Cache::compress(File_Entry * file, const string & key) {
+    long size = file->st.st_size;
+
+    // 小文件直接用缓存里的内容，大文件从缓存打开的fd里读出来
+    char * src = file->data;
+    char * buf = NULL;
+    if(!src) {
+        buf = new char[size];
+        long done = 0;
+        while(done < size) {
+            ssize_t n = pread(file->fd, buf + done, size - done, done);
+            if(n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        if(done != size) {
+            delete [] buf;
+            m_lock.lock();
+            m_pending.erase(key);
+            m_lock.unlock();
+            return NULL;
+        }
+        src = buf;
+    }
+
+    Gzip_Entry * entry = new Gzip_Entry;
+    entry->key = key;
+    entry->data = NULL;
+    entry->size = 0;
+    entry->refcount = 1;
+    entry->referenced = true;
+
+    // windowBits加16表示输出gzip格式（带gzip头和CRC）
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+        uLong bound = deflateBound(&zs, size);
+        char * out = new char[bound];
+        zs.next_in = (Bytef *)src;
+        zs.avail_in = size;
+        zs.next_out = (Bytef *)out;
+        zs.avail_out = bound;
+        if(deflate(&zs, Z_FINISH) == Z_STREAM_END && (long)zs.total_out < size) {
+            entry->size = zs.total_out;
+            entry->data = new char[entry->size];
+            memcpy(entry->data, out, entry->size);
+        }
+        delete [] out;
+        deflateEnd(&zs);
+    }
+    delete [] buf;
+
+    if(entry->data) {
+        entry->etag = file->etag.substr(0, file->etag.size() - 1) + "-gzip\"";
+        char headers[512];
+        snprintf(headers, sizeof(headers), "HTTP/1.1 200 OK\r\nContent-Length: %ld\r\nContent-Type:%s\r\n"
+                 "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\nETag: %s\r\nLast-Modified: %s\r\n",
+                 entry->size, file->mime, entry->etag.c_str(), file->last_modified.c_str());
+        entry->headers = headers;
+    }
+    entry->charge = sizeof(Gzip_Entry) + entry->key.size() + entry->etag.size() + entry->headers.size() + entry->size;
+
+    m_lock.lock();
+    m_pending.erase(key);
+    Gzip_Entry * cached = insert(entry);
+    m_lock.unlock();
+    return cached;
+}
+
+void Gzip_Cache::release(Gzip_Entry * entry) {
+    if(!entry) {
+        return;
+    }
+    if(--entry->refcount == 0) {
+        delete [] entry->data;
+        delete entry;
+    }
+}
+
+Gzip_Entry * Gzip_Cache::insert(Gzip_Entry * entry) {
+    unordered_map<string, Gzip_Entry *>::iterator it = m_table.find(entry->key);
+    if(it != m_table.end()) {
+        Gzip_Entry * cached = it->second;
+        cached->refcount++;
+        release(entry);
+        return cached;
+    }
+    // 一个结果就超过了内存上限，不缓存，只给这一次请求用
+    if(entry->charge > m_max_bytes) {
+        return entry;
+    }
+    while(!m_clock.empty() && m_bytes + entry->charge > m_max_bytes) {
+        evict();
+    }
+    // 缓存持有一个引用
+    entry->refcount++;
+    m_table[entry->key] = entry;
+    m_clock.push_back(entry);
+    m_bytes += entry->charge;
+    return entry;
+}
+
+void Gzip_Cache::evict() {
+    // CLOCK：访问位为1的给第二次机会（清零后跳过），遇到访问位为0的就淘汰
+    while(!m_clock.empty()) {
+        if(m_hand >= m_clock.size()) {
+            m_hand = 0;
+        }
+        Gzip_Entry * entry = m_clock[m_hand];
+        if(entry->referenced) {
+            entry->referenced = false;
+            m_hand++;
+        } else {
+            m_table.erase(entry->key);
+            m_clock[m_hand] = m_clock.back();
+            m_clock.pop_back();
+            m_bytes -= entry->charge;
+            release(entry);
+            return;
+        }
+    }
+}
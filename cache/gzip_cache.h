@@ -0,0 +1,94 @@
+#ifndef GZIP_CACHE_H
+#define GZIP_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../locker/locker.h"
+#include "../threadpool/task_pool.h"
+#include "file_cache.h"
+using namespace std;
+
+const long GZIP_MIN_SIZE = 256;                 // 小于这个大小的文件压缩没有意义
+const long GZIP_MAX_SIZE = 8 * 1024 * 1024;     // 大于这个大小的文件不在线压缩
+const int GZIP_LEVEL = 6;                       // 压缩级别
+const int GZIP_MAX_PENDING = 1024;              // 最多排队多少个压缩任务（和请求共用线程池，不能把它占满）
+
+/**
+ * 在线压缩的结果
+ * 和File_Entry一样用引用计数管理生命周期，data为NULL表示压缩后没有变小，不值得压缩
+*/
+struct Gzip_Entry {
+    string key;                 // 缓存的key（路径 + mtime + size + 编码）
+    char * data;                // 压缩后的内容
+    long size;                  // 压缩后的大小
+    string etag;                // 在原文件的ETag上加-gzip，和原文件的内容区分开
+    string headers;             // 预先生成的响应头（不含Connection和空行）
+    long charge;                // 占用的缓存内存
+    atomic<int> refcount;       // 引用计数
+    atomic<bool> referenced;    // CLOCK算法的访问位
+};
+
+/**
+ * 在线gzip压缩结果的缓存（单例）
+ * 没有预压缩文件的文本类型文件，第一次被接受gzip的客户端请求时压缩一次，之后直接从内存发送
+ * - key包含路径、mtime和大小，文件修改后自然换成新的key，旧的结果被CLOCK淘汰
+ * - 压缩结果占用的内存有上限
+ * - epoll后端在工作线程里请求，直接同步压缩；io_uring后端在事件循环线程里请求，
+ *   作为TASK_EXPENSIVE任务交给服务器的线程池，这一次先返回未压缩的内容，避免大文件压缩卡住其他连接
+*/
+class Gzip_Cache {
+public:
+    static Gzip_Cache * get_instance();
+
+    // 初始化，max_bytes为压缩结果占用的内存上限（0表示关闭在线压缩）
+    void init(long max_bytes);
+
+    // 设置执行后台压缩的线程池（NULL表示没有，不等待的请求直接放弃压缩）
+    void set_pool(Task_Pool * pool) { m_pool = pool; }
+
+    // 这个文件是否值得在线压缩
+    bool eligible(File_Entry * file);
+
+    // 获取文件压缩后的内容，成功时增加引用计数，用完后必须调用release
+    // wait为false时未命中不会阻塞，而是交给线程池压缩，返回NULL
+    Gzip_Entry * acquire(File_Entry * file, bool wait);
+
+    // 释放一个引用
+    void release(Gzip_Entry * entry);
+
+    // 压缩file并插入缓存（后台压缩任务调用）
+    Gzip_Entry * compress(File_Entry * file, const string & key);
+
+private:
+    Gzip_Cache();
+    ~Gzip_Cache();
+
+    string key_of(File_Entry * file);
+
+    // 插入缓存，key已经存在就返回已经存在的条目（调用者持有锁）
+    Gzip_Entry * insert(Gzip_Entry * entry);
+
+    // 用CLOCK算法淘汰一个条目（调用者持有锁）
+    void evict();
+
+private:
+    long m_max_bytes;               // 内存上限
+    long m_bytes;                   // 已经占用的内存
+    Locker m_lock;
+    unordered_map<string, Gzip_Entry *> m_table;
+    vector<Gzip_Entry *> m_clock;   // CLOCK算法的环
+    size_t m_hand;                  // CLOCK算法的指针
+    unordered_set<string> m_pending; // 已经交给线程池、还没有压缩完的key
+    Task_Pool * m_pool;             // 执行后台压缩的线程池（服务器的线程池）
+};
+
+#endif
@@ -6,11 +6,22 @@ Config::Config() {
     lfd_trig_mode = 0; // 监听文件描述符触发模式LT
     cfd_trig_mode = 0; // 通信文件描述符触发模式LT
     conn_thread_num = 8; // 通信线程连接数量默认8个
+    conn_thread_min = 0; // 默认线程数固定
+    pool_report = 0; // 默认不输出线程池的延迟
     sql_thread_num = 5; // 连接数据库的线程默认5个
     log_open = 1; // 默认打开日志记录
     log_write_way = 0; // 默认同步方式记录日志
     socket_linger_opt = 0; // 默认不强制close文件描述符
     actor_mode = 1; // 默认为Proactor模式
+    reactor_num = 1; // 默认只有一个事件循环
+    io_backend = 0; // 默认使用epoll
+    cache_size = 64; // 默认文件缓存64MB
+    gzip_cache_size = 32; // 默认在线压缩缓存32MB
+    buffer_max_size = 64; // 默认读写缓冲区最大64KB
+    tls_port = 0; // 默认不开启TLS
+    tls_cert = "server.crt"; // 默认证书文件
+    tls_key = "server.key"; // 默认私钥文件
+    proxy_policy = 0; // 默认轮询
 }
 
 Config::~Config(){}
@@ -50,8 +61,8 @@ void Config::parse_arg_(int argc, char * argv[]) {
     // 这里主函数会传入参数argc和argv
     // 其中argc是包含了地址的数量，即参数数量+1
     int optVal; // 选项
-    const char * optStr = "p:t:c:s:o:w:l:a:";
-    while((optVal == getopt(argc, argv, optStr)) != -1) {
+    const char * optStr = "p:t:c:n:T:s:o:w:l:a:r:i:m:z:b:S:C:K:U:L:";
+    while((optVal = getopt(argc, argv, optStr)) != -1) {
         switch(optVal) {
             case 'p': {
                 // 设置端口号
@@ -69,6 +80,16 @@ void Config::parse_arg_(int argc, char * argv[]) {
                 conn_thread_num = atoi(optarg);
                 break;
             }
+            case 'n': {
+                // 设置最少的线程数量（线程池按负载伸缩）
+                conn_thread_min = atoi(optarg);
+                break;
+            }
+            case 'T': {
+                // 设置是否输出线程池的延迟
+                pool_report = atoi(optarg);
+                break;
+            }
             case 's': {
                 // 设置连接数据库线程数量
                 sql_thread_num = atoi(optarg);
@@ -94,6 +115,68 @@ void Config::parse_arg_(int argc, char * argv[]) {
                 actor_mode = atoi(optarg);
                 break;
             }
+            case 'r': {
+                // 设置事件循环线程数量
+                reactor_num = atoi(optarg);
+                if(reactor_num <= 0) {
+                    reactor_num = 1;
+                }
+                break;
+            }
+            case 'i': {
+                // 设置I/O后端
+                io_backend = atoi(optarg);
+                break;
+            }
+            case 'm': {
+                // 设置文件缓存大小
+                cache_size = atoi(optarg);
+                if(cache_size < 0) {
+                    cache_size = 0;
+                }
+                break;
+            }
+            case 'z': {
+                // 设置在线压缩缓存大小
+                gzip_cache_size = atoi(optarg);
+                if(gzip_cache_size < 0) {
+                    gzip_cache_size = 0;
+                }
+                break;
+            }
+            case 'b': {
+                // 设置读写缓冲区上限
+                buffer_max_size = atoi(optarg);
+                if(buffer_max_size < 4) {
+                    buffer_max_size = 4;
+                }
+                break;
+            }
+            case 'S': {
+                // 设置HTTPS端口
+                tls_port = atoi(optarg);
+                break;
+            }
+            case 'C': {
+                // 设置TLS证书文件
+                tls_cert = optarg;
+                break;
+            }
+            case 'K': {
+                // 设置TLS私钥文件
+                tls_key = optarg;
+                break;
+            }
+            case 'U': {
+                // 添加一组反向代理的上游
+                upstreams.push_back(optarg);
+                break;
+            }
+            case 'L': {
+                // 设置反向代理的负载均衡策略
+                proxy_policy = atoi(optarg);
+                break;
+            }
             default:
                 break;
         }
@@ -3,6 +3,7 @@
 
 #include <unistd.h>
 #include <string>
+#include <vector>
 
 // config类是Server一些可配置的参数信息得到的
 // 当运行的过程中，在server后部添加一些配置信息，最终得到的config
@@ -47,6 +48,16 @@ public:
     // 默认 = 8
     int conn_thread_num;
 
+    // 通信线程池最少的线程数量，小于通信线程池线程数量时线程池按负载伸缩
+    // 任务排队太久时增加线程（不超过conn_thread_num），空闲太久的线程退出
+    // 默认 = 0 (线程数固定为conn_thread_num)
+    int conn_thread_min;
+
+    // 是否每TIME_SLOT秒输出一次线程池每个代价类别的任务数和延迟（p50/p99）
+    // - 0 : 不输出 (默认)
+    // - 1 : 输出
+    int pool_report;
+
     // 数据库连接线程池线程数量
     // 默认 = 5
     int sql_thread_num;
@@ -70,6 +81,54 @@ public:
     // - 0 Reactor : 主线程光接受请求，子线程读写数据，并且还要处理请求
     // - 1 Proactor : 主线程读写请求，子线程处理请求任务  (默认)
     int actor_mode;
+
+    // 事件循环（subreactor）线程数量
+    // 每个事件循环拥有自己的epoll树和SO_REUSEPORT监听socket
+    // 默认 = 1 (单reactor)
+    int reactor_num;
+
+    // I/O后端
+    // - 0 : epoll + recv/writev (默认)
+    // - 1 : io_uring（multishot accept/recv + provided buffer ring），内核不支持时回退到epoll
+    int io_backend;
+
+    // 打开文件缓存中小文件内容占用的内存上限，单位MB
+    // 0表示不缓存，每个请求都重新打开文件
+    // 默认 = 64
+    int cache_size;
+
+    // 在线gzip压缩结果占用的内存上限，单位MB
+    // 0表示关闭在线压缩（仍然会使用.gz/.br预压缩文件）
+    // 默认 = 32
+    int gzip_cache_size;
+
+    // 每个连接读写缓冲区的上限，单位KB
+    // 缓冲区按需从线程本地的缓冲区池借，请求头超过这个大小就断开连接，请求体超过这个大小回复413
+    // 默认 = 64
+    int buffer_max_size;
+
+    // HTTPS端口，和明文端口同时监听
+    // 0表示不开启TLS (默认)
+    int tls_port;
+
+    // TLS证书链文件（PEM）
+    // 默认 = server.crt
+    std::string tls_cert;
+
+    // TLS私钥文件（PEM）
+    // 默认 = server.key
+    std::string tls_key;
+
+    // 反向代理：把路径前缀转发给一组上游，可以多次指定
+    // 格式 /prefix=host:port,host:port，前缀为 / 时转发整个站点
+    // 请求体先完整地读进读缓冲区再转发，大小受-b限制，超过的请求回复413，不会转发给上游
+    // 默认没有
+    std::vector<std::string> upstreams;
+
+    // 反向代理的负载均衡策略
+    // - 0 : 轮询 (默认)
+    // - 1 : 最少连接
+    int proxy_policy;
 };
 
 
@@ -0,0 +1,1063 @@
+#include "h2_session.h"
+#include "http_conn.h"
+#include "router.h"
+#include <algorithm>
+#include <netinet/tcp.h>
+
+// 错误页面的内容和HTTP/1.1共用
+extern const char * error_400_form;
+extern const char * error_403_form;
+extern const char * error_404_form;
+extern const char * error_405_form;
+extern const char * error_413_form;
+extern const char * error_416_form;
+extern const char * error_500_form;
+extern const char * error_502_form;
+extern const char * ok_200_title;
+
+// 连接前言
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const int PREFACE_LEN = sizeof(preface) - 1;
+
+// 帧标志
+static const int FLAG_END_STREAM = 0x1;
+static const int FLAG_ACK = 0x1;
+static const int FLAG_END_HEADERS = 0x4;
+static const int FLAG_PADDED = 0x8;
+static const int FLAG_PRIORITY = 0x20;
+
+// SETTINGS的参数
+enum { SETTINGS_HEADER_TABLE_SIZE = 1, SETTINGS_ENABLE_PUSH, SETTINGS_MAX_CONCURRENT_STREAMS, SETTINGS_INITIAL_WINDOW_SIZE,
+       SETTINGS_MAX_FRAME_SIZE, SETTINGS_MAX_HEADER_LIST_SIZE };
+
+static const long MAX_WINDOW = 0x7fffffff;
+
+static inline uint32_t read_u32(const uint8_t * p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void write_u32(uint8_t * p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// HTTP2-Settings的值是不带填充的base64url
+static bool base64url_decode(string_view in, string & out) {
+    out.clear();
+    uint32_t acc = 0;
+    int bits = 0;
+    for(char ch : in) {
+        int v;
+        if(ch >= 'A' && ch <= 'Z') v = ch - 'A';
+        else if(ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+        else if(ch >= '0' && ch <= '9') v = ch - '0' + 52;
+        else if(ch == '-') v = 62;
+        else if(ch == '_') v = 63;
+        else if(ch == '=') break;
+        else return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+// Content-Range的值：bytes start-end/size，start为-1时是bytes */size
+static string_view content_range(char * buf, long start, long end, long size) {
+    char * p = buf;
+    memcpy(p, "bytes ", 6);
+    p += 6;
+    if(start < 0) {
+        *p++ = '*';
+    } else {
+        p += Header_Builder::format_ulong(p, start);
+        *p++ = '-';
+        p += Header_Builder::format_ulong(p, end);
+    }
+    *p++ = '/';
+    p += Header_Builder::format_ulong(p, size);
+    return string_view(buf, p - buf);
+}
+
+H2_Session::H2_Session(http_conn * conn) : m_conn(conn), m_next(0), m_preface_received(false), m_settings_sent(false),
+    m_goaway_sent(false), m_peer_goaway(false), m_last_stream_id(0), m_window(65535), m_peer_initial_window(65535),
+    m_peer_max_frame(16384), m_header_stream(0), m_header_end_stream(false), m_header_weight(16) {
+    // 同一个连接上的多个流交错发送，文件内容都要在内存里（缓存的小文件或者映射的大文件），不能sendfile
+    m_conn->m_use_sendfile = false;
+    // 一批的结尾常常是很小的帧（窗口剩下的几个字节、WINDOW_UPDATE、SETTINGS ACK），
+    // 不关闭Nagle的话会和对端的延迟确认互相等待几十毫秒
+    int nodelay = 1;
+    setsockopt(m_conn->m_sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+}
+
+H2_Session::~H2_Session() {
+    for(H2_Stream * s : m_streams) {
+        if(!s->closed) {
+            free_stream(s);
+        }
+    }
+    for(H2_Stream * s : m_done) {
+        free_stream(s);
+    }
+}
+
+int H2_Session::match_preface(const char * buf, int len) {
+    if(len <= 0) {
+        return -1;
+    }
+    int n = std::min(len, PREFACE_LEN);
+    if(memcmp(buf, preface, n) != 0) {
+        return -1;
+    }
+    return (n == PREFACE_LEN) ? 1 : 0;
+}
+
+bool H2_Session::upgrade(string_view settings, int ret) {
+    string payload;
+    if(!base64url_decode(settings, payload) || !apply_settings((const uint8_t *)payload.data(), payload.size())) {
+        return false;
+    }
+    write_settings();
+    // 升级的请求就是流1，已经是半关闭（远端）状态了
+    m_last_stream_id = 1;
+    H2_Stream * s = open_stream(1, 16);
+    s->end_received = true;
+    respond(s, ret);
+    return true;
+}
+
+bool H2_Session::process(bool read_more) {
+    for(H2_Stream * s : m_streams) {
+        s->chunk_used = 0;
+    }
+    if(!m_settings_sent) {
+        write_settings();
+    }
+    if(read_more && !m_conn->read()) {
+        return false;
+    }
+    if(!read_frames()) {
+        return false;
+    }
+    schedule();
+    // 出错发送了GOAWAY，或者对端GOAWAY之后所有的流都结束了，这一批发送完就关闭连接
+    m_conn->m_keep_alive = !m_goaway_sent && !(m_peer_goaway && m_streams.empty());
+    return true;
+}
+
+bool H2_Session::has_output() const {
+    if(m_goaway_sent || !m_preface_received) {
+        return false;
+    }
+    for(H2_Stream * s : m_streams) {
+        if(s->closed || s->waiting) {
+            continue;
+        }
+        // 数据源可能已经准备好响应头了
+        if(s->head_pending) {
+            return true;
+        }
+        if(!s->responded) {
+            continue;
+        }
+        // 流式响应要取下一块（或者发送结束的空DATA帧），不受窗口限制
+        if(s->remaining == 0 ? (s->source != NULL) : (s->window > 0 && m_window > 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void H2_Session::release_sent() {
+    for(H2_Stream * s : m_done) {
+        free_stream(s);
+    }
+    m_done.clear();
+}
+
+void H2_Session::wake() {
+    for(H2_Stream * s : m_streams) {
+        s->waiting = false;
+    }
+}
+
+// 处理读缓冲区中所有完整的帧，不完整的帧留在读缓冲区里等下一次
+bool H2_Session::read_frames() {
+    http_conn * c = m_conn;
+    if(c->m_read_index == 0) {
+        return true;
+    }
+    const uint8_t * buf = (const uint8_t *)c->m_read_buf;
+    int pos = 0;
+    if(!m_preface_received) {
+        int r = match_preface(c->m_read_buf, c->m_read_index);
+        if(r <= 0) {
+            return r == 0;
+        }
+        pos = PREFACE_LEN;
+        m_preface_received = true;
+    }
+    while(!m_goaway_sent && c->m_read_index - pos >= 9) {
+        // 写缓冲区中积压的控制帧和响应头太多了，剩下的帧等这一批发送完再处理
+        if(c->m_write_index > http_conn::m_buffer_max / 2) {
+            break;
+        }
+        const uint8_t * h = buf + pos;
+        int len = (h[0] << 16) | (h[1] << 8) | h[2];
+        if(len > MAX_FRAME_SIZE) {
+            goaway(H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if(c->m_read_index - pos - 9 < len) {
+            break;
+        }
+        pos += 9 + len;
+        if(!on_frame(h[3], h[4], read_u32(h + 5) & 0x7fffffff, h + 9, len)) {
+            break;
+        }
+    }
+    sweep();
+    if(m_goaway_sent) {
+        // 连接要关闭了，后面的数据不再处理
+        pos = c->m_read_index;
+    }
+    int left = c->m_read_index - pos;
+    if(left > 0 && pos > 0) {
+        memmove(c->m_read_buf, c->m_read_buf + pos, left);
+    }
+    c->m_read_index = left;
+    return true;
+}
+
+// 处理一个帧，返回false表示发送了GOAWAY，不再处理后面的帧
+bool H2_Session::on_frame(int type, int flags, int stream_id, const uint8_t * payload, int len) {
+    // 头部块必须连续，中间不能插入其他帧
+    if(m_header_stream != 0 && (type != H2_CONTINUATION || stream_id != m_header_stream)) {
+        goaway(H2_PROTOCOL_ERROR);
+        return false;
+    }
+    switch(type) {
+        case H2_DATA: {
+            if(stream_id == 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            // 请求体和HTTP/1.1一样不超过读缓冲区的上限，超过的流回复413，
+            // 所以收到多少就马上把连接和流的接收窗口还回去多少
+            if(len > 0) {
+                window_update(0, len);
+            }
+            H2_Stream * s = find(stream_id);
+            if(s && s->body_refused) {
+                return true;
+            }
+            if(!s || s->end_received) {
+                if(stream_id > m_last_stream_id) {
+                    goaway(H2_PROTOCOL_ERROR);
+                    return false;
+                }
+                rst_stream(stream_id, H2_STREAM_CLOSED);
+                return true;
+            }
+            // 流量控制按整个帧计算，包括填充
+            int frame_len = len;
+            int pad = 0;
+            if(flags & FLAG_PADDED) {
+                if(len < 1 || payload[0] >= len) {
+                    goaway(H2_PROTOCOL_ERROR);
+                    return false;
+                }
+                pad = payload[0];
+                payload++;
+                len--;
+            }
+            if(s->content.size() + (len - pad) > (size_t)http_conn::m_buffer_max) {
+                refuse_body(s);
+                return true;
+            }
+            s->content.append((const char *)payload, len - pad);
+            if(flags & FLAG_END_STREAM) {
+                s->end_received = true;
+                handle_request(s);
+            } else if(frame_len > 0) {
+                window_update(stream_id, frame_len);
+            }
+            return true;
+        }
+        case H2_HEADERS: {
+            if(stream_id == 0 || !(stream_id & 1)) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            int pad = 0;
+            int weight = 16;
+            if(flags & FLAG_PADDED) {
+                if(len < 1) {
+                    goaway(H2_FRAME_SIZE_ERROR);
+                    return false;
+                }
+                pad = payload[0];
+                payload++;
+                len--;
+            }
+            if(flags & FLAG_PRIORITY) {
+                if(len < 5) {
+                    goaway(H2_FRAME_SIZE_ERROR);
+                    return false;
+                }
+                weight = payload[4] + 1;
+                payload += 5;
+                len -= 5;
+            }
+            if(pad > len) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            m_header_block.assign((const char *)payload, len - pad);
+            m_header_stream = stream_id;
+            m_header_end_stream = flags & FLAG_END_STREAM;
+            m_header_weight = weight;
+            return (flags & FLAG_END_HEADERS) ? on_headers() : true;
+        }
+        case H2_CONTINUATION:
+            if(m_header_stream == 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if(m_header_block.size() + len > MAX_HEADER_BLOCK) {
+                goaway(H2_ENHANCE_YOUR_CALM);
+                return false;
+            }
+            m_header_block.append((const char *)payload, len);
+            return (flags & FLAG_END_HEADERS) ? on_headers() : true;
+        case H2_PRIORITY: {
+            if(stream_id == 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if(len != 5) {
+                goaway(H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            // 只使用权重，依赖关系忽略
+            H2_Stream * s = find(stream_id);
+            if(s) {
+                s->weight = payload[4] + 1;
+            }
+            return true;
+        }
+        case H2_RST_STREAM: {
+            if(stream_id == 0 || stream_id > m_last_stream_id) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if(len != 4) {
+                goaway(H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            H2_Stream * s = find(stream_id);
+            if(s) {
+                close_stream(s);
+            }
+            return true;
+        }
+        case H2_SETTINGS:
+            if(stream_id != 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if(flags & FLAG_ACK) {
+                if(len != 0) {
+                    goaway(H2_FRAME_SIZE_ERROR);
+                    return false;
+                }
+                return true;
+            }
+            if(len % 6 != 0) {
+                goaway(H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            if(!apply_settings(payload, len)) {
+                return false;
+            }
+            write_frame_header(0, H2_SETTINGS, FLAG_ACK, 0);
+            return true;
+        case H2_PUSH_PROMISE:
+            // 客户端不能推送
+            goaway(H2_PROTOCOL_ERROR);
+            return false;
+        case H2_PING:
+            if(stream_id != 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            if(len != 8) {
+                goaway(H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            if(!(flags & FLAG_ACK)) {
+                write_frame_header(8, H2_PING, FLAG_ACK, 0);
+                m_conn->add_bytes((const char *)payload, 8);
+            }
+            return true;
+        case H2_GOAWAY:
+            if(stream_id != 0) {
+                goaway(H2_PROTOCOL_ERROR);
+                return false;
+            }
+            // 不再接受新的流，已经开始的流发送完再关闭连接
+            m_peer_goaway = true;
+            return true;
+        case H2_WINDOW_UPDATE: {
+            if(len != 4) {
+                goaway(H2_FRAME_SIZE_ERROR);
+                return false;
+            }
+            long increment = read_u32(payload) & 0x7fffffff;
+            if(stream_id == 0) {
+                if(increment == 0) {
+                    goaway(H2_PROTOCOL_ERROR);
+                    return false;
+                }
+                m_window += increment;
+                if(m_window > MAX_WINDOW) {
+                    goaway(H2_FLOW_CONTROL_ERROR);
+                    return false;
+                }
+                return true;
+            }
+            H2_Stream * s = find(stream_id);
+            if(!s) {
+                return true;
+            }
+            if(increment == 0) {
+                rst_stream(stream_id, H2_PROTOCOL_ERROR);
+            } else if((s->window += increment) > MAX_WINDOW) {
+                rst_stream(stream_id, H2_FLOW_CONTROL_ERROR);
+            }
+            return true;
+        }
+        default:
+            // 不认识的帧类型直接忽略
+            return true;
+    }
+}
+
+// 一个完整的头部块：新的请求，或者请求体后面的尾部头部
+bool H2_Session::on_headers() {
+    int stream_id = m_header_stream;
+    m_header_stream = 0;
+    // 被拒绝的流的头部块也要解码，动态表要和对端保持一致
+    vector<Hpack_Field> fields;
+    if(!m_decoder.decode((const uint8_t *)m_header_block.data(), m_header_block.size(), fields)) {
+        goaway(H2_COMPRESSION_ERROR);
+        return false;
+    }
+    H2_Stream * s = find(stream_id);
+    if(!s) {
+        if(stream_id <= m_last_stream_id) {
+            // 已经关闭的流
+            goaway(H2_STREAM_CLOSED);
+            return false;
+        }
+        m_last_stream_id = stream_id;
+        sweep();
+        if(m_peer_goaway || m_streams.size() >= (size_t)MAX_STREAMS) {
+            rst_stream(stream_id, H2_REFUSED_STREAM);
+            return true;
+        }
+        s = open_stream(stream_id, m_header_weight);
+        s->request = std::move(fields);
+    } else if(!m_header_end_stream || s->end_received) {
+        // 尾部头部必须结束这个流
+        rst_stream(stream_id, H2_PROTOCOL_ERROR);
+        return true;
+    }
+    if(m_header_end_stream) {
+        s->end_received = true;
+        handle_request(s);
+    }
+    return true;
+}
+
+bool H2_Session::apply_settings(const uint8_t * payload, int len) {
+    for(int i = 0; i + 6 <= len; i += 6) {
+        int id = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = read_u32(payload + i + 2);
+        switch(id) {
+            case SETTINGS_ENABLE_PUSH:
+                if(value > 1) {
+                    goaway(H2_PROTOCOL_ERROR);
+                    return false;
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if(value > MAX_WINDOW) {
+                    goaway(H2_FLOW_CONTROL_ERROR);
+                    return false;
+                }
+                // 已经打开的流的窗口按差值调整，可以变成负数
+                long delta = (long)value - m_peer_initial_window;
+                m_peer_initial_window = value;
+                for(H2_Stream * s : m_streams) {
+                    s->window += delta;
+                }
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if(value < 16384 || value > 16777215) {
+                    goaway(H2_PROTOCOL_ERROR);
+                    return false;
+                }
+                // 一个DATA帧不会超过我们自己的上限
+                m_peer_max_frame = std::min(value, (uint32_t)MAX_FRAME_SIZE);
+                break;
+            default:
+                // 响应头不使用动态表，SETTINGS_HEADER_TABLE_SIZE不影响编码器；其他参数不需要处理
+                break;
+        }
+    }
+    return true;
+}
+
+// 请求收完了，把伪头部和请求头放到http_conn中，交给do_request处理
+void H2_Session::handle_request(H2_Stream * s) {
+    http_conn * c = m_conn;
+    c->init_request();
+    string_view method, path;
+    for(const Hpack_Field & f : s->request) {
+        if(!f.name.empty() && f.name[0] == ':') {
+            if(f.name == ":method") {
+                method = f.value;
+            } else if(f.name == ":path") {
+                path = f.value;
+            } else if(f.name == ":authority") {
+                c->m_headers[HEADER_HOST] = f.value;
+                c->m_header_mask |= 1ULL << HEADER_HOST;
+            }
+            continue;
+        }
+        int id = header_table.find(f.name);
+        if(id < 0) {
+            continue;
+        }
+        c->m_headers[id] = f.value;
+        c->m_header_mask |= 1ULL << id;
+        if(id == HEADER_ACCEPT_ENCODING) {
+            c->m_accept_encoding = http_conn::parse_accept_encoding(f.value.c_str());
+        }
+    }
+    c->m_content = s->content.data();
+    c->m_content_length = s->content.size();
+    c->m_h2_fields = &s->request;
+    if(method.empty() || path.empty() || path[0] != '/') {
+        rst_stream(s->id, H2_PROTOCOL_ERROR);
+    } else {
+        int m = method_table.find(method);
+        int ret;
+        string url(path);
+        c->m_url = &url[0];
+        if(m >= 0) {
+            c->m_method = (http_conn::METHOD)m;
+            ret = c->do_request();
+        } else {
+            // 不认识的方法：路径存在就返回405
+            Route_Match match;
+            ret = (Router::get_instance()->match(-1, c->m_url, &match) == ROUTE_NOT_FOUND) ? http_conn::NO_RESOURCE
+                                                                                            : http_conn::METHOD_NOT_ALLOWED;
+            c->m_allow = match.allow;
+        }
+        respond(s, ret);
+    }
+    // 头部的值指向请求头的存储，处理完就清掉
+    c->m_url = 0;
+    c->m_header_mask = 0;
+    c->m_h2_fields = NULL;
+    c->m_content = NULL;
+    c->m_content_length = 0;
+    vector<Hpack_Field>().swap(s->request);
+    string().swap(s->content);
+}
+
+// 和HTTP/1.1一样回复413，响应发送完后用RST_STREAM(NO_ERROR)让客户端停止发送剩下的请求体（RFC 9113 8.1），
+// 在这之前收到的DATA直接丢弃（连接的接收窗口已经还回去了）
+void H2_Session::refuse_body(H2_Stream * s) {
+    http_conn * c = m_conn;
+    s->end_received = true;
+    s->body_refused = true;
+    string().swap(s->content);
+    c->init_request();
+    c->m_method = http_conn::POST;
+    for(const Hpack_Field & f : s->request) {
+        if(f.name == ":method" && f.value == "HEAD") {
+            c->m_method = http_conn::HEAD;
+        }
+    }
+    respond(s, http_conn::CONTENT_TOO_LARGE);
+    vector<Hpack_Field>().swap(s->request);
+}
+
+// 根据do_request的结果发送HEADERS，响应体交给调度器发送
+void H2_Session::respond(H2_Stream * s, int code) {
+    http_conn * c = m_conn;
+    bool head = (c->m_method == http_conn::HEAD);
+    // 响应体占用的资源转移到流上，流结束后释放
+    s->file = c->m_file;
+    s->gzip = c->m_gzip;
+    s->address = c->m_file_address;
+    s->address_len = c->m_file_stat.st_size;
+    c->m_file = NULL;
+    c->m_gzip = NULL;
+    c->m_file_address = 0;
+    File_Entry * f = s->file;
+
+    string block;
+    block.reserve(256);
+    char range[64];
+    const char * form = NULL;
+    switch(code) {
+        case http_conn::FILE_REQUEST:
+        case http_conn::PARTIAL_CONTENT: {
+            if(s->gzip) {
+                Hpack_Encoder::status(block, 200);
+                Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, (unsigned long)s->gzip->size);
+                Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, f->mime);
+                Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_ENCODING, "gzip");
+                Hpack_Encoder::literal(block, Hpack_Encoder::VARY, "Accept-Encoding");
+                Hpack_Encoder::literal(block, Hpack_Encoder::ETAG, s->gzip->etag);
+                Hpack_Encoder::literal(block, Hpack_Encoder::LAST_MODIFIED, f->last_modified);
+                s->body = s->gzip->data;
+                s->remaining = s->gzip->size;
+                break;
+            }
+            long size = s->address_len;
+            if(!f->data && !s->address && !head && size > 0) {
+                // HTTP/1.1升级过来的请求是按sendfile准备的，这里再映射
+                s->address = (char *)mmap(0, size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+                if(s->address == MAP_FAILED) {
+                    s->address = 0;
+                    rst_stream(s->id, H2_INTERNAL_ERROR);
+                    return;
+                }
+            }
+            char * base = f->data ? f->data : s->address;
+            long start = 0, len = size;
+            // 多个范围的multipart响应对HTTP/2没有什么好处，发送整个文件
+            bool partial = (code == http_conn::PARTIAL_CONTENT && c->m_range_count == 1);
+            if(partial) {
+                start = c->m_ranges[0].start;
+                len = c->m_ranges[0].end - start + 1;
+            }
+            Hpack_Encoder::status(block, partial ? 206 : 200);
+            Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, (unsigned long)len);
+            if(partial) {
+                Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_RANGE, content_range(range, start, c->m_ranges[0].end, size));
+            }
+            Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, f->mime);
+            if(f->encoding != ENCODING_IDENTITY) {
+                Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_ENCODING, (f->encoding == ENCODING_GZIP) ? "gzip" : "br");
+            }
+            if(f->compressible) {
+                Hpack_Encoder::literal(block, Hpack_Encoder::VARY, "Accept-Encoding");
+            }
+            Hpack_Encoder::literal(block, Hpack_Encoder::ACCEPT_RANGES, "bytes");
+            Hpack_Encoder::literal(block, Hpack_Encoder::ETAG, f->etag);
+            Hpack_Encoder::literal(block, Hpack_Encoder::LAST_MODIFIED, f->last_modified);
+            s->body = base ? base + start : NULL;
+            s->remaining = base ? len : 0;
+            break;
+        }
+        case http_conn::NOT_MODIFIED:
+            Hpack_Encoder::status(block, 304);
+            Hpack_Encoder::literal(block, Hpack_Encoder::ETAG, s->gzip ? s->gzip->etag : f->etag);
+            Hpack_Encoder::literal(block, Hpack_Encoder::LAST_MODIFIED, f->last_modified);
+            if(f->compressible) {
+                Hpack_Encoder::literal(block, Hpack_Encoder::VARY, "Accept-Encoding");
+            }
+            break;
+        case http_conn::RANGE_NOT_SATISFIABLE:
+            Hpack_Encoder::status(block, 416);
+            Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_RANGE, content_range(range, -1, 0, s->address_len));
+            form = error_416_form;
+            break;
+        case http_conn::STREAM_REQUEST:
+            // HTTP/2不需要chunked编码，每一块直接作为DATA帧发送，响应头由数据源决定
+            s->source = c->m_stream;
+            s->mime = c->m_stream_mime;
+            s->head_only = head;
+            s->head_pending = true;
+            c->m_stream = NULL;
+            stream_head(s);
+            return;
+        case http_conn::BAD_GATEWAY:
+            Hpack_Encoder::status(block, 502);
+            form = error_502_form;
+            break;
+        case http_conn::METHOD_NOT_ALLOWED:
+            Hpack_Encoder::status(block, 405);
+            Hpack_Encoder::literal(block, Hpack_Encoder::ALLOW, c->m_allow);
+            form = error_405_form;
+            break;
+        case http_conn::BAD_REQUEST:
+            Hpack_Encoder::status(block, 400);
+            form = error_400_form;
+            break;
+        case http_conn::CONTENT_TOO_LARGE:
+            Hpack_Encoder::status(block, 413);
+            form = error_413_form;
+            break;
+        case http_conn::NO_RESOURCE:
+            Hpack_Encoder::status(block, 404);
+            form = error_404_form;
+            break;
+        case http_conn::FORBIDDEN_REQUEST:
+            Hpack_Encoder::status(block, 403);
+            form = error_403_form;
+            break;
+        default:
+            Hpack_Encoder::status(block, 500);
+            form = error_500_form;
+            break;
+    }
+    if(form) {
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, (unsigned long)strlen(form));
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, "text/html");
+        s->body = (char *)form;
+        s->remaining = strlen(form);
+    }
+    finish_headers(s, block, head);
+}
+
+void H2_Session::stream_head(H2_Stream * s) {
+    Stream_Head h;
+    h.status = 200;
+    h.reason = ok_200_title;
+    h.content_length = Stream_Head::UNKNOWN_LENGTH;
+    int ret = s->source->head(&h);
+    if(ret == Stream_Source::AGAIN) {
+        s->waiting = true;
+        if(!m_conn->wait_source(s->source)) {
+            rst_stream(s->id, H2_INTERNAL_ERROR);
+        }
+        return;
+    }
+    s->head_pending = false;
+    string block;
+    block.reserve(256);
+    if(ret < 0) {
+        delete s->source;
+        s->source = NULL;
+        Hpack_Encoder::status(block, 502);
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, (unsigned long)strlen(error_502_form));
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, "text/html");
+        s->body = (char *)error_502_form;
+        s->remaining = strlen(error_502_form);
+    } else {
+        Hpack_Encoder::status(block, h.status);
+        if(s->mime) {
+            Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, s->mime);
+        }
+        if(h.content_length >= 0) {
+            Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, (unsigned long)h.content_length);
+        }
+        // 数据源的头部每一行是 "name: value\r\n"，名字已经是小写的，不在静态表中查找，直接用新名字的字面量
+        string_view lines = h.headers;
+        size_t end;
+        while((end = lines.find("\r\n")) != string_view::npos) {
+            string_view line = lines.substr(0, end);
+            lines.remove_prefix(end + 2);
+            size_t colon = line.find(':');
+            if(colon == string_view::npos) {
+                continue;
+            }
+            string_view value = line.substr(colon + 1);
+            while(!value.empty() && value[0] == ' ') {
+                value.remove_prefix(1);
+            }
+            Hpack_Encoder::literal(block, line.substr(0, colon), value);
+        }
+        if(h.content_length == Stream_Head::NO_BODY || h.content_length == 0) {
+            delete s->source;
+            s->source = NULL;
+        }
+    }
+    finish_headers(s, block, s->head_only);
+}
+
+void H2_Session::finish_headers(H2_Stream * s, string & block, bool head) {
+    char date[Coarse_Clock::DATE_LEN];
+    Coarse_Clock::date(date);
+    // "Date: " 和 "\r\n" 之间的部分
+    Hpack_Encoder::literal(block, Hpack_Encoder::DATE, string_view(date + 6, Coarse_Clock::DATE_LEN - 8));
+    if(head) {
+        s->body = NULL;
+        s->remaining = 0;
+        delete s->source;
+        s->source = NULL;
+    }
+    bool end_stream = (s->remaining == 0 && !s->source);
+    write_headers(s, block, end_stream);
+    s->responded = true;
+    if(end_stream) {
+        end_response(s);
+    }
+}
+
+// 加权轮询调度这一批的DATA帧
+// 每一轮每个有数据的流的赤字加上 QUANTUM * 权重，赤字够发送一个帧就发送，一轮中可以发送多个帧
+// 受连接和流的发送窗口、对端的最大帧大小、这一批的字节数和iovec数量限制
+void H2_Session::schedule() {
+    http_conn * c = m_conn;
+    const int iv_cap = sizeof(c->m_iv) / sizeof(c->m_iv[0]);
+    long budget = BATCH_BYTES;
+    bool progress = true;
+    // 升级的连接要等客户端的连接前言到了再发送流1的数据，
+    // 这时客户端已经处理完101切换到HTTP/2了，不会在同一次读取中收到101和大量的帧
+    while(progress && budget > 0 && c->m_iv_count + 3 <= iv_cap && !m_goaway_sent && m_preface_received) {
+        progress = false;
+        size_t n = m_streams.size();
+        for(size_t i = 0; i < n && budget > 0 && c->m_iv_count + 3 <= iv_cap; i++) {
+            H2_Stream * s = m_streams[(m_next + i) % n];
+            if(s->closed || s->waiting) {
+                continue;
+            }
+            if(s->head_pending) {
+                stream_head(s);
+                progress = true;
+                continue;
+            }
+            if(!s->responded) {
+                continue;
+            }
+            if(s->remaining == 0) {
+                // 流式响应上一块已经发送完了，缓冲区还有空间就接着取下一块
+                if(s->source && (!s->chunk || s->chunk_used < s->chunk_size)) {
+                    read_source(s);
+                    progress = true;
+                }
+                continue;
+            }
+            s->deficit += QUANTUM * s->weight;
+            while(budget > 0 && c->m_iv_count + 3 <= iv_cap) {
+                long len = std::min(std::min(s->remaining, s->window), std::min(m_window, (long)m_peer_max_frame));
+                if(len <= 0) {
+                    // 被窗口挡住了，赤字不累积
+                    s->deficit = 0;
+                    break;
+                }
+                if(s->deficit < len) {
+                    progress = true;
+                    break;
+                }
+                bool end_stream = (len == s->remaining && !s->source);
+                write_data(s, len, end_stream);
+                s->deficit -= len;
+                budget -= len;
+                progress = true;
+                if(s->remaining == 0) {
+                    s->deficit = 0;
+                    if(end_stream) {
+                        end_response(s);
+                    }
+                    break;
+                }
+            }
+        }
+        m_next++;
+    }
+    sweep();
+    // 最后一个DATA帧之后写入的帧头和控制帧
+    c->queue_iov(NULL, 0);
+}
+
+bool H2_Session::read_source(H2_Stream * s) {
+    if(!s->chunk) {
+        s->chunk = Buffer_Pool::acquire(http_conn::STREAM_CHUNK_SIZE, &s->chunk_size);
+    }
+    // 同一批中的多块依次放在缓冲区中，前面的块还在iovec里
+    int len = s->source->read(s->chunk + s->chunk_used, s->chunk_size - s->chunk_used);
+    if(len == Stream_Source::AGAIN) {
+        // 数据还没有到，这个流先不参与调度
+        s->waiting = true;
+        if(!m_conn->wait_source(s->source)) {
+            rst_stream(s->id, H2_INTERNAL_ERROR);
+        }
+        return false;
+    }
+    if(len < 0) {
+        rst_stream(s->id, H2_INTERNAL_ERROR);
+        return false;
+    }
+    if(len == 0) {
+        // 数据源结束了，发送一个空的DATA帧结束这个流
+        delete s->source;
+        s->source = NULL;
+        write_data(s, 0, true);
+        end_response(s);
+        return false;
+    }
+    s->body = s->chunk + s->chunk_used;
+    s->remaining = len;
+    s->chunk_used += len;
+    return true;
+}
+
+H2_Stream * H2_Session::find(int stream_id) {
+    for(H2_Stream * s : m_streams) {
+        if(s->id == stream_id && !s->closed) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+H2_Stream * H2_Session::open_stream(int stream_id, int weight) {
+    H2_Stream * s = new H2_Stream();
+    s->id = stream_id;
+    s->weight = weight;
+    s->window = m_peer_initial_window;
+    s->deficit = 0;
+    s->end_received = false;
+    s->responded = false;
+    s->closed = false;
+    s->body_refused = false;
+    s->body = NULL;
+    s->remaining = 0;
+    s->file = NULL;
+    s->gzip = NULL;
+    s->address = 0;
+    s->address_len = 0;
+    s->source = NULL;
+    s->mime = NULL;
+    s->head_only = false;
+    s->head_pending = false;
+    s->waiting = false;
+    s->chunk = NULL;
+    s->chunk_size = 0;
+    s->chunk_used = 0;
+    m_streams.push_back(s);
+    return s;
+}
+
+void H2_Session::close_stream(H2_Stream * s) {
+    if(!s->closed) {
+        s->closed = true;
+        m_done.push_back(s);
+    }
+}
+
+void H2_Session::end_response(H2_Stream * s) {
+    if(s->body_refused) {
+        rst_stream(s->id, H2_NO_ERROR);
+    } else {
+        close_stream(s);
+    }
+}
+
+// 把已经关闭的流从活动列表中去掉
+void H2_Session::sweep() {
+    m_streams.erase(std::remove_if(m_streams.begin(), m_streams.end(), [](H2_Stream * s) { return s->closed; }), m_streams.end());
+}
+
+void H2_Session::free_stream(H2_Stream * s) {
+    if(s->address) {
+        munmap(s->address, s->address_len);
+    }
+    if(s->gzip) {
+        Gzip_Cache::get_instance()->release(s->gzip);
+    }
+    if(s->file) {
+        File_Cache::get_instance()->release(s->file);
+    }
+    delete s->source;
+    Buffer_Pool::release(s->chunk, s->chunk_size);
+    delete s;
+}
+
+void H2_Session::write_frame_header(int len, int type, int flags, int stream_id) {
+    uint8_t h[9];
+    h[0] = len >> 16;
+    h[1] = len >> 8;
+    h[2] = len;
+    h[3] = type;
+    h[4] = flags;
+    write_u32(h + 5, stream_id);
+    m_conn->add_bytes((const char *)h, 9);
+}
+
+void H2_Session::write_settings() {
+    uint8_t payload[6];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    write_u32(payload + 2, MAX_STREAMS);
+    write_frame_header(sizeof(payload), H2_SETTINGS, 0, 0);
+    m_conn->add_bytes((const char *)payload, sizeof(payload));
+    m_settings_sent = true;
+}
+
+// 头部块超过对端的最大帧大小时拆成HEADERS + CONTINUATION
+void H2_Session::write_headers(H2_Stream * s, const string & block, bool end_stream) {
+    size_t pos = 0;
+    bool first = true;
+    do {
+        size_t len = std::min(block.size() - pos, (size_t)m_peer_max_frame);
+        int flags = (pos + len == block.size()) ? FLAG_END_HEADERS : 0;
+        if(first && end_stream) {
+            flags |= FLAG_END_STREAM;
+        }
+        write_frame_header(len, first ? H2_HEADERS : H2_CONTINUATION, flags, s->id);
+        m_conn->add_bytes(block.data() + pos, len);
+        pos += len;
+        first = false;
+    } while(pos < block.size());
+}
+
+// 小块数据直接拷贝到写缓冲区，大块数据用iovec指向响应体，不拷贝
+void H2_Session::write_data(H2_Stream * s, long len, bool end_stream) {
+    write_frame_header(len, H2_DATA, end_stream ? FLAG_END_STREAM : 0, s->id);
+    if(len <= COPY_THRESHOLD) {
+        m_conn->add_bytes(s->body, len);
+    } else {
+        m_conn->queue_iov(s->body, len);
+    }
+    s->body += len;
+    s->remaining -= len;
+    s->window -= len;
+    m_window -= len;
+}
+
+void H2_Session::window_update(int stream_id, uint32_t increment) {
+    uint8_t payload[4];
+    write_u32(payload, increment);
+    write_frame_header(4, H2_WINDOW_UPDATE, 0, stream_id);
+    m_conn->add_bytes((const char *)payload, 4);
+}
+
+void H2_Session::rst_stream(int stream_id, int error) {
+    uint8_t payload[4];
+    write_u32(payload, error);
+    write_frame_header(4, H2_RST_STREAM, 0, stream_id);
+    m_conn->add_bytes((const char *)payload, 4);
+    H2_Stream * s = find(stream_id);
+    if(s) {
+        close_stream(s);
+    }
+}
+
+// 连接错误：发送GOAWAY，所有的流都结束，这一批发送完就关闭连接
+void H2_Session::goaway(int error) {
+    uint8_t payload[8];
+    write_u32(payload, m_last_stream_id);
+    write_u32(payload + 4, error);
+    write_frame_header(8, H2_GOAWAY, 0, 0);
+    m_conn->add_bytes((const char *)payload, 8);
+    m_goaway_sent = true;
+    for(H2_Stream * s : m_streams) {
+        close_stream(s);
+    }
+}
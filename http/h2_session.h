@@ -0,0 +1,167 @@
+#ifndef H2_SESSION_H
+#define H2_SESSION_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <string_view>
+#include "hpack.h"
+#include "stream_source.h"
+#include "../cache/file_cache.h"
+#include "../cache/gzip_cache.h"
+using namespace std;
+
+class http_conn;
+
+// 帧类型
+enum H2_FRAME_TYPE { H2_DATA = 0, H2_HEADERS, H2_PRIORITY, H2_RST_STREAM, H2_SETTINGS, H2_PUSH_PROMISE, H2_PING,
+                     H2_GOAWAY, H2_WINDOW_UPDATE, H2_CONTINUATION };
+
+// 错误码
+enum H2_ERROR { H2_NO_ERROR = 0, H2_PROTOCOL_ERROR, H2_INTERNAL_ERROR, H2_FLOW_CONTROL_ERROR, H2_SETTINGS_TIMEOUT,
+                H2_STREAM_CLOSED, H2_FRAME_SIZE_ERROR, H2_REFUSED_STREAM, H2_CANCEL, H2_COMPRESSION_ERROR,
+                H2_CONNECT_ERROR, H2_ENHANCE_YOUR_CALM };
+
+// 一个请求/响应流
+struct H2_Stream {
+    int id;
+    int weight;                 // 权重1~256，决定加权轮询时每一轮能发送多少字节
+    long window;                // 发送窗口（对端给这个流的接收窗口）
+    long deficit;               // 加权轮询的赤字计数
+    bool end_received;          // 请求已经收完（END_STREAM）
+    bool responded;             // 已经发送了HEADERS，响应体由调度器发送
+    bool closed;                // 流已经结束，等这一批发送完后释放
+    bool body_refused;          // 请求体超过上限，已经回复了413，之后收到的DATA直接丢弃
+    vector<Hpack_Field> request; // 请求头，请求收完后才处理
+    string content;             // 收到的请求体（DATA），不超过http_conn::m_buffer_max，请求收完后交给处理函数
+
+    // 响应体：缓存的文件内容、在线压缩的结果、映射的文件、错误页面或者流式响应当前的一块
+    char * body;
+    long remaining;
+
+    // 响应体占用的资源，流结束并且最后一批数据发送完后释放
+    File_Entry * file;
+    Gzip_Entry * gzip;
+    char * address;
+    long address_len;
+
+    // 流式响应的数据源和当前一块的缓冲区（从缓冲区池借）
+    Stream_Source * source;
+    const char * mime;
+    bool head_only;             // HEAD请求，流式响应只发送响应头
+    bool head_pending;          // 响应头还在等数据源（比如上游的响应头还没有到）
+    bool waiting;               // 数据源返回了AGAIN，等连接的等待集合就绪后再调度
+    char * chunk;
+    int chunk_size;
+    int chunk_used;             // 缓冲区中已经被这一批的DATA帧引用的字节数，这一批发送完之前不能覆盖
+};
+
+/**
+ * 一个明文HTTP/2（h2c）连接的会话
+ * 通过连接前言（prior knowledge）或者HTTP/1.1的Upgrade: h2c建立，建立后接管http_conn的读写缓冲区：
+ * 读缓冲区中是收到的帧，写缓冲区中是要发送的帧头、控制帧和HEADERS，DATA帧的内容用iovec直接指向缓存的文件
+ * 每个流的请求还是由http_conn::do_request处理，和HTTP/1.1共用文件缓存、在线压缩、条件请求和Range
+ *
+ * 响应体由调度器按批发送：一批最多BATCH_BYTES字节、不超过http_conn的iovec数量，
+ * 在连接和各个流的发送窗口内，按权重做加权轮询（deficit round robin），一批发送完后再调度下一批，
+ * 这一批发送期间已经收到的帧也在下一批开始前处理，大文件不会阻塞同一连接上的新请求
+ * RFC 9113已经废弃了优先级依赖树，这里只使用权重，依赖关系忽略
+*/
+class H2_Session {
+public:
+    // 我们接收的最大帧（SETTINGS_MAX_FRAME_SIZE使用默认值）
+    static const int MAX_FRAME_SIZE = 16384;
+    // SETTINGS_MAX_CONCURRENT_STREAMS
+    static const int MAX_STREAMS = 128;
+    // 一批最多发送多少字节的DATA
+    static const long BATCH_BYTES = 256 * 1024;
+    // 加权轮询时权重每加1，每一轮多发送的字节数
+    static const long QUANTUM = 1024;
+    // 不超过这个大小的DATA直接拷贝到写缓冲区，不占用iovec
+    static const long COPY_THRESHOLD = 512;
+    // 头部块（HEADERS + CONTINUATION）的上限
+    static const size_t MAX_HEADER_BLOCK = 64 * 1024;
+
+    H2_Session(http_conn * conn);
+    ~H2_Session();
+
+    // 读缓冲区是否以连接前言开头：1是，0数据还不够判断，-1不是
+    static int match_preface(const char * buf, int len);
+
+    // HTTP/1.1请求升级：settings为HTTP2-Settings头部的值，ret为这个请求（流1）的处理结果
+    // 101响应已经写到写缓冲区里了，这里接着写SETTINGS和流1的响应头
+    bool upgrade(string_view settings, int ret);
+
+    // 处理读缓冲区中完整的帧并调度一批要发送的数据，返回false表示连接需要关闭
+    // read_more为true时先从socket读取新数据（只有epoll后端在发送的间隙调用时使用）
+    bool process(bool read_more);
+
+    // 一批发送完后，是否还有可以发送的数据（有数据并且窗口允许）
+    bool has_output() const;
+
+    // 释放已经结束并且数据已经发送完的流（一批发送完或者连接关闭时调用）
+    void release_sent();
+
+    // 连接的等待集合就绪了，所有在等待的流都重新参与调度
+    void wake();
+
+private:
+    bool read_frames();
+    bool on_frame(int type, int flags, int stream_id, const uint8_t * payload, int len);
+    bool on_headers();
+    bool apply_settings(const uint8_t * payload, int len);
+    void handle_request(H2_Stream * s);
+    void respond(H2_Stream * s, int ret);
+    // 请求体超过上限：不再接收请求体，直接回复413
+    void refuse_body(H2_Stream * s);
+    // 从数据源取流式响应的响应头，还没有准备好就挂起这个流
+    void stream_head(H2_Stream * s);
+    // 加上Date并发送HEADERS，没有响应体的流直接结束
+    void finish_headers(H2_Stream * s, string & block, bool head);
+    void schedule();
+    // 从数据源取下一块，返回false表示流已经结束（或出错）
+    bool read_source(H2_Stream * s);
+
+    H2_Stream * find(int stream_id);
+    H2_Stream * open_stream(int stream_id, int weight);
+    // 流结束了，移到m_done中，等这一批发送完再释放资源
+    void close_stream(H2_Stream * s);
+    // 响应发送完了，结束这个流（请求体被拒绝的流还要让客户端停止发送）
+    void end_response(H2_Stream * s);
+    void sweep();
+    void free_stream(H2_Stream * s);
+
+    void write_frame_header(int len, int type, int flags, int stream_id);
+    void write_settings();
+    void write_headers(H2_Stream * s, const string & block, bool end_stream);
+    void write_data(H2_Stream * s, long len, bool end_stream);
+    void window_update(int stream_id, uint32_t increment);
+    void rst_stream(int stream_id, int error);
+    void goaway(int error);
+
+private:
+    http_conn * m_conn;
+    Hpack_Decoder m_decoder;
+
+    vector<H2_Stream *> m_streams;  // 活动的流
+    vector<H2_Stream *> m_done;     // 已经结束的流，数据可能还在这一批的iovec里
+    size_t m_next;                  // 加权轮询下一轮从哪个流开始
+
+    bool m_preface_received;
+    bool m_settings_sent;
+    bool m_goaway_sent;             // 发送了GOAWAY，发送完就关闭连接
+    bool m_peer_goaway;             // 对端发送了GOAWAY，不再接受新的流，现有的流结束后关闭连接
+    int m_last_stream_id;           // 收到的最大的流ID
+
+    long m_window;                  // 连接级的发送窗口
+    long m_peer_initial_window;     // 对端的SETTINGS_INITIAL_WINDOW_SIZE
+    int m_peer_max_frame;           // 对端的SETTINGS_MAX_FRAME_SIZE
+
+    // 正在接收的头部块（HEADERS后面跟着CONTINUATION）
+    string m_header_block;
+    int m_header_stream;            // 0表示没有在接收头部块
+    bool m_header_end_stream;
+    int m_header_weight;
+};
+
+#endif
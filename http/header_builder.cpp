@@ -0,0 +1,64 @@
+#include "header_builder.h"
+#include <string.h>
+
+// 00~99的两位十进制数，一次转换两位
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int Header_Builder::format_ulong(char * out, unsigned long value) {
+    // 从后往前写到临时缓冲区，再拷贝到out的开头
+    char buf[MAX_DIGITS];
+    char * p = buf + MAX_DIGITS;
+    while(value >= 100) {
+        unsigned long idx = (value % 100) * 2;
+        value /= 100;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    }
+    if(value >= 10) {
+        *--p = digit_pairs[value * 2 + 1];
+        *--p = digit_pairs[value * 2];
+    } else {
+        *--p = (char)('0' + value);
+    }
+    int len = buf + MAX_DIGITS - p;
+    memcpy(out, p, len);
+    return len;
+}
+
+// 状态码对应的预先生成的状态行，不认识的状态码返回空
+static string_view prebuilt_status_line(int status) {
+    switch(status) {
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 206: return "HTTP/1.1 206 Partial Content\r\n";
+        case 304: return "HTTP/1.1 304 Not Modified\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 403: return "HTTP/1.1 403 Forbidden\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 416: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+        case 500: return "HTTP/1.1 500 Internal Error\r\n";
+        default: return string_view();
+    }
+}
+
+// 状态行的前缀"HTTP/1.1 200 "和结尾的"\r\n"
+static const size_t STATUS_PREFIX = 13;
+static const size_t STATUS_SUFFIX = 2;
+
+string_view Header_Builder::status_line(int status, string_view reason) {
+    string_view line = prebuilt_status_line(status);
+    if(line.size() != STATUS_PREFIX + reason.size() + STATUS_SUFFIX || line.substr(STATUS_PREFIX, reason.size()) != reason) {
+        return string_view();
+    }
+    return line;
+}
@@ -0,0 +1,33 @@
+#ifndef HEADER_BUILDER_H
+#define HEADER_BUILDER_H
+
+#include <stddef.h>
+#include <string_view>
+using namespace std;
+
+/**
+ * 响应头生成工具
+ * 常用的状态行和头部都是预先生成好的常量字节串，生成响应头只需要memcpy，
+ * 长度之类的数字用查表的方式转换成十进制，不经过vsnprintf解析格式字符串
+*/
+class Header_Builder {
+public:
+    // 一个十进制数最多需要多少个字节
+    static const int MAX_DIGITS = 20;
+
+    // 把value转换成十进制写到out中（不写'\0'），返回长度，out至少要有MAX_DIGITS个字节
+    static int format_ulong(char * out, unsigned long value);
+
+    // 预先生成的状态行 "HTTP/1.1 200 OK\r\n"，不认识的状态码或者原因短语不同（比如代理转发上游的状态行）返回空
+    static string_view status_line(int status, string_view reason);
+
+
+    // 常用的头部
+    static constexpr string_view CONTENT_LENGTH = "Content-Length: ";
+    static constexpr string_view CONTENT_TYPE_HTML = "Content-Type:text/html\r\n";
+    static constexpr string_view KEEP_ALIVE = "Connection: keep-alive\r\n";
+    static constexpr string_view CLOSE = "Connection: close\r\n";
+    static constexpr string_view CRLF = "\r\n";
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef HEADER_TABLE_H
+#define HEADER_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <string_view>
+using namespace std;
+
+/**
+ * 编译期生成的完美哈希表（需要C++17）
+ * 构造函数在编译期为给定的一组key找一个没有任何冲突的哈希种子，
+ * 运行时查找只需要算一次哈希、比较一次字符串，不需要逐个strncasecmp
+ * key按ASCII忽略大小写比较（HTTP的头部名不区分大小写）
+ * N为key的数量，SIZE为哈希表的大小（必须是2的幂）
+*/
+template <size_t N, size_t SIZE>
+class Perfect_Hash {
+public:
+    constexpr Perfect_Hash(const array<string_view, N> & keys) : m_keys(keys), m_seed(0), m_slots() {
+        for(uint32_t seed = 1; seed < 100000; seed++) {
+            if(try_seed(seed)) {
+                m_seed = seed;
+                return;
+            }
+        }
+    }
+
+    // 查找key的下标，不存在返回-1
+    constexpr int find(string_view key) const {
+        int idx = m_slots[hash(key, m_seed) & (SIZE - 1)];
+        return (idx >= 0 && equal(m_keys[idx], key)) ? idx : -1;
+    }
+
+    // 是否找到了没有冲突的种子（用static_assert在编译期检查）
+    constexpr bool valid() const { return m_seed != 0; }
+
+    static constexpr char to_lower(char c) {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    // 忽略大小写比较
+    static constexpr bool equal(string_view a, string_view b) {
+        if(a.size() != b.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < a.size(); i++) {
+            if(to_lower(a[i]) != to_lower(b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // 忽略大小写的FNV-1a
+    static constexpr uint32_t hash(string_view key, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for(size_t i = 0; i < key.size(); i++) {
+            h ^= (uint8_t)to_lower(key[i]);
+            h *= 16777619u;
+        }
+        return h ^ (h >> 16);
+    }
+
+    constexpr bool try_seed(uint32_t seed) {
+        for(size_t i = 0; i < SIZE; i++) {
+            m_slots[i] = -1;
+        }
+        for(size_t i = 0; i < N; i++) {
+            uint32_t h = hash(m_keys[i], seed) & (SIZE - 1);
+            if(m_slots[h] != -1) {
+                return false;
+            }
+            m_slots[h] = (int16_t)i;
+        }
+        return true;
+    }
+
+private:
+    array<string_view, N> m_keys;
+    uint32_t m_seed;
+    array<int16_t, SIZE> m_slots;
+};
+
+// 能识别的请求头，解析后保存在http_conn对应的槽里，按这个枚举下标访问
+// 新增一个头部只需要在这里和header_names里各加一项，运行时没有额外开销
+enum HEADER {
+    HEADER_ACCEPT = 0, HEADER_ACCEPT_CHARSET, HEADER_ACCEPT_ENCODING, HEADER_ACCEPT_LANGUAGE,
+    HEADER_AUTHORIZATION, HEADER_CACHE_CONTROL, HEADER_CONNECTION, HEADER_CONTENT_ENCODING,
+    HEADER_CONTENT_LENGTH, HEADER_CONTENT_TYPE, HEADER_COOKIE, HEADER_EXPECT,
+    HEADER_FORWARDED, HEADER_FROM, HEADER_HOST, HEADER_HTTP2_SETTINGS,
+    HEADER_IF_MATCH, HEADER_IF_MODIFIED_SINCE, HEADER_IF_NONE_MATCH, HEADER_IF_RANGE,
+    HEADER_IF_UNMODIFIED_SINCE, HEADER_KEEP_ALIVE, HEADER_MAX_FORWARDS, HEADER_ORIGIN,
+    HEADER_PRAGMA, HEADER_RANGE, HEADER_REFERER, HEADER_TE,
+    HEADER_TRAILER, HEADER_TRANSFER_ENCODING, HEADER_UPGRADE, HEADER_USER_AGENT,
+    HEADER_VIA, HEADER_X_FORWARDED_FOR, HEADER_X_FORWARDED_PROTO, HEADER_X_REAL_IP,
+    HEADER_COUNT
+};
+
+constexpr array<string_view, HEADER_COUNT> header_names = {{
+    "Accept", "Accept-Charset", "Accept-Encoding", "Accept-Language",
+    "Authorization", "Cache-Control", "Connection", "Content-Encoding",
+    "Content-Length", "Content-Type", "Cookie", "Expect",
+    "Forwarded", "From", "Host", "HTTP2-Settings",
+    "If-Match", "If-Modified-Since", "If-None-Match", "If-Range",
+    "If-Unmodified-Since", "Keep-Alive", "Max-Forwards", "Origin",
+    "Pragma", "Range", "Referer", "TE",
+    "Trailer", "Transfer-Encoding", "Upgrade", "User-Agent",
+    "Via", "X-Forwarded-For", "X-Forwarded-Proto", "X-Real-IP",
+}};
+
+constexpr Perfect_Hash<HEADER_COUNT, 256> header_table(header_names);
+static_assert(header_table.valid(), "no collision-free seed for header_names");
+static_assert(HEADER_COUNT <= 64, "header slots are tracked in a 64-bit mask");
+static_assert(header_table.find("content-length") == HEADER_CONTENT_LENGTH, "header_table lookup");
+static_assert(header_table.find("X-Unknown") == -1, "header_table lookup");
+
+// 请求方法，顺序和http_conn::METHOD一致
+constexpr array<string_view, 8> method_names = {{
+    "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT",
+}};
+
+constexpr Perfect_Hash<8, 32> method_table(method_names);
+static_assert(method_table.valid(), "no collision-free seed for method_names");
+static_assert(method_table.find("HEAD") == 2, "method_table lookup");
+
+#endif
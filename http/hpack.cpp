@@ -0,0 +1,338 @@
+#include "hpack.h"
+#include "header_builder.h"
+#include <string.h>
+
+// RFC 7541 附录A 静态表，下标从1开始
+static const struct { const char * name; const char * value; } static_table[] = {
+    {"", ""},
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""},
+    {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""},
+    {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""},
+    {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""},
+    {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+    {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+static const size_t STATIC_TABLE_SIZE = sizeof(static_table) / sizeof(static_table[0]) - 1;
+
+// RFC 7541 附录B Huffman编码表（按符号顺序，code右对齐），256为EOS
+static const struct { uint32_t code; int bits; } huffman_table[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+/**
+ * HPACK的Huffman编码是规范Huffman编码：同样长度的码字按符号顺序连续分配
+ * 所以只需要每个长度的第一个码字、码字数量和按(长度, 符号)排好序的符号表，就可以逐位解码
+*/
+struct Huffman_Decode_Table {
+    static const int MAX_BITS = 30;
+    uint32_t first[MAX_BITS + 1];   // 每个长度的第一个码字
+    uint32_t count[MAX_BITS + 1];   // 每个长度的码字数量
+    int offset[MAX_BITS + 1];       // 每个长度的第一个符号在symbols中的位置
+    int symbols[257];
+
+    Huffman_Decode_Table() {
+        memset(count, 0, sizeof(count));
+        for(int s = 0; s < 257; s++) {
+            count[huffman_table[s].bits]++;
+        }
+        int pos = 0;
+        for(int len = 1; len <= MAX_BITS; len++) {
+            offset[len] = pos;
+            first[len] = UINT32_MAX;
+            for(int s = 0; s < 257; s++) {
+                if(huffman_table[s].bits == len) {
+                    if(first[len] == UINT32_MAX) {
+                        first[len] = huffman_table[s].code;
+                    }
+                    symbols[pos++] = s;
+                }
+            }
+        }
+    }
+};
+
+static const Huffman_Decode_Table & huffman_decode_table() {
+    static Huffman_Decode_Table table;
+    return table;
+}
+
+Hpack_Decoder::Hpack_Decoder(size_t max_table_size) : m_size(0), m_max_size(max_table_size), m_settings_max(max_table_size) {}
+
+bool Hpack_Decoder::decode_int(const uint8_t *& p, const uint8_t * end, int prefix, uint64_t & value) {
+    if(p >= end) {
+        return false;
+    }
+    uint64_t max = (1u << prefix) - 1;
+    value = *p++ & max;
+    if(value < max) {
+        return true;
+    }
+    int shift = 0;
+    while(p < end) {
+        uint8_t b = *p++;
+        if(shift > 28) {
+            return false;
+        }
+        value += (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if(!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Hpack_Decoder::decode_string(const uint8_t *& p, const uint8_t * end, string & out) {
+    if(p >= end) {
+        return false;
+    }
+    bool huffman = (*p & 0x80);
+    uint64_t len = 0;
+    if(!decode_int(p, end, 7, len) || len > (uint64_t)(end - p)) {
+        return false;
+    }
+    bool ok = true;
+    if(huffman) {
+        ok = huffman_decode(p, len, out);
+    } else {
+        out.assign((const char *)p, len);
+    }
+    p += len;
+    return ok;
+}
+
+bool Hpack_Decoder::huffman_decode(const uint8_t * p, size_t len, string & out) {
+    const Huffman_Decode_Table & t = huffman_decode_table();
+    out.clear();
+    out.reserve(len * 8 / 5);
+    uint32_t code = 0;
+    int bits = 0;
+    for(size_t i = 0; i < len; i++) {
+        for(int b = 7; b >= 0; b--) {
+            code = (code << 1) | ((p[i] >> b) & 1);
+            bits++;
+            // 码字最短5位；code - first < count说明是这个长度的一个码字
+            if(bits >= 5 && code - t.first[bits] < t.count[bits]) {
+                int sym = t.symbols[t.offset[bits] + (code - t.first[bits])];
+                if(sym == 256) {
+                    // 字符串中不能出现EOS
+                    return false;
+                }
+                out.push_back((char)sym);
+                code = 0;
+                bits = 0;
+            } else if(bits == Huffman_Decode_Table::MAX_BITS) {
+                return false;
+            }
+        }
+    }
+    // 结尾的填充必须是不超过7位的全1（EOS的前缀）
+    return bits <= 7 && code == (1u << bits) - 1;
+}
+
+bool Hpack_Decoder::lookup(uint64_t index, Hpack_Field & field) const {
+    if(index == 0) {
+        return false;
+    }
+    if(index <= STATIC_TABLE_SIZE) {
+        field.name = static_table[index].name;
+        field.value = static_table[index].value;
+        return true;
+    }
+    index -= STATIC_TABLE_SIZE + 1;
+    if(index >= m_table.size()) {
+        return false;
+    }
+    field = m_table[index];
+    return true;
+}
+
+void Hpack_Decoder::evict() {
+    while(m_size > m_max_size && !m_table.empty()) {
+        m_size -= m_table.back().name.size() + m_table.back().value.size() + 32;
+        m_table.pop_back();
+    }
+}
+
+void Hpack_Decoder::add(const Hpack_Field & field) {
+    size_t size = field.name.size() + field.value.size() + 32;
+    if(size > m_max_size) {
+        // 比整个表还大的条目会把表清空，自己也不加入
+        m_table.clear();
+        m_size = 0;
+        return;
+    }
+    m_size += size;
+    m_table.push_front(field);
+    evict();
+}
+
+bool Hpack_Decoder::decode(const uint8_t * p, size_t len, vector<Hpack_Field> & fields) {
+    const uint8_t * end = p + len;
+    size_t decoded = 0;
+    while(p < end) {
+        uint8_t b = *p;
+        uint64_t index = 0;
+        Hpack_Field field;
+        if(b & 0x80) {
+            // 1xxxxxxx 索引
+            if(!decode_int(p, end, 7, index) || !lookup(index, field)) {
+                return false;
+            }
+        } else if((b & 0xe0) == 0x20) {
+            // 001xxxxx 动态表大小更新
+            if(!decode_int(p, end, 5, index) || index > m_settings_max) {
+                return false;
+            }
+            m_max_size = index;
+            evict();
+            continue;
+        } else {
+            // 01xxxxxx 带索引的字面量，0000xxxx 不索引的字面量，0001xxxx 永不索引的字面量
+            bool indexing = (b & 0xc0) == 0x40;
+            if(!decode_int(p, end, indexing ? 6 : 4, index)) {
+                return false;
+            }
+            if(index > 0) {
+                if(!lookup(index, field)) {
+                    return false;
+                }
+            } else if(!decode_string(p, end, field.name)) {
+                return false;
+            }
+            if(!decode_string(p, end, field.value)) {
+                return false;
+            }
+            if(indexing) {
+                add(field);
+            }
+        }
+        decoded += field.name.size() + field.value.size() + 32;
+        if(decoded > MAX_DECODED_SIZE) {
+            return false;
+        }
+        fields.push_back(std::move(field));
+    }
+    return true;
+}
+
+void Hpack_Encoder::integer(string & out, uint64_t value, int prefix, uint8_t first) {
+    uint64_t max = (1u << prefix) - 1;
+    if(value < max) {
+        out.push_back((char)(first | value));
+        return;
+    }
+    out.push_back((char)(first | max));
+    value -= max;
+    while(value >= 0x80) {
+        out.push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+void Hpack_Encoder::status(string & out, int status) {
+    switch(status) {
+        case 200: integer(out, 8, 7, 0x80); return;
+        case 204: integer(out, 9, 7, 0x80); return;
+        case 206: integer(out, 10, 7, 0x80); return;
+        case 304: integer(out, 11, 7, 0x80); return;
+        case 400: integer(out, 12, 7, 0x80); return;
+        case 404: integer(out, 13, 7, 0x80); return;
+        case 500: integer(out, 14, 7, 0x80); return;
+        default: literal(out, 8, (unsigned long)status); return;
+    }
+}
+
+void Hpack_Encoder::literal(string & out, int name_index, string_view value) {
+    // 0000xxxx 不索引的字面量，名字用静态表下标，值不使用Huffman编码
+    integer(out, name_index, 4, 0x00);
+    integer(out, value.size(), 7, 0x00);
+    out.append(value.data(), value.size());
+}
+
+void Hpack_Encoder::literal(string & out, string_view name, string_view value) {
+    // 00000000 不索引的字面量，名字和值都是字面量
+    out.push_back(0x00);
+    integer(out, name.size(), 7, 0x00);
+    out.append(name.data(), name.size());
+    integer(out, value.size(), 7, 0x00);
+    out.append(value.data(), value.size());
+}
+
+void Hpack_Encoder::literal(string & out, int name_index, unsigned long value) {
+    char buf[Header_Builder::MAX_DIGITS];
+    int len = Header_Builder::format_ulong(buf, value);
+    literal(out, name_index, string_view(buf, len));
+}
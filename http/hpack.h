@@ -0,0 +1,77 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <string_view>
+using namespace std;
+
+// 一个解码出来的头部字段
+struct Hpack_Field {
+    string name;
+    string value;
+};
+
+/**
+ * HPACK（RFC 7541）解码器，每个HTTP/2连接一个（动态表是连接级的状态）
+ * 支持静态表、动态表和Huffman编码的字符串
+ * 动态表的上限是我们的SETTINGS_HEADER_TABLE_SIZE（默认4096），对端只能在这个范围内调整
+*/
+class Hpack_Decoder {
+public:
+    Hpack_Decoder(size_t max_table_size = 4096);
+
+    // 解码一个完整的头部块，结果追加到fields，出错返回false（连接错误COMPRESSION_ERROR）
+    bool decode(const uint8_t * p, size_t len, vector<Hpack_Field> & fields);
+
+    // 一个头部块解码出来的内容最多多少字节，防止很小的头部块解码出巨大的内容
+    static const size_t MAX_DECODED_SIZE = 64 * 1024;
+
+private:
+    // 按下标查找静态表或者动态表
+    bool lookup(uint64_t index, Hpack_Field & field) const;
+    // 加入动态表，必要时淘汰最旧的条目
+    void add(const Hpack_Field & field);
+    // 淘汰条目，直到动态表不超过上限
+    void evict();
+
+    static bool decode_int(const uint8_t *& p, const uint8_t * end, int prefix, uint64_t & value);
+    static bool decode_string(const uint8_t *& p, const uint8_t * end, string & out);
+    static bool huffman_decode(const uint8_t * p, size_t len, string & out);
+
+private:
+    deque<Hpack_Field> m_table;     // 动态表，最新的在前面
+    size_t m_size;                  // 动态表当前的大小（每个条目是名字+值+32）
+    size_t m_max_size;              // 对端通过动态表大小更新指令设置的上限
+    size_t m_settings_max;          // 我们在SETTINGS中允许的上限
+};
+
+/**
+ * HPACK编码器
+ * 响应头不多，不使用动态表也不使用Huffman编码，只用静态表的下标和不索引的字面量，
+ * 所以编码器是无状态的，对端的SETTINGS_HEADER_TABLE_SIZE也不影响它
+*/
+class Hpack_Encoder {
+public:
+    // :status，常用的状态码直接用静态表的下标
+    static void status(string & out, int status);
+    // 名字在静态表中的不索引字面量
+    static void literal(string & out, int name_index, string_view value);
+    static void literal(string & out, int name_index, unsigned long value);
+    // 名字不在静态表中的不索引字面量（比如反向代理转发的上游头部），name必须是小写的
+    static void literal(string & out, string_view name, string_view value);
+
+    // 静态表中的下标
+    enum STATIC_INDEX {
+        ACCEPT_RANGES = 18, ALLOW = 22, CONTENT_ENCODING = 26, CONTENT_LENGTH = 28, CONTENT_RANGE = 30,
+        CONTENT_TYPE = 31, DATE = 33, ETAG = 34, LAST_MODIFIED = 44, VARY = 59
+    };
+
+private:
+    static void integer(string & out, uint64_t value, int prefix, uint8_t first);
+};
+
+#endif
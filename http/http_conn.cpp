@@ -1,4 +1,7 @@
 #include "http_conn.h"
+#include "h2_session.h"
+#include "router.h"
+#include <sys/sendfile.h>
 
 
 // 定义HTTP响应的一些状态信息
@@ -9,15 +12,26 @@ const char* error_403_title = "Forbidden";
 const char* error_403_form = "You do not have permission to get file from this server.\n";
 const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
+const char* error_405_title = "Method Not Allowed";
+const char* error_405_form = "The requested method is not supported for this resource.\n";
+const char* error_413_title = "Content Too Large";
+const char* error_413_form = "The request body is larger than the server is willing to accept.\n";
+const char* error_416_title = "Range Not Satisfiable";
+const char* error_416_form = "The requested range is not satisfiable.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_502_title = "Bad Gateway";
+const char* error_502_form = "The upstream server is unavailable or returned an invalid response.\n";
 
-http_conn::http_conn(){}
+http_conn::http_conn() : m_tasks(0), m_sockfd(-1), m_read_buf(NULL), m_read_buf_size(0), m_write_buf(NULL), m_write_buf_size(0),
+    m_file(NULL), m_gzip(NULL), m_file_address(0), m_body_count(0), m_sendfile(NULL), m_stream(NULL), m_stream_mime(NULL),
+    m_stream_head_pending(false), m_chunk_buf(NULL), m_chunk_buf_size(0), m_h2(NULL), m_park_fd(-1), m_waiting(false), m_ssl(NULL), m_tls_ready(false), m_tls_want_write(false),
+    m_ktls_send(false), m_ktls_recv(false) {}
 http_conn::~http_conn(){}
 
 // 类内定义 类外初始化
-int http_conn::m_epfd = -1;
-int http_conn::m_user_cout = 0;
+atomic<int> http_conn::m_user_cout(0);
+int http_conn::m_buffer_max = 64 * 1024;
 
 // 网站资源的根目录
 const char * doc_root = "/home/lxh/webserver/resources";
@@ -31,12 +45,19 @@ int set_nonblocking(int fd) {
 }
 
 // 向epoll中添加需要检测的文件描述符
-void addfd(int epfd, int fd, bool one_shot){
+// epfd为-1表示连接由io_uring后端驱动，不需要注册到epoll上，也不需要设置非阻塞
+void addfd(int epfd, int fd, bool one_shot, int trig_mode){
+    if(epfd == -1) {
+        return;
+    }
     epoll_event epev;
-    epev.data.fd = fd;
+    // 高32位清零，事件循环用它区分等待集合的事件
+    epev.data.u64 = fd;
     // 对于对方连接断开，会触发EPOLLRDHUP，不需要返回值来判断了，而是通过返回事件判断
     epev.events = EPOLLIN | EPOLLRDHUP; // 默认水平触发模式 one-shot用于防止
-    // epev.events = EPOLLIN | EPOLLRDHUP | EPOLLET; // 默认水平触发模式 one-shot用于防止
+    if(trig_mode == 1) {
+        epev.events |= EPOLLET; // 边沿触发模式
+    }
     if(one_shot) {
         epev.events |= EPOLLONESHOT;
     }
@@ -47,10 +68,16 @@ void addfd(int epfd, int fd, bool one_shot){
 }
 
 // 从epoll中修改监听的文件描述符，主要是要重置epoll的events属性（EPOLLONESHOT事件，确保下一次可读EPOLLIN可触发）
-void modifyfd(int epfd, int fd, int ev) {
+void modifyfd(int epfd, int fd, int ev, int trig_mode) {
+    if(epfd == -1) {
+        return;
+    }
     epoll_event epev;
-    epev.data.fd = fd;
+    epev.data.u64 = fd;
     epev.events = ev | EPOLLONESHOT | EPOLLRDHUP;
+    if(trig_mode == 1) {
+        epev.events |= EPOLLET;
+    }
     epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &epev);
 }
 
@@ -60,37 +87,160 @@ void removefd(int epfd, int fd) {
     close(fd); // 关闭文件描述符
 }
 
+// 注册或者重新注册一个EPOLLONESHOT的fd（第一次MOD失败时ADD）
+static bool arm_oneshot(int epfd, int fd, uint64_t data, int ev) {
+    epoll_event epev;
+    epev.data.u64 = data;
+    epev.events = ev | EPOLLONESHOT;
+    if(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &epev) == 0) {
+        return true;
+    }
+    return errno == ENOENT && epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &epev) == 0;
+}
+
 void http_conn::init() {
+    release_session();
+    m_read_index = 0; // 读缓冲区的索引也初始化为0
+    init_request();
+    // 上一个响应如果没有发送完连接就断开了，文件还没有释放
+    init_response();
+    release_buffers();
+}
+
+// 初始化解析一个请求的状态，读缓冲区中已经读到的（流水线中后续请求的）数据保留
+void http_conn::init_request() {
     m_checked_state = CHECK_STATE_REQUESTLINE; // 初始化状态为解析请求首行
     m_start_line = 0; // 当前正在解析的索引解析为0
     m_checked_index = 0; // 解析到的位置也初始化为0
-    m_read_index = 0; // 读缓冲区的索引也初始化为0
     m_content_length = 0; // 请求体长度置为0
-    m_read_index = 0;
-    m_write_index = 0;
+    m_content = NULL;
 
     m_url = 0;
+    m_allow = "";
     m_method = GET;
     m_version = 0;
-    m_linger = false;
-    m_host = 0;
+    // HTTP/1.1默认保持连接，除非请求中带了Connection: close
+    m_linger = true;
+    // 只清掉位图，头部槽里的旧值不会被读到
+    m_header_mask = 0;
+    m_header_start = 0;
+    m_header_end = 0;
+    m_h2_fields = NULL;
+    m_range_count = 0;
+    m_accept_encoding = ENCODING_IDENTITY;
+}
+
+// 初始化一批响应的状态，释放这批响应占用的文件
+void http_conn::init_response() {
+    unmap();
+    m_write_index = 0;
+    m_response_start = 0;
+    m_response_count = 0;
+    m_file_offset = 0;
+    m_file_remaining = 0;
+    m_bytes_to_send = 0;
+    m_iv_count = 0;
+    m_keep_alive = true;
+    // 写缓冲区只在生成和发送响应的时候使用
+    Buffer_Pool::release(m_write_buf, m_write_buf_size);
+    m_write_buf = NULL;
+    m_write_buf_size = 0;
+}
+
+// 把读写缓冲区还给缓冲区池
+void http_conn::release_buffers() {
+    Buffer_Pool::release(m_read_buf, m_read_buf_size);
+    m_read_buf = NULL;
+    m_read_buf_size = 0;
+    m_read_index = 0;
+    Buffer_Pool::release(m_write_buf, m_write_buf_size);
+    m_write_buf = NULL;
+    m_write_buf_size = 0;
+}
+
+// 读缓冲区扩容到至少need字节，超过上限返回false
+// 已经解析出来的请求行和头部字段指向读缓冲区，扩容后要一起移动
+bool http_conn::grow_read_buf(int need) {
+    if(need > m_buffer_max) {
+        return false;
+    }
+    int size = (m_read_buf_size > 0) ? m_read_buf_size * 2 : READ_BUFFER_SIZE;
+    while(size < need) {
+        size *= 2;
+    }
+    if(size > m_buffer_max) {
+        size = m_buffer_max;
+    }
+    int real_size = 0;
+    char * buf = Buffer_Pool::acquire(size, &real_size);
+    if(m_read_buf) {
+        memcpy(buf, m_read_buf, m_read_index);
+        if(m_url) {
+            m_url = buf + (m_url - m_read_buf);
+        }
+        if(m_version) {
+            m_version = buf + (m_version - m_read_buf);
+        }
+        for(int i = 0; i < HEADER_COUNT; i++) {
+            if(m_header_mask & (1ULL << i)) {
+                m_headers[i] = string_view(buf + (m_headers[i].data() - m_read_buf), m_headers[i].size());
+            }
+        }
+        Buffer_Pool::release(m_read_buf, m_read_buf_size);
+    }
+    m_read_buf = buf;
+    // 分档向上取整后可能超过上限（-b不是某一档的大小），超出的部分不使用，还回去时直接释放
+    m_read_buf_size = (real_size > m_buffer_max) ? m_buffer_max : real_size;
+    return true;
+}
 
-    // 读缓冲区数据清空
-    bzero(m_read_buf, READ_BUFFER_SIZE);
-    bzero(m_write_buf, READ_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_MAX);
+// 写缓冲区扩容到至少need字节，超过上限返回false
+// 这一批已经生成的响应头在iovec中指向写缓冲区，扩容后要一起移动
+bool http_conn::grow_write_buf(int need) {
+    if(need > m_buffer_max) {
+        return false;
+    }
+    int size = (m_write_buf_size > 0) ? m_write_buf_size * 2 : WRITE_BUFFER_SIZE;
+    while(size < need) {
+        size *= 2;
+    }
+    if(size > m_buffer_max) {
+        size = m_buffer_max;
+    }
+    int real_size = 0;
+    char * buf = Buffer_Pool::acquire(size, &real_size);
+    if(m_write_buf) {
+        memcpy(buf, m_write_buf, m_write_index);
+        for(int i = 0; i < m_iv_count; i++) {
+            char * base = (char *)m_iv[i].iov_base;
+            if(base >= m_write_buf && base < m_write_buf + m_write_buf_size) {
+                m_iv[i].iov_base = buf + (base - m_write_buf);
+            }
+        }
+        Buffer_Pool::release(m_write_buf, m_write_buf_size);
+    }
+    m_write_buf = buf;
+    m_write_buf_size = (real_size > m_buffer_max) ? m_buffer_max : real_size;
+    return true;
 }
 
-void http_conn::init(int sockfd, const sockaddr_in &addr) {
+void http_conn::init(int sockfd, const sockaddr_in &addr, int epfd, int trig_mode, int actor_mode) {
     m_sockfd = sockfd; // 初始化
     m_addr = addr;
+    m_epfd = epfd;
+    m_trig_mode = trig_mode;
+    m_actor_mode = actor_mode;
+    m_state = 0;
+    m_cost_hint = TASK_NORMAL;
+    // io_uring后端（epfd为-1）由io_uring发送iovec，文件走mmap；epoll后端文件走sendfile
+    m_use_sendfile = (epfd != -1);
 
     // 设置通信的文件描述符端口复用
     int reuse = 1;
     setsockopt(m_sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
 
     // 将通信文件描述符添加到epoll中
-    addfd(m_epfd, m_sockfd, true);
+    addfd(m_epfd, m_sockfd, true, m_trig_mode);
     m_user_cout++; // 总用户数+1
 
     init();
@@ -106,18 +256,117 @@ void http_conn::close_conn() {
     }
 }
 
+// 工作线程不能直接close，否则定时器还留在事件循环的链表里，到期后会关闭一个可能已经被复用的fd
+// 这里只shutdown，再重新注册事件，事件循环会收到EPOLLHUP/EPOLLRDHUP，然后由它关闭连接并删除定时器
+void http_conn::shutdown_conn() {
+    if(m_sockfd != -1) {
+        shutdown(m_sockfd, SHUT_RDWR);
+        modifyfd(m_epfd, m_sockfd, EPOLLIN, m_trig_mode);
+    }
+}
+
+bool http_conn::start_tls() {
+    m_ssl = Tls_Context::get_instance()->create(m_sockfd);
+    // 握手完成之前不知道能不能用kTLS，先不用sendfile
+    m_use_sendfile = false;
+    return m_ssl != NULL;
+}
+
+bool http_conn::tls_handshake() {
+    int ret = SSL_do_handshake(m_ssl);
+    if(ret == 1) {
+        m_tls_ready = true;
+        m_tls_want_write = false;
+        m_ktls_send = Tls_Context::ktls_send(m_ssl);
+        m_ktls_recv = Tls_Context::ktls_recv(m_ssl);
+        // 内核负责加密时文件内容可以继续sendfile，否则要读到用户态交给SSL_write
+        m_use_sendfile = m_ktls_send;
+        return true;
+    }
+    int err = SSL_get_error(m_ssl, ret);
+    if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        m_tls_want_write = (err == SSL_ERROR_WANT_WRITE);
+        return true;
+    }
+    ERR_clear_error();
+    return false;
+}
+
+bool http_conn::tls_read() {
+    while(true) {
+        // 和明文连接一样，达到上限就先不读了
+        if(m_read_index >= m_read_buf_size && !grow_read_buf(m_read_index + 1)) {
+            return true;
+        }
+        int bytes_read = SSL_read(m_ssl, m_read_buf + m_read_index, m_read_buf_size - m_read_index);
+        if(bytes_read > 0) {
+            m_read_index += bytes_read;
+            continue;
+        }
+        if(SSL_get_error(m_ssl, bytes_read) == SSL_ERROR_WANT_READ) {
+            // socket里没有完整的记录了
+            return true;
+        }
+        // 对方发送了close_notify、关闭了连接或者出错
+        ERR_clear_error();
+        return false;
+    }
+}
+
+int http_conn::tls_writev(struct iovec * iv, int count) {
+    // 每一块单独SSL_write，一块写了一部分或者EAGAIN就返回已经写出的字节数，
+    // 下一次从断点继续，重试时的数据和上一次相同（SSL_write要求的）
+    int total = 0;
+    for(int i = 0; i < count; i++) {
+        if(iv[i].iov_len == 0) {
+            continue;
+        }
+        int n = SSL_write(m_ssl, iv[i].iov_base, iv[i].iov_len);
+        if(n <= 0) {
+            int err = SSL_get_error(m_ssl, n);
+            if(total > 0) {
+                return total;
+            }
+            if(err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+                errno = EAGAIN;
+            } else {
+                ERR_clear_error();
+                errno = EIO;
+            }
+            return -1;
+        }
+        total += n;
+        if(n < (int)iv[i].iov_len) {
+            return total;
+        }
+    }
+    return total;
+}
+
 // 循环读取客户数据，直到读取完毕或者没有数据可以读取
 bool http_conn::read() {
-    // 如果读的下标已经超过了读缓冲区大小，就说明读完了
-    if(m_read_index >= READ_BUFFER_SIZE) {
-        return false;
+    if(m_ssl) {
+        // 握手还没有完成时，读事件先用来推进握手
+        if(!m_tls_ready && !tls_handshake()) {
+            return false;
+        }
+        if(!m_tls_ready) {
+            return true;
+        }
+        if(!m_ktls_recv) {
+            return tls_read();
+        }
     }
-    
     // 读取到的字节
     int bytes_read = 0;
     while(true) {
+        // 读缓冲区满了（或者还没有借）就扩容，已经达到上限就先不读了，
+        // 由解析决定是回复413（请求体太大）还是关闭连接（请求头太大），剩下的数据还留在socket里
+        if(m_read_index >= m_read_buf_size && !grow_read_buf(m_read_index + 1)) {
+            break;
+        }
         // 这一句话的意思，是每次读取从下标位置开始读，读取
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_index, READ_BUFFER_SIZE - m_read_index, 0);
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_index, m_read_buf_size - m_read_index, 0);
         if(bytes_read == -1) {
             if(errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 标识没有数据了
@@ -135,113 +384,430 @@ bool http_conn::read() {
 } 
 
 // 写数据，写到写缓冲区中
+// 一批（流水线中多个请求的）响应头、错误页面和内存中的文件内容通过一次sendmsg发送，
+// 最后一个响应的大文件内容通过sendfile直接从页缓存发送到socket，
+// 发送的进度保存在m_iv和m_file_offset中，EAGAIN后下一次EPOLLOUT从断点继续发送
 bool http_conn::write() {
     int temp = 0;
-    int bytes_have_send = 0; // 已经发送的字节
-    int bytes_to_send = m_write_index; // 将要发送的字节（m_write_index）下一个要发送的
 
-    if ( bytes_to_send == 0 ) {
-        // 将要发送的字节为0，这一次响应结束。
-        modifyfd(m_epfd, m_sockfd, EPOLLIN); 
-        init();
+    if(m_ssl && !m_tls_ready) {
+        // 握手中途socket写满了，可写后继续握手
+        if(!tls_handshake()) {
+            return false;
+        }
+        modifyfd(m_epfd, m_sockfd, m_tls_want_write ? EPOLLOUT : EPOLLIN, m_trig_mode);
         return true;
     }
 
+    if ( m_bytes_to_send == 0 && !streaming() ) {
+        // 将要发送的字节为0，这一次响应结束。
+        return finish_write();
+    }
+
     while(1) {
-        // 分散写(多块不连续的内存也可以写入，因为我们的write_buf响应头和响应内容m_address不在一个地方)
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        // 流式响应上一块已经发送完了，取下一块
+        if(m_iv_count == 0 && m_file_remaining == 0 && streaming() && !refill()) {
+            unmap();
+            return false;
+        }
+        if(m_iv_count == 0 && m_waiting && !m_h2) {
+            // 数据源（比如上游服务器）还没有数据，等它就绪，这期间客户端的fd只关心连接断开
+            park(0);
+            return true;
+        }
+        if(m_iv_count > 0) {
+            // 分散写(多块不连续的内存也可以写入)
+            // 后面还有文件内容要sendfile时带上MSG_MORE，让响应头和文件的第一段合并成一个TCP报文段
+            struct msghdr msg;
+            bzero(&msg, sizeof(msg));
+            msg.msg_iov = m_iv;
+            msg.msg_iovlen = m_iv_count;
+            if(m_ssl && !m_ktls_send) {
+                temp = tls_writev(m_iv, m_iv_count);
+            } else {
+                temp = sendmsg(m_sockfd, &msg, (m_file_remaining > 0) ? MSG_MORE : 0);
+            }
+        } else if(m_file_remaining > 0) {
+            // sendfile会更新m_file_offset，不需要mmap整个文件，文件多大都可以
+            temp = sendfile(m_sockfd, m_sendfile->fd, &m_file_offset, m_file_remaining);
+            if(temp == 0) {
+                // 文件在发送过程中被截断了，长度对不上，只能断开连接
+                unmap();
+                return false;
+            }
+        } else {
+            // 已经没有可发送的数据了
+            m_bytes_to_send = 0;
+            temp = 0;
+        }
         if (temp <= -1) {
             // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
             if(errno == EAGAIN) {
-                modifyfd(m_epfd, m_sockfd, EPOLLOUT);
+                arm(EPOLLOUT);
                 return true;
             }
             unmap();
             return false;
         }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if (bytes_to_send <= bytes_have_send) {
+        if(m_iv_count > 0) {
+            advance_write(temp);
+        } else {
+            m_file_remaining -= temp;
+        }
+        m_bytes_to_send -= temp;
+        if (m_bytes_to_send <= 0 && !streaming()) {
             // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            unmap();
-            if(m_linger) {
-                init();
-                modifyfd(m_epfd, m_sockfd, EPOLLIN);
-                return true;
-            } else {
-                modifyfd(m_epfd, m_sockfd, EPOLLIN);
-                return false;
-            } 
+            return finish_write();
         }
     }
 }
 
-// 要分析目标文件的属性，即通过url找到资源然后写给客户端
+// io_uring的multishot recv把数据放在provided buffer里，这里拷贝到读缓冲区
+bool http_conn::read_from(const char * buf, int len) {
+    if(m_read_index + len > m_read_buf_size && !grow_read_buf(m_read_index + len)) {
+        return false;
+    }
+    memcpy(m_read_buf + m_read_index, buf, len);
+    m_read_index += len;
+    return true;
+}
+
+// 发送了bytes字节后调整iovec，把已经发完的块去掉，没发完的块往后移
+bool http_conn::advance_write(int bytes) {
+    int i = 0;
+    while(i < m_iv_count && bytes >= (int)m_iv[i].iov_len) {
+        bytes -= m_iv[i].iov_len;
+        i++;
+    }
+    if(i < m_iv_count) {
+        m_iv[i].iov_base = (char *)m_iv[i].iov_base + bytes;
+        m_iv[i].iov_len -= bytes;
+    }
+    for(int j = i; j < m_iv_count; j++) {
+        m_iv[j - i] = m_iv[j];
+    }
+    m_iv_count -= i;
+    return m_iv_count == 0;
+}
+
+// 一批响应发送完毕，根据最后一个请求的Connection字段决定是否保持连接
+// 读缓冲区中还有流水线请求时先不注册事件（否则Reactor模式下其他工作线程可能同时处理这个连接），
+// 由调用者通过has_pipelined判断后接着处理
+bool http_conn::finish_write() {
+    bool keep_alive = m_keep_alive;
+    init_response();
+    if(!keep_alive) {
+        modifyfd(m_epfd, m_sockfd, EPOLLIN, m_trig_mode);
+        return false;
+    }
+    if(m_read_index == 0) {
+        // 连接空闲了，读缓冲区也还回去，空闲的keep-alive连接不占用缓冲区
+        release_buffers();
+        arm(EPOLLIN);
+    }
+    return true;
+}
+
+// 按方法和路径在路由表中找到处理函数，路径存在但方法没有注册时返回405
 http_conn::HTTP_CODE http_conn::do_request() {
-    // 比如解析请求头后，服务器得到了资源的相对地址，就需要找到对应的资源
-    strcpy(m_real_file, doc_root); // 先把doc_root的路径拷贝到real_file中
-    int len = strlen(doc_root);
-    strncpy(m_real_file + len, m_url, MAX_FILENAME - len - 1); // 继续把m_url拼接进去
-    // 判断m_real_file的相关状态信息
-    if(stat(m_real_file, &m_file_stat) < 0) {
-        return NO_REQUEST;
+    Route_Match match;
+    ROUTE_RESULT result = Router::get_instance()->match(m_method, m_url, &match);
+    if(result == ROUTE_NOT_FOUND) {
+        return NO_RESOURCE;
     }
-    // 判断m_real_file是否有读的访问权限
-    if(!(m_file_stat.st_mode & S_IROTH)) {
-        return FORBIDDEN_REQUEST;
+    m_allow = match.allow;
+    if(result == ROUTE_METHOD_NOT_ALLOWED) {
+        return METHOD_NOT_ALLOWED;
     }
-    // 判断是否是目录
-    if(S_ISDIR(m_file_stat.st_mode)) {
+    // 处理函数知道这个请求的代价时自己设置，否则按不知道处理
+    m_cost_hint = TASK_NORMAL;
+    return match.handler(this, match.params, match.arg);
+}
+
+http_conn::HTTP_CODE http_conn::file_handler(http_conn * conn, const Route_Params &, void *) {
+    return conn->serve_file();
+}
+
+// 要分析目标文件的属性，即通过url找到资源然后写给客户端
+// 文件的打开、stat和小文件的内容都由文件缓存负责，热点文件命中后不需要任何文件系统调用
+// 静态文件只注册了GET和HEAD
+http_conn::HTTP_CODE http_conn::serve_file() {
+    File_Entry * entry = NULL;
+    int err = File_Cache::get_instance()->acquire(m_url, m_accept_encoding, &entry);
+    if(err == EACCES) {
+        // 没有读的访问权限
+        return FORBIDDEN_REQUEST;
+    } else if(err == EISDIR) {
+        // 是目录
         return BAD_REQUEST;
+    } else if(err != 0) {
+        return NO_RESOURCE;
     }
+    m_file = entry;
+    m_file_stat = entry->st;
+    // 内容已经在缓存里的小文件很快就能发完；大文件要sendfile或者mmap，会占用工作线程很久
+    set_cost_hint(entry->data ? TASK_CHEAP : TASK_EXPENSIVE);
 
-    // 以只读的方式打开文件
-    int fd = open(m_real_file, O_RDONLY);
-    // 创建内存映射 文件会被直接映射到内存，对该内存进行操作也就是对文件操作了
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+    // 没有预压缩版本的文本文件，客户端接受gzip时在线压缩
+    // epoll后端在工作线程里，可以直接压缩；io_uring后端在事件循环线程里，交给后台线程，这一次先不压缩
+    // Range请求不在线压缩，范围按原文件计算
+    Gzip_Cache * gzip_cache = Gzip_Cache::get_instance();
+    bool range = (m_method == GET && has_header(HEADER_RANGE));
+    if(!range && (m_accept_encoding & ENCODING_GZIP) && gzip_cache->eligible(entry)) {
+        m_gzip = gzip_cache->acquire(entry, m_epfd != -1);
+        if(m_gzip) {
+            return not_modified(m_gzip->etag, m_file_stat.st_mtime) ? NOT_MODIFIED : FILE_REQUEST;
+        }
+    }
+
+    // 条件请求：客户端缓存的就是这个版本，返回不带响应体的304
+    if(not_modified(entry->etag, m_file_stat.st_mtime)) {
+        return NOT_MODIFIED;
+    }
+
+    // Range请求，If-Range不匹配时忽略Range发送整个文件
+    HTTP_CODE ret = FILE_REQUEST;
+    if(range && if_range_match(entry)) {
+        ret = parse_range(m_file_stat.st_size);
+        if(ret == RANGE_NOT_SATISFIABLE) {
+            return ret;
+        }
+    }
+
+    // 小文件的内容已经在缓存里了；epoll后端的大文件用缓存里打开的fd直接sendfile
+    // sendfile只能发送文件中连续的一段，多个范围的时候也要映射到内存里
+    if(entry->data || entry->fd == -1 || (m_use_sendfile && m_range_count <= 1) || m_method == HEAD) {
+        return ret;
+    }
+    // io_uring后端没有sendfile，大文件还是映射到内存里，用sendmsg发送
+    if(m_file_stat.st_size > 0) {
+        m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if(m_file_address == MAP_FAILED) {
+            m_file_address = 0;
+            return INTERNAL_ERROR;
+        }
+    }
+    return ret;
+}
+
+// If-None-Match: "a", W/"b" 或者 *
+// GET/HEAD的条件请求用弱比较，W/前缀忽略
+bool http_conn::etag_match(string_view list, const string & etag) {
+    while(!list.empty()) {
+        size_t skip = list.find_first_not_of(" \t,");
+        if(skip == string_view::npos) {
+            break;
+        }
+        list.remove_prefix(skip);
+        if(list[0] == '*') {
+            return true;
+        }
+        if(list.size() > 2 && list[0] == 'W' && list[1] == '/') {
+            list.remove_prefix(2);
+        }
+        size_t end = (list[0] == '"') ? list.find('"', 1) : list.find(',');
+        string_view tag = list.substr(0, (end == string_view::npos || list[0] != '"') ? end : end + 1);
+        if(tag == etag) {
+            return true;
+        }
+        list.remove_prefix(tag.size());
+    }
+    return false;
+}
+
+// 有If-None-Match时只看它，没有时才看If-Modified-Since（RFC 7232 6.）
+bool http_conn::not_modified(const string & etag, time_t mtime) {
+    if(has_header(HEADER_IF_NONE_MATCH)) {
+        return etag_match(header(HEADER_IF_NONE_MATCH), etag);
+    }
+    if(has_header(HEADER_IF_MODIFIED_SINCE)) {
+        string_view since = header(HEADER_IF_MODIFIED_SINCE);
+        time_t t = File_Cache::parse_http_date(since.data(), since.size());
+        return t != -1 && mtime <= t;
+    }
+    return false;
 }
 
-// 释放内存映射
+// If-Range: "etag" 或者 HTTP-date，ETag用强比较，弱校验器永远不匹配
+bool http_conn::if_range_match(File_Entry * entry) {
+    if(!has_header(HEADER_IF_RANGE)) {
+        return true;
+    }
+    string_view value = header(HEADER_IF_RANGE);
+    if(!value.empty() && (value[0] == '"' || value.substr(0, 2) == "W/")) {
+        return value == entry->etag;
+    }
+    time_t t = File_Cache::parse_http_date(value.data(), value.size());
+    return t != -1 && t == entry->st.st_mtime;
+}
+
+// 读取一个不超过18位的十进制数，没有数字返回-1
+static off_t parse_offset(string_view & text) {
+    off_t value = 0;
+    size_t i = 0;
+    while(i < text.size() && i < 18 && text[i] >= '0' && text[i] <= '9') {
+        value = value * 10 + (text[i] - '0');
+        i++;
+    }
+    if(i == 0 || (i < text.size() && text[i] >= '0' && text[i] <= '9')) {
+        return -1;
+    }
+    text.remove_prefix(i);
+    return value;
+}
+
+// Range: bytes=0-499, 1000-, -500
+// 语法错误、不认识的单位或者范围太多时忽略Range（返回FILE_REQUEST），没有一个范围在文件内返回RANGE_NOT_SATISFIABLE
+http_conn::HTTP_CODE http_conn::parse_range(off_t size) {
+    string_view text = header(HEADER_RANGE);
+    if(text.size() < 6 || strncasecmp(text.data(), "bytes=", 6) != 0) {
+        return FILE_REQUEST;
+    }
+    text.remove_prefix(6);
+    int specs = 0;
+    m_range_count = 0;
+    while(true) {
+        size_t skip = text.find_first_not_of(" \t,");
+        if(skip == string_view::npos) {
+            break;
+        }
+        text.remove_prefix(skip);
+        off_t start = 0, end = 0;
+        if(text[0] == '-') {
+            // 最后n个字节
+            text.remove_prefix(1);
+            off_t n = parse_offset(text);
+            if(n < 0) {
+                m_range_count = 0;
+                return FILE_REQUEST;
+            }
+            start = (n < size) ? size - n : 0;
+            end = (n > 0) ? size - 1 : -1;
+        } else {
+            start = parse_offset(text);
+            if(start < 0 || text.empty() || text[0] != '-') {
+                m_range_count = 0;
+                return FILE_REQUEST;
+            }
+            text.remove_prefix(1);
+            end = size - 1;
+            if(!text.empty() && text[0] >= '0' && text[0] <= '9') {
+                off_t last = parse_offset(text);
+                if(last < start) {
+                    m_range_count = 0;
+                    return FILE_REQUEST;
+                }
+                end = (last < size - 1) ? last : size - 1;
+            }
+        }
+        size_t next = text.find_first_not_of(" \t");
+        if(next != string_view::npos && text[next] != ',') {
+            m_range_count = 0;
+            return FILE_REQUEST;
+        }
+        specs++;
+        // 起始位置超出文件的范围不满足，跳过
+        if(start > end || start >= size) {
+            continue;
+        }
+        if(m_range_count == MAX_RANGES) {
+            m_range_count = 0;
+            return FILE_REQUEST;
+        }
+        m_ranges[m_range_count].start = start;
+        m_ranges[m_range_count].end = end;
+        m_range_count++;
+    }
+    if(specs == 0) {
+        return FILE_REQUEST;
+    }
+    return (m_range_count > 0) ? PARTIAL_CONTENT : RANGE_NOT_SATISFIABLE;
+}
+
+// 释放一个响应占用的内存映射、在线压缩结果和文件缓存条目的引用
+static void release_body(File_Entry * file, Gzip_Entry * gzip, char * address, long length) {
+    if(address) {
+        munmap(address, length);
+    }
+    if(gzip) {
+        Gzip_Cache::get_instance()->release(gzip);
+    }
+    if(file) {
+        File_Cache::get_instance()->release(file);
+    }
+}
+
+// 释放当前请求和这一批响应占用的文件（文件由缓存负责关闭）
 void http_conn::unmap(){
-    if(m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+    release_body(m_file, m_gzip, m_file_address, m_file_stat.st_size);
+    m_file = NULL;
+    m_gzip = NULL;
+    m_file_address = 0;
+    for(int i = 0; i < m_body_count; i++) {
+        release_body(m_bodies[i].file, m_bodies[i].gzip, m_bodies[i].address, m_bodies[i].length);
+    }
+    m_body_count = 0;
+    m_sendfile = NULL;
+    // 流式响应没有发送完连接就断开了
+    delete m_stream;
+    m_stream = NULL;
+    m_stream_head_pending = false;
+    Buffer_Pool::release(m_chunk_buf, m_chunk_buf_size);
+    m_chunk_buf = NULL;
+    m_chunk_buf_size = 0;
+    if(m_h2) {
+        m_h2->release_sent();
     }
 }
 
+void http_conn::release_session() {
+    delete m_h2;
+    m_h2 = NULL;
+    // 数据源已经都释放了（它们会先把自己的fd从等待集合中删掉）
+    if(m_park_fd != -1) {
+        close(m_park_fd);
+        m_park_fd = -1;
+    }
+    m_waiting = false;
+    // 连接已经要关闭了，不再发送close_notify
+    SSL_free(m_ssl);
+    m_ssl = NULL;
+    m_tls_ready = false;
+    m_tls_want_write = false;
+    m_ktls_send = false;
+    m_ktls_recv = false;
+}
+
 // 解析具体的某一行 - 从状态机 - 根据\n获取的
 http_conn::LINE_STATUS http_conn::parse_line(){
     // 获取一行数据 结束标志\r\n
-    char temp; // 临时字符
-    // 循环对检查索引递增，直到读的索引
-    for(; m_checked_index < m_read_index; ++m_checked_index) {
-        temp = m_read_buf[m_checked_index]; // 字符赋值给temp
-        if(temp == '\r') { // 如果temp为\r就判断下一个是否是\n
-            // 如果说当前的是\r，但下一个没有了，是下一次读取的索引了
-            if((m_checked_index + 1) == m_read_index) {
-                return LINE_OPEN;
-            } else if((m_read_buf[m_checked_index + 1] == '\n')) {
-                // 如果是，就将\r\n的\r和\n都变为\0
-                m_read_buf[m_checked_index++] = '\0';
-                m_read_buf[m_checked_index++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        } else if(temp == '\n') {
-            // 按道理来说，\r之后的\n是直接被上一步就置为\0的，这只能是两个连续的\n
-            // 不过这里还是进行判断了
-            if((m_checked_index > 1) && (m_read_buf[m_checked_index - 1] == '\r')) {
-                m_read_buf[m_checked_index-1] = '\0';
-                m_read_buf[m_checked_index++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-    }
-    return LINE_OPEN;
+    // 向量化地跳过所有不是\r和\n的字节（一次比较16~32个字节），直接定位到第一个\r或\n
+    m_checked_index = Tokenizer::find2(m_read_buf + m_checked_index, m_read_buf + m_read_index, '\r', '\n') - m_read_buf;
+    if(m_checked_index >= m_read_index) {
+        return LINE_OPEN;
+    }
+    char temp = m_read_buf[m_checked_index]; // 临时字符
+    if(temp == '\r') { // 如果temp为\r就判断下一个是否是\n
+        // 如果说当前的是\r，但下一个没有了，是下一次读取的索引了
+        if((m_checked_index + 1) == m_read_index) {
+            return LINE_OPEN;
+        } else if((m_read_buf[m_checked_index + 1] == '\n')) {
+            // 如果是，就将\r\n的\r和\n都变为\0
+            m_read_buf[m_checked_index++] = '\0';
+            m_read_buf[m_checked_index++] = '\0';
+            return LINE_OK;
+        }
+        return LINE_BAD;
+    }
+    // 按道理来说，\r之后的\n是直接被上一步就置为\0的，这只能是两个连续的\n
+    // 不过这里还是进行判断了
+    if((m_checked_index > 1) && (m_read_buf[m_checked_index - 1] == '\r')) {
+        m_read_buf[m_checked_index-1] = '\0';
+        m_read_buf[m_checked_index++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
 }
 
 // 解析请求首行 - 解析请求分开写
@@ -250,23 +816,24 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char * text){
     // text是一行的数据 GET / HTTP/1.1
     // 这里利用字符串或者正则表达式使用
     // 查找text中 空格和\t的第一个位置，首先找到了text + 3
-    m_url = strpbrk(text, " \t");
-    if(!m_url) {
+    m_url = (char *)Tokenizer::find2(text, m_line_end, ' ', '\t');
+    if(m_url == m_line_end) {
         return BAD_REQUEST;
     }
 
     *m_url++ = '\0'; // GET\0/ HTTP/1.1
-    char * method = text; // 因为后面有一个\0了所以直接获取就是了
-    if(strcasecmp(method, "GET") == 0) {
-        m_method = GET;
-    } else {
+    // 请求方法在编译期生成的完美哈希表中查找，顺序和METHOD一致
+    int method = method_table.find(string_view(text, m_url - 1 - text));
+    if(method < 0) {
         return BAD_REQUEST;
     }
+    m_method = (METHOD)method;
 
     // 获取版本
     // m_url = / HTTP/1.1
-    m_version = strpbrk(m_url, " \t");
-    if(!m_version) {
+    m_version = (char *)Tokenizer::find2(m_url, m_line_end, ' ', '\t');
+    if(m_version == m_line_end) {
+        m_version = 0;
         return BAD_REQUEST;
     }
     *m_version++ = '\0'; // /\0HTTP/1.1
@@ -284,6 +851,7 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char * text){
         return BAD_REQUEST;
     }
     m_checked_state = CHECK_STATE_HEADER; // 检查状态变为检查请求头 
+    m_header_start = m_checked_index;
     return NO_REQUEST;
 }
 
@@ -291,43 +859,129 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char * text){
 http_conn::HTTP_CODE http_conn::parse_headers(char * text){
     // 如果遇到空行，说明头部解析完毕
     if(text[0] == '\0') {
+        m_header_end = text - m_read_buf;
         // 如果HTTP请求有消息体，还需要再读取一下m_content_length字节的消息体
         if(m_content_length != 0) {
+            if(m_content_length > m_buffer_max - m_checked_index) {
+                return CONTENT_TOO_LARGE;
+            }
             m_checked_state = CHECK_STATE_CONTENT; // 状态机，如果就剩请求体没转，则转换到STATE_CONTENT状态
             return NO_REQUEST; // 返回还没有解析完毕呢
         }
         // 否则说明m_content_length=0说明没有请求体了
         return GET_REQUEST; // 返回一个完整的请求
-    } else if(strncasecmp(text, "Connection:", 11) == 0) {
-        // 处理Connection头部字段 Connection: keep-alive
-        text += 11; // text往后移动11个位置，到数据开始位置的空格处
-        // strspn函数用于查找第一个字符串的前n个都属于第二个字符串的子串
-        // 这里就是为了将空格和\t给去除，直接定位到数据位置
-        text += strspn(text, " \t");
-
-        if(strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
-        }
-    } else if(strncasecmp(text, "Content-Length:", 15) == 0) {
-        // 处理Content-Length头部
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text); // string to long int
-    } else if(strncasecmp(text, "Host:", 5) == 0) {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else {
-        printf("Ops! unknow header %s\n", text);
+    }
+
+    // 向量化地查找头部名和值之间的':'，没有':'的行直接忽略
+    char * colon = (char *)Tokenizer::find2(text, m_line_end, ':', ':');
+    if(colon == m_line_end) {
+        return NO_REQUEST;
+    }
+    // 头部名在编译期生成的完美哈希表中查找，不认识的头部直接忽略
+    int id = header_table.find(string_view(text, colon - text));
+    if(id < 0) {
+        return NO_REQUEST;
+    }
+    // strspn函数用于查找第一个字符串的前n个都属于第二个字符串的子串
+    // 这里就是为了将空格和\t给去除，直接定位到数据位置，值末尾的空白也去掉
+    char * value = colon + 1 + strspn(colon + 1, " \t");
+    char * end = m_line_end;
+    while(end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+        *--end = '\0';
+    }
+    // 重复的Content-Length（即使值相同）无法确定请求体的边界，按请求错误处理
+    if(id == HEADER_CONTENT_LENGTH && has_header(HEADER_CONTENT_LENGTH)) {
+        return BAD_REQUEST;
+    }
+    m_headers[id] = string_view(value, end - value);
+    m_header_mask |= 1ULL << id;
+
+    // 影响解析和连接状态的头部在这里直接处理，其他的头部之后按需从槽里取
+    switch(id) {
+        case HEADER_CONNECTION:
+            // 处理Connection头部字段 Connection: keep-alive
+            if(strcasecmp(value, "keep-alive") == 0) {
+                m_linger = true;
+            } else if(strcasecmp(value, "close") == 0) {
+                m_linger = false;
+            }
+            break;
+        case HEADER_CONTENT_LENGTH:
+            // 处理Content-Length头部，请求体必须能放进读缓冲区（之后还有头部，空行处再检查一次）
+            // 格式正确但是太大的回复413，不用等请求体到达
+            if(!parse_content_length(value, m_buffer_max - m_checked_index, m_content_length)) {
+                return (*value && value[strspn(value, "0123456789")] == '\0') ? CONTENT_TOO_LARGE : BAD_REQUEST;
+            }
+            break;
+        case HEADER_ACCEPT_ENCODING:
+            // 处理Accept-Encoding头部 Accept-Encoding: gzip, deflate, br
+            m_accept_encoding = parse_accept_encoding(value);
+            break;
+        default:
+            break;
     }
     return NO_REQUEST;
 }
 
+// 解析Accept-Encoding的值，返回客户端接受的编码（CONTENT_ENCODING按位或）
+// 每一项的格式为 编码名[;q=权重]，q=0表示明确不接受，*表示接受所有编码
+int http_conn::parse_accept_encoding(const char * text) {
+    int accept = ENCODING_IDENTITY;
+    while(*text) {
+        text += strspn(text, " \t,");
+        const char * name = text;
+        int name_len = strcspn(text, " \t,;");
+        text += name_len;
+        // 查找q参数，q=0、q=0.0之类的表示不接受
+        bool refused = false;
+        const char * end = text + strcspn(text, ",");
+        const char * q = strstr(text, "q=");
+        if(q && q < end) {
+            q += 2;
+            refused = (atof(q) <= 0.0);
+        }
+        text = end;
+        if(refused || name_len == 0) {
+            continue;
+        }
+        if((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) || (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            accept |= ENCODING_GZIP;
+        } else if(name_len == 2 && strncasecmp(name, "br", 2) == 0) {
+            accept |= ENCODING_BR;
+        } else if(name_len == 1 && name[0] == '*') {
+            accept |= ENCODING_GZIP | ENCODING_BR;
+        }
+    }
+    return accept;
+}
+
+// 解析Content-Length的值，负数、带符号或其他字符、溢出和超过max的都不接受
+bool http_conn::parse_content_length(const char * text, long int max, long int & length) {
+    if(*text == '\0') {
+        return false;
+    }
+    long int value = 0;
+    for(; *text; text++) {
+        if(*text < '0' || *text > '9') {
+            return false;
+        }
+        value = value * 10 + (*text - '0');
+        // max不超过读缓冲区的上限，每一步都和它比较，不会溢出
+        if(value > max) {
+            return false;
+        }
+    }
+    length = value;
+    return true;
+}
+
 // 解析请求体
 http_conn::HTTP_CODE http_conn::parse_content(char * text){
     // 这里不对请求体进行真正的解析，而是只判断请求体是否有
+    // 请求体后面可能紧跟着流水线中的下一个请求，所以不能写'\0'，只把解析位置移到请求体之后
     if(m_read_index >= (m_content_length + m_checked_index)) {
-        text[m_content_length] = '\0';
+        m_content = m_read_buf + m_checked_index;
+        m_checked_index += m_content_length;
         return GET_REQUEST;
     }
     return NO_REQUEST;
@@ -342,10 +996,14 @@ http_conn::HTTP_CODE http_conn::process_read() {
     // 怎么解析成三部分，一行一行的读取先
     // 情况1：主状态机的状态是解析内容，以及当前解析行状态为OK
     // 情况2：获取了一行数据解析，并且解析后返回的数据为Line_OK
+    // 请求体不按行解析：请求体还没有收完时不能调用parse_line，否则解析位置会移到已收到的数据末尾，
+    // 请求体中的\r\n也会被改成\0\0
     while(((m_checked_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK)) 
-                                || ((line_status = parse_line()) == LINE_OK)) {
+                                || ((m_checked_state != CHECK_STATE_CONTENT) && (line_status = parse_line()) == LINE_OK)) {
         // 解析到了一行完整的数据，或者解析到了请求体，也是完整的数据
         text = get_line();
+        // 行尾的\r\n已经被改成了\0\0
+        m_line_end = m_read_buf + m_checked_index - 2;
         // 修改起始下标
         m_start_line = m_checked_index;
         // printf("got 1 http line : %s\n", text);
@@ -357,6 +1015,8 @@ http_conn::HTTP_CODE http_conn::process_read() {
                 // 语法错误就直接不解析了
                 ret = parse_request_line(text);
                 if(ret == BAD_REQUEST) {
+                    // 请求的边界已经无法确定，后面的流水线请求也不能再解析了，响应后关闭连接
+                    m_linger = false;
                     return BAD_REQUEST;
                 }
                 // 后面还有很多其他可能，这里不写了
@@ -366,8 +1026,10 @@ http_conn::HTTP_CODE http_conn::process_read() {
             case CHECK_STATE_HEADER: {
                 //printf("正在分析请求头...\n");
                 ret = parse_headers(text);
-                if(ret == BAD_REQUEST) { // 如果语法错误，直接返回
-                    return BAD_REQUEST;
+                if(ret == BAD_REQUEST || ret == CONTENT_TOO_LARGE) { // 如果语法错误或者请求体太大，直接返回
+                    // 请求体没有读，后面的数据无法解析，响应后关闭连接
+                    m_linger = false;
+                    return ret;
                 } else if(ret == GET_REQUEST) { // 如果是获取了一个完整请求（请求完成了）
                     return do_request(); // 解析具体的请求信息
                 }
@@ -384,6 +1046,7 @@ http_conn::HTTP_CODE http_conn::process_read() {
                 break;
             }
             default: {
+                m_linger = false;
                 return INTERNAL_ERROR;
             }
         }
@@ -395,59 +1058,114 @@ http_conn::HTTP_CODE http_conn::process_read() {
 // 往写缓冲m_write_buf中写入待发送的数据
 // 传入参数格式字符串和可变参数
 bool http_conn::add_response(const char* format, ...) {
-    // 如果当前写缓冲区下标大于写缓冲区的最大（写缓冲区写满了）
-    if( m_write_index >= WRITE_BUFFER_SIZE ) {
+    // 写缓冲区还没有借就先借一块
+    if(!m_write_buf && !grow_write_buf(WRITE_BUFFER_SIZE)) {
         return false;
     }
     // 定义一个va_list可变参数列表
     va_list arg_list; // 这个主要是指向可变参数列表的
     va_start(arg_list, format); // 将可变参数列表指向可变参数起始位置
+    va_list retry_list;
+    va_copy(retry_list, arg_list);
     // 通过vsnprintf函数，将格式化的数据写入写缓冲区，其类似sprintf
-    int len = vsnprintf(m_write_buf + m_write_index, WRITE_BUFFER_SIZE - 1 - m_write_index, format, arg_list);
-    // 如果len超过了可写入空间大小，写缓冲区就满了，就不继续写入了
-    if(len >= (WRITE_BUFFER_SIZE - 1 - m_write_index)) {
-        return false;
+    int len = vsnprintf(m_write_buf + m_write_index, m_write_buf_size - 1 - m_write_index, format, arg_list);
+    // 如果len超过了可写入空间大小，写缓冲区扩容后再写一次，已经达到上限就不继续写入了
+    if(len >= (m_write_buf_size - 1 - m_write_index)) {
+        if(!grow_write_buf(m_write_index + len + 1)) {
+            va_end(retry_list);
+            va_end(arg_list);
+            return false;
+        }
+        vsnprintf(m_write_buf + m_write_index, m_write_buf_size - 1 - m_write_index, format, retry_list);
     }
     // 每次写将增加
     m_write_index += len;
     // va_end宏结束对可变参数的访问
+    va_end(retry_list);
     va_end(arg_list);
     return true;
 }
 
-// 添加状态头
+// 往写缓冲m_write_buf中写入预先生成好的数据
+bool http_conn::add_bytes(const char * data, int len) {
+    if(len >= (m_write_buf_size - 1 - m_write_index) && !grow_write_buf(m_write_index + len + 1)) {
+        return false;
+    }
+    memcpy(m_write_buf + m_write_index, data, len);
+    m_write_index += len;
+    return true;
+}
+
+// 数字直接转换成十进制写入写缓冲区，不经过vsnprintf
+bool http_conn::add_number(string_view name, unsigned long value, string_view suffix) {
+    int len = name.size() + Header_Builder::MAX_DIGITS + suffix.size();
+    if(len >= (m_write_buf_size - 1 - m_write_index) && !grow_write_buf(m_write_index + len + 1)) {
+        return false;
+    }
+    char * p = m_write_buf + m_write_index;
+    memcpy(p, name.data(), name.size());
+    p += name.size();
+    p += Header_Builder::format_ulong(p, value);
+    memcpy(p, suffix.data(), suffix.size());
+    p += suffix.size();
+    m_write_index = p - m_write_buf;
+    return true;
+}
+
+// 添加状态头，常用的状态行是预先生成好的，原因短语不一样时（代理转发的上游状态行）按title拼出来
 bool http_conn::add_status_line( int status, const char* title ) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    string_view line = Header_Builder::status_line(status, title);
+    if(!line.empty()) {
+        return add_bytes(line);
+    }
+    return add_number("HTTP/1.1 ", status, " ") && add_bytes(title, strlen(title)) && add_bytes(Header_Builder::CRLF);
 }
 
 // 添加请求头
-bool http_conn::add_headers(int content_len) {
+bool http_conn::add_headers(long content_len) {
     add_content_length(content_len);
     add_content_type();
+    add_date();
     add_linger();
     add_blank_line();
     return true;
 }
 
 // 添加请求
-bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length: %d\r\n", content_len);
+bool http_conn::add_content_length(long content_len) {
+    return add_number(Header_Builder::CONTENT_LENGTH, content_len);
 }
 
 bool http_conn::add_linger() {
-    return add_response("Connection: %s\r\n", ( m_linger == true ) ? "keep-alive" : "close");
+    return add_bytes(m_linger ? Header_Builder::KEEP_ALIVE : Header_Builder::CLOSE);
+}
+
+// Date由共享的时钟每秒生成一次，这里只拷贝
+bool http_conn::add_date() {
+    if(Coarse_Clock::DATE_LEN >= (m_write_buf_size - 1 - m_write_index) && !grow_write_buf(m_write_index + Coarse_Clock::DATE_LEN + 1)) {
+        return false;
+    }
+    m_write_index += Coarse_Clock::date(m_write_buf + m_write_index);
+    return true;
 }
 
 bool http_conn::add_blank_line() {
-    return add_response("%s", "\r\n");
+    return add_bytes(Header_Builder::CRLF);
 }
 
 bool http_conn::add_content(const char* content) {
-    return add_response("%s", content);
+    return add_bytes(content, strlen(content));
 }
 
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_bytes(Header_Builder::CONTENT_TYPE_HTML);
+}
+
+// Content-Range: bytes start-end/size
+bool http_conn::add_content_range(long start, long end, long size) {
+    add_number("Content-Range: bytes ", start, "-");
+    add_number("", end, "/");
+    return add_number("", size);
 }
 
 
@@ -469,6 +1187,13 @@ bool http_conn::process_write(HTTP_CODE ret) {
                 return false;
             }
             break;
+        case CONTENT_TOO_LARGE:
+            add_status_line( 413, error_413_title );
+            add_headers( strlen( error_413_form ) );
+            if ( ! add_content( error_413_form ) ) {
+                return false;
+            }
+            break;
         case NO_RESOURCE:
             add_status_line( 404, error_404_title );
             add_headers( strlen( error_404_form ) );
@@ -483,41 +1208,541 @@ bool http_conn::process_write(HTTP_CODE ret) {
                 return false;
             }
             break;
+        case RANGE_NOT_SATISFIABLE:
+            add_status_line( 416, error_416_title );
+            add_number( "Content-Range: bytes */", m_file_stat.st_size );
+            add_headers( strlen( error_416_form ) );
+            if ( ! add_content( error_416_form ) ) {
+                return false;
+            }
+            break;
+        case PARTIAL_CONTENT:
+            return add_partial_content();
+        case STREAM_REQUEST: {
+            // 响应体在发送的时候一块一块地从数据源取
+            // 数据源还没有准备好响应头时先不生成，这个响应一定是这一批的最后一个，由refill在发送时生成
+            m_stream_method = m_method;
+            m_stream_linger = m_linger;
+            int ret = add_stream_head();
+            m_stream_head_pending = (ret == Stream_Source::AGAIN);
+            if(ret < 0 && !m_stream_head_pending) {
+                return process_write(BAD_GATEWAY);
+            }
+            return true;
+        }
+        case BAD_GATEWAY:
+            add_status_line( 502, error_502_title );
+            add_headers( strlen( error_502_form ) );
+            if ( ! add_content( error_502_form ) ) {
+                return false;
+            }
+            break;
+        case METHOD_NOT_ALLOWED:
+            add_status_line( 405, error_405_title );
+            add_bytes( "Allow: " );
+            add_bytes( m_allow );
+            add_bytes( Header_Builder::CRLF );
+            add_headers( strlen( error_405_form ) );
+            if ( ! add_content( error_405_form ) ) {
+                return false;
+            }
+            break;
+        case NOT_MODIFIED: {
+            // 304没有响应体，只带上校验器，让客户端更新它缓存的副本
+            const string & etag = m_gzip ? m_gzip->etag : m_file->etag;
+            add_status_line( 304, "Not Modified" );
+            add_bytes( "ETag: " );
+            add_bytes( etag );
+            add_bytes( "\r\nLast-Modified: " );
+            add_bytes( m_file->last_modified );
+            add_blank_line();
+            if(m_file->compressible) {
+                add_bytes( "Vary: Accept-Encoding\r\n" );
+            }
+            add_date();
+            add_linger();
+            add_blank_line();
+            queue_response(NULL, 0);
+            return true;
+        }
         case FILE_REQUEST:
-            add_status_line(200, ok_200_title );
-            add_headers(m_file_stat.st_size);
-            m_iv[ 0 ].iov_base = m_write_buf;
-            m_iv[ 0 ].iov_len = m_write_index;
-            m_iv[ 1 ].iov_base = m_file_address;
-            m_iv[ 1 ].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
+            if(m_gzip) {
+                // 在线压缩的结果直接从内存发送
+                add_bytes(m_gzip->headers.data(), m_gzip->headers.size());
+                add_date();
+                add_linger();
+                add_blank_line();
+                queue_response((m_method == HEAD) ? NULL : m_gzip->data, (m_method == HEAD) ? 0 : m_gzip->size);
+                return true;
+            }
+            // 状态行、Content-Length和Content-Type由文件缓存预先生成，直接拷贝
+            add_bytes(m_file->headers.data(), m_file->headers.size());
+            add_date();
+            add_linger();
+            add_blank_line();
+            if(m_method == HEAD) {
+                // HEAD只发送响应头，Content-Length还是文件的大小
+                queue_response(NULL, 0);
+            } else if(m_file->data) {
+                // 小文件直接从缓存的内存里发送
+                queue_response(m_file->data, m_file_stat.st_size);
+            } else if(m_file_address) {
+                queue_response(m_file_address, m_file_stat.st_size);
+            } else {
+                // 文件内容由write中的sendfile发送，这个响应只能是这一批的最后一个
+                File_Entry * file = m_file;
+                queue_response(NULL, 0);
+                if(file->fd != -1 && m_file_stat.st_size > 0) {
+                    m_sendfile = file;
+                    m_file_offset = 0;
+                    m_file_remaining = m_file_stat.st_size;
+                    m_bytes_to_send += m_file_stat.st_size;
+                }
+            }
             return true;
         default:
             return false;
     }
-    m_iv[ 0 ].iov_base = m_write_buf;
-    m_iv[ 0 ].iov_len = m_write_index;
-    m_iv_count = 1;
+    queue_response(NULL, 0);
+    return true;
+}
+
+bool http_conn::streaming() const {
+    return m_stream != NULL || (m_h2 && m_h2->has_output());
+}
+
+void http_conn::start_stream(Stream_Source * source, const char * mime) {
+    delete m_stream;
+    m_stream = source;
+    m_stream_mime = mime;
+}
+
+int http_conn::add_stream_head() {
+    Stream_Head head;
+    head.status = 200;
+    head.reason = ok_200_title;
+    head.content_length = Stream_Head::UNKNOWN_LENGTH;
+    int ret = m_stream->head(&head);
+    if(ret != 0) {
+        if(ret != Stream_Source::AGAIN) {
+            delete m_stream;
+            m_stream = NULL;
+        }
+        return ret;
+    }
+    add_status_line( head.status, head.reason );
+    if(m_stream_mime) {
+        add_bytes( "Content-Type:" );
+        add_bytes( m_stream_mime );
+        add_blank_line();
+    }
+    add_bytes( head.headers );
+    // 长度事先不知道就用chunked编码，知道长度（上游给了Content-Length）就原样转发
+    m_stream_chunked = (head.content_length == Stream_Head::UNKNOWN_LENGTH);
+    if(m_stream_chunked) {
+        add_bytes( "Transfer-Encoding: chunked\r\n" );
+    } else if(head.content_length >= 0) {
+        add_content_length( head.content_length );
+    }
+    m_linger = m_stream_linger;
+    add_date();
+    add_linger();
+    add_blank_line();
+    if(m_stream_method == HEAD || head.content_length == Stream_Head::NO_BODY || head.content_length == 0) {
+        delete m_stream;
+        m_stream = NULL;
+    }
+    queue_response(NULL, 0);
+    return 0;
+}
+
+bool http_conn::wait_source(Stream_Source * source) {
+    if(m_park_fd == -1) {
+        m_park_fd = epoll_create1(EPOLL_CLOEXEC);
+        if(m_park_fd < 0) {
+            m_park_fd = -1;
+            return false;
+        }
+    }
+    int fd = source->wait_fd();
+    if(fd < 0 || !arm_oneshot(m_park_fd, fd, fd, source->wait_events())) {
+        return false;
+    }
+    source->wait_epfd = m_park_fd;
+    m_waiting = true;
+    return true;
+}
+
+void http_conn::arm(int ev) {
+    if(m_waiting) {
+        park(ev);
+    } else {
+        modifyfd(m_epfd, m_sockfd, ev, m_trig_mode);
+    }
+}
+
+// 客户端的fd和数据源的fd都在等待集合里，等待集合注册到事件循环上，任何一个就绪都会唤醒这个连接
+// io_uring后端由事件循环直接poll等待集合，客户端的数据由multishot recv接收
+void http_conn::park(int ev) {
+    if(m_epfd == -1) {
+        return;
+    }
+    arm_oneshot(m_park_fd, m_sockfd, m_sockfd, ev | EPOLLRDHUP);
+    arm_oneshot(m_epfd, m_park_fd, PARK_EVENT | (uint32_t)m_sockfd, EPOLLIN);
+}
+
+int http_conn::unpark() {
+    // 不区分是哪个数据源就绪了，都重新尝试一次，还没有数据的会再次返回AGAIN
+    m_waiting = false;
+    if(m_h2) {
+        m_h2->wake();
+    }
+    int client_events = 0;
+    epoll_event events[16];
+    int n = epoll_wait(m_park_fd, events, 16, 0);
+    for(int i = 0; i < n; i++) {
+        if(events[i].data.u64 == (uint64_t)m_sockfd) {
+            client_events = events[i].events;
+        }
+    }
+    return client_events;
+}
+
+const sockaddr_in & http_conn::get_address() {
+    if(m_addr.sin_family != AF_INET) {
+        socklen_t len = sizeof(m_addr);
+        getpeername(m_sockfd, (struct sockaddr *)&m_addr, &len);
+    }
+    return m_addr;
+}
+
+// 每一块的格式为 长度（十六进制）\r\n 数据 \r\n，最后一块为 0\r\n\r\n
+// 长度行预留在数据前面，数据直接读到缓冲区里，不需要再拷贝一次
+bool http_conn::refill() {
+    static const int CHUNK_HEAD = 10;   // 最多8位十六进制的长度 + \r\n
+    static const char * hex = "0123456789abcdef";
+    if(m_h2) {
+        // 上一批已经发送完了，释放已经结束的流，再调度下一批
+        // epoll后端顺便读取发送期间到达的帧（窗口更新、新的请求），io_uring后端的数据已经在读缓冲区里了
+        m_write_index = 0;
+        m_response_start = 0;
+        m_iv_count = 0;
+        m_h2->release_sent();
+        return m_h2->process(m_epfd != -1);
+    }
+    if(m_stream_head_pending) {
+        // 上一批响应已经发送完了，响应头从写缓冲区的开头生成
+        m_write_index = 0;
+        m_response_start = 0;
+        m_iv_count = 0;
+        int ret = add_stream_head();
+        if(ret == Stream_Source::AGAIN) {
+            return wait_source(m_stream);
+        }
+        m_stream_head_pending = false;
+        if(ret < 0) {
+            m_linger = m_stream_linger;
+            return process_write(BAD_GATEWAY);
+        }
+        if(!m_stream) {
+            return true;
+        }
+    }
+    if(!m_chunk_buf) {
+        m_chunk_buf = Buffer_Pool::acquire(STREAM_CHUNK_SIZE, &m_chunk_buf_size);
+    }
+    char * data = m_chunk_buf + CHUNK_HEAD;
+    int len = m_stream->read(data, m_chunk_buf_size - CHUNK_HEAD - 2);
+    if(len == Stream_Source::AGAIN) {
+        // 响应头已经可以先发送了
+        return m_iv_count > 0 || wait_source(m_stream);
+    }
+    if(len < 0) {
+        return false;
+    }
+    char * start = data;
+    char * end = data;
+    if(!m_stream_chunked) {
+        // 按Content-Length发送，数据原样发送，数据源负责长度正确
+        end = data + len;
+        if(len == 0) {
+            delete m_stream;
+            m_stream = NULL;
+        }
+    } else if(len > 0) {
+        *--start = '\n';
+        *--start = '\r';
+        for(int n = len; n > 0; n >>= 4) {
+            *--start = hex[n & 15];
+        }
+        end = data + len;
+        *end++ = '\r';
+        *end++ = '\n';
+    } else {
+        // 数据源结束了，发送最后一块，发送完后这个响应就结束了
+        memcpy(data, "0\r\n\r\n", 5);
+        end = data + 5;
+        delete m_stream;
+        m_stream = NULL;
+    }
+    if(end > start) {
+        m_iv[m_iv_count].iov_base = start;
+        m_iv[m_iv_count].iov_len = end - start;
+        m_iv_count++;
+        m_bytes_to_send += end - start;
+    }
+    return true;
+}
+
+// 生成206响应，响应体直接指向缓存的内存或映射的文件，和200一样不拷贝
+// 单个范围在epoll后端的大文件上直接sendfile这一段
+bool http_conn::add_partial_content() {
+    static atomic<unsigned long> boundary_seq(0);
+    long size = m_file_stat.st_size;
+    char * base = m_file->data ? m_file->data : m_file_address;
+
+    add_status_line( 206, "Partial Content" );
+    if(m_range_count == 1) {
+        off_t start = m_ranges[0].start, end = m_ranges[0].end;
+        add_content_length( end - start + 1 );
+        add_bytes( "Content-Type:" );
+        add_bytes( m_file->mime );
+        add_blank_line();
+        add_content_range( start, end, size );
+        add_bytes( m_file->common_headers.data(), m_file->common_headers.size() );
+        add_date();
+        add_linger();
+        add_blank_line();
+        if(base) {
+            queue_response(base + start, end - start + 1);
+            return true;
+        }
+        // 和200一样，这一段文件由write中的sendfile发送，这个响应只能是这一批的最后一个
+        File_Entry * file = m_file;
+        queue_response(NULL, 0);
+        m_sendfile = file;
+        m_file_offset = start;
+        m_file_remaining = end - start + 1;
+        m_bytes_to_send += m_file_remaining;
+        return true;
+    }
+
+    // multipart/byteranges，每一部分前面是分隔符和这一部分的Content-Type、Content-Range
+    char boundary[32];
+    snprintf(boundary, sizeof(boundary), "%016lx", (unsigned long)(m_file_stat.st_ino * 0x9e3779b97f4a7c15UL) ^ ++boundary_seq);
+    const char * part_format = "\r\n--%s\r\nContent-Type:%s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n";
+    const char * tail_format = "\r\n--%s--\r\n";
+    long total = snprintf(NULL, 0, tail_format, boundary);
+    for(int i = 0; i < m_range_count; i++) {
+        total += snprintf(NULL, 0, part_format, boundary, m_file->mime, (long)m_ranges[i].start, (long)m_ranges[i].end, size);
+        total += m_ranges[i].end - m_ranges[i].start + 1;
+    }
+    add_response( "Content-Length: %ld\r\nContent-Type: multipart/byteranges; boundary=%s\r\n", total, boundary );
+    add_bytes( m_file->common_headers.data(), m_file->common_headers.size() );
+    add_date();
+    add_linger();
+    add_blank_line();
+    for(int i = 0; i < m_range_count; i++) {
+        if(!add_response( part_format, boundary, m_file->mime, (long)m_ranges[i].start, (long)m_ranges[i].end, size )) {
+            return false;
+        }
+        queue_iov(base + m_ranges[i].start, m_ranges[i].end - m_ranges[i].start + 1);
+    }
+    add_response( tail_format, boundary );
+    queue_response(NULL, 0);
+    return true;
+}
+
+// 把写缓冲区中从m_response_start开始新生成的数据和一块响应体加入到iovec中
+void http_conn::queue_iov(char * body, long body_len) {
+    // 没有响应体的响应（比如错误页面）的头部和下一个响应的头部在写缓冲区中是相邻的，合并成一块
+    char * head = m_write_buf + m_response_start;
+    int head_len = m_write_index - m_response_start;
+    if(head_len == 0) {
+        // HTTP/2连续的两个DATA帧之间没有新写入的数据
+    } else if(m_iv_count > 0 && (char *)m_iv[m_iv_count - 1].iov_base + m_iv[m_iv_count - 1].iov_len == head) {
+        m_iv[m_iv_count - 1].iov_len += head_len;
+    } else {
+        m_iv[m_iv_count].iov_base = head;
+        m_iv[m_iv_count].iov_len = head_len;
+        m_iv_count++;
+    }
+    if(body && body_len > 0) {
+        m_iv[m_iv_count].iov_base = body;
+        m_iv[m_iv_count].iov_len = body_len;
+        m_iv_count++;
+    }
+    m_bytes_to_send += head_len + body_len;
+    m_response_start = m_write_index;
+}
+
+// 把写缓冲区中刚生成的响应头和响应体加入到这一批响应的iovec中
+// 响应体所在的文件的所有权也转移到这一批响应中，整批发送完后一起释放
+void http_conn::queue_response(char * body, long body_len) {
+    queue_iov(body, body_len);
+    m_response_count++;
+
+    if(m_file || m_gzip || m_file_address) {
+        Response_Body & rb = m_bodies[m_body_count++];
+        rb.file = m_file;
+        rb.gzip = m_gzip;
+        rb.address = m_file_address;
+        rb.length = m_file_stat.st_size;
+        m_file = NULL;
+        m_gzip = NULL;
+        m_file_address = 0;
+    }
+    // 整批响应发送完后是否保持连接，由最后一个请求决定
+    m_keep_alive = m_linger;
+}
+
+// Upgrade: h2c（可能和其他协议一起列出），HTTP2-Settings是必须的
+bool http_conn::wants_h2c() const {
+    if(!has_header(HEADER_UPGRADE) || !has_header(HEADER_HTTP2_SETTINGS)) {
+        return false;
+    }
+    string_view list = header(HEADER_UPGRADE);
+    while(!list.empty()) {
+        size_t skip = list.find_first_not_of(" \t,");
+        if(skip == string_view::npos) {
+            break;
+        }
+        list.remove_prefix(skip);
+        size_t end = list.find_first_of(" \t,");
+        string_view token = list.substr(0, end);
+        if(token.size() == 3 && strncasecmp(token.data(), "h2c", 3) == 0) {
+            return true;
+        }
+        list.remove_prefix(token.size());
+    }
+    return false;
+}
+
+// 一个请求处理完毕，把读缓冲区中剩下的（流水线中后续请求的）数据移动到开头，准备解析下一个请求
+void http_conn::finish_request() {
+    int left = m_read_index - m_checked_index;
+    if(left > 0) {
+        memmove(m_read_buf, m_read_buf + m_checked_index, left);
+    }
+    m_read_index = left;
+    init_request();
+}
+
+// 解析HTTP请求并生成响应，返回false表示连接需要关闭
+// 流水线：一次把读缓冲区中所有完整的请求都解析掉，响应追加到同一批里，最后一起发送
+bool http_conn::process_request() {
+    // TLS握手还没有完成，等待握手需要的事件
+    if(m_ssl && !m_tls_ready) {
+        modifyfd(m_epfd, m_sockfd, m_tls_want_write ? EPOLLOUT : EPOLLIN, m_trig_mode);
+        return true;
+    }
+    // 以连接前言开头的是直接使用HTTP/2的客户端（prior knowledge）
+    if(!m_h2) {
+        int preface = H2_Session::match_preface(m_read_buf, m_read_index);
+        if(preface > 0) {
+            m_h2 = new H2_Session(this);
+        } else if(preface == 0) {
+            modifyfd(m_epfd, m_sockfd, EPOLLIN, m_trig_mode);
+            return true;
+        }
+    }
+    if(m_h2) {
+        if(!m_h2->process(false)) {
+            return false;
+        }
+        if(m_write_index == 0) {
+            // 读缓冲区满到上限还放不下一个完整的帧
+            if(m_read_index >= m_buffer_max) {
+                return false;
+            }
+            arm(EPOLLIN);
+        }
+        return true;
+    }
+
+    while(true) {
+        // 1.解析HTTP请求
+        HTTP_CODE read_ret = process_read();
+        if(read_ret == NO_REQUEST) {
+            // 读缓冲区已经满到上限，请求行或者请求头还不完整，请求太大了
+            if(m_response_count == 0 && m_read_index >= m_buffer_max) {
+                return false;
+            }
+            break;
+        }
+
+        // 这一批的第一个请求要求升级到h2c：发送101，这个请求的响应在流1上发送，后面的数据都是HTTP/2的帧
+        if(m_response_count == 0 && read_ret != BAD_REQUEST && read_ret != CONTENT_TOO_LARGE && wants_h2c()) {
+            add_bytes("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+            m_h2 = new H2_Session(this);
+            if(!m_h2->upgrade(header(HEADER_HTTP2_SETTINGS), read_ret)) {
+                return false;
+            }
+            finish_request();
+            return m_h2->process(false);
+        }
+
+        // 2.生成响应(数据准备好写出去)
+        int iv_count = m_iv_count;
+        if(!process_write(read_ret)) {
+            return false;
+        }
+        finish_request();
+
+        // 连接要关闭、最后一个响应要sendfile或者是流式响应、刚生成了一个multipart响应、或者这一批已经放不下了，就先发送，剩下的请求发送完再处理
+        if(!m_keep_alive || m_sendfile || m_stream || m_iv_count - iv_count > 2 || m_response_count >= MAX_PIPELINE
+           || m_write_index > WRITE_BUFFER_SIZE - PIPELINE_RESERVE) {
+            break;
+        }
+    }
+    if(!has_response()) {
+        // 如果请求不完整
+        modifyfd(m_epfd, m_sockfd, EPOLLIN, m_trig_mode); // 继续再获取该文件描述符的数据
+    }
     return true;
 }
 
 // 由线程池的工作线程调用，这是处理HTTP请求的入口函数
 void http_conn::process() {
-    // 这里要解析HTTP请求，然后生成响应
-    // 1.解析HTTP请求
-    HTTP_CODE read_ret = process_read();
-    if(read_ret == NO_REQUEST) {
-        // 如果请求不完整
-        modifyfd(m_epfd, m_sockfd, EPOLLIN); // 继续再获取该文件描述符的数据
+    if(m_actor_mode == 1) {
+        // Proactor：事件循环线程已经把数据读好了，工作线程只负责处理请求
+        // 写事件添加后，由事件循环线程把响应写出去
+        if(!process_request()) {
+            shutdown_conn();
+            return;
+        }
+        if(has_response()) {
+            modifyfd(m_epfd, m_sockfd, EPOLLOUT, m_trig_mode);
+        }
         return;
     }
 
-    // 2.生成响应(数据准备好写出去)
-    //printf("开始生成响应...\n");
-    bool write_ret = process_write(read_ret);
-    if(!write_ret) {
-        close_conn();
+    // Reactor：事件循环线程只负责通知，读写都在工作线程中完成
+    bool parse = (m_state == 0);
+    if(parse && !read()) {
+        shutdown_conn();
+        return;
+    }
+    while(true) {
+        if(parse) {
+            if(!process_request()) {
+                shutdown_conn();
+                return;
+            }
+            // 请求不完整，已经重新注册了EPOLLIN
+            if(!has_response()) {
+                return;
+            }
+        }
+        // 直接尝试写，写不完（EAGAIN）时write会注册EPOLLOUT，下次由事件循环再派发一个写任务
+        if(!write()) {
+            shutdown_conn();
+            return;
+        }
+        // 这一批响应发送完了，读缓冲区里还有流水线请求，接着处理
+        if(!has_pipelined()) {
+            return;
+        }
+        parse = true;
     }
-    // 写成功后，将文件描述符写事件添加
-    modifyfd(m_epfd, m_sockfd, EPOLLOUT);
 }
@@ -13,29 +13,55 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/uio.h>
+#include <atomic>
+#include <vector>
 
+#include "../cache/file_cache.h"
+#include "../cache/gzip_cache.h"
+#include "../buffer/buffer_pool.h"
+#include "tokenizer.h"
+#include "header_table.h"
+#include "header_builder.h"
+#include "stream_source.h"
+#include "../timer/coarse_clock.h"
+#include "../tls/tls_context.h"
 using namespace std;
 
+// 网站资源的根目录
+extern const char * doc_root;
+
+class H2_Session;
+struct Route_Params;
+struct Hpack_Field;
+
 /**
  * 工作任务类（请求类）
  * 这个类是线程主要处理的工作，保存了一个请求信息
 */
 class http_conn {
+    // HTTP/2会话直接使用连接的读写缓冲区、iovec和请求状态
+    friend class H2_Session;
 public:
-    // socket共有的一个epollfd，只有一个红黑树
-    static int m_epfd;
-    // 所有用户连接的数量
-    static int m_user_cout;
-    // 读缓冲区的固定大小
+    // 所有用户连接的数量（多个事件循环线程同时修改，所以是原子的）
+    static atomic<int> m_user_cout;
+    // 读写缓冲区的上限（可配置），请求头或请求体超过这个大小就断开连接
+    static int m_buffer_max;
+    // 读缓冲区的初始大小
     static const int READ_BUFFER_SIZE = 2048;
-    // 写缓冲区的固定大小
+    // 写缓冲区的初始大小
     static const int WRITE_BUFFER_SIZE = 1024;
-    // 文件名的最大长度
-    static const int MAX_FILENAME = 200;
+    // 流水线中一批最多合并发送多少个响应
+    static const int MAX_PIPELINE = 16;
+    // 这一批的响应头超过WRITE_BUFFER_SIZE - PIPELINE_RESERVE时，不再往这一批里追加响应（一个响应头或错误页面不会超过这个大小）
+    static const int PIPELINE_RESERVE = 512;
+    // 一个请求最多支持多少个范围，超过就忽略Range发送整个文件
+    static const int MAX_RANGES = 8;
+    // 流式响应每一块的缓冲区大小（包括chunked编码的长度行和结尾的\r\n）
+    static const int STREAM_CHUNK_SIZE = 16 * 1024;
 
 public:
     // 定义一些状态
-    // HTTP请求方法，这里只支持GET
+    // HTTP请求方法，都能识别，静态文件只支持GET和HEAD（其他方法返回405）
     enum METHOD {GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT};
     
     /*
@@ -61,8 +87,20 @@ public:
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        METHOD_NOT_ALLOWED  :   表示请求方法不支持
+        NOT_MODIFIED        :   表示客户端缓存的文件没有被修改（条件请求）
+        PARTIAL_CONTENT     :   文件请求，只发送Range中的范围
+        RANGE_NOT_SATISFIABLE : 表示Range中没有一个范围在文件内
+        STREAM_REQUEST      :   动态内容，已经调用start_stream设置了数据源，用chunked编码发送
+        BAD_GATEWAY         :   表示上游服务器不可用或者返回了无效的响应（反向代理）
+        CONTENT_TOO_LARGE   :   表示请求体超过了读缓冲区的上限
     */
-    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION };
+    enum HTTP_CODE { NO_REQUEST, GET_REQUEST, BAD_REQUEST, NO_RESOURCE, FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION,
+                     METHOD_NOT_ALLOWED, NOT_MODIFIED, PARTIAL_CONTENT, RANGE_NOT_SATISFIABLE, STREAM_REQUEST, BAD_GATEWAY,
+                     CONTENT_TOO_LARGE };
+
+    // 等待集合就绪时，事件循环的epoll中data的高32位是这个标记，低32位是连接的fd
+    static const uint64_t PARK_EVENT = 1ULL << 32;
 
 public:
     // 构造函数
@@ -73,61 +111,185 @@ public:
 public:
     // 用于处理（响应）客户端的请求（这个就是直接放这个请求要做什么事情的）
     void process(); 
-    // 初始化新接收的连接
-    void init(int sockfd, const sockaddr_in &addr);
+    // 初始化新接收的连接，epfd为接收该连接的事件循环的epoll树，trig_mode为通信文件描述符的触发模式
+    // actor_mode为事件处理模式 0:Reactor 1:Proactor
+    void init(int sockfd, const sockaddr_in &addr, int epfd, int trig_mode, int actor_mode);
     // 关闭连接
     void close_conn();
+    // 工作线程中关闭连接：只shutdown并重新注册事件，由事件循环收到EPOLLHUP后真正关闭并删除定时器
+    void shutdown_conn();
     // 非阻塞的从文件描述符缓冲区读数据
     bool read();
     // 非阻塞向文件描述符写缓冲区写数据
     bool write();
+
+    // ------ 给io_uring后端使用的接口（读写由io_uring完成，这里只管缓冲区） ------
+    // 把内核放到provided buffer里的数据追加到读缓冲区
+    bool read_from(const char * buf, int len);
+    // 是否已经生成了待发送的响应（流式响应的响应头可能还在等数据源）
+    bool has_response() const { return m_write_index > 0 || m_stream != NULL; }
+    // 响应发送完后是否保持连接
+    bool is_linger() const { return m_keep_alive; }
+    // 响应已经发送完毕，读缓冲区中还有流水线请求等待处理
+    bool has_pipelined() const { return m_bytes_to_send == 0 && m_write_index == 0 && m_read_index > 0 && m_stream == NULL; }
+    // 待发送的iovec
+    struct iovec * get_write_iov(int & iov_count) { iov_count = m_iv_count; return m_iv; }
+    // 已经发送了bytes字节，调整iovec，全部发送完返回true
+    bool advance_write(int bytes);
+    // 响应发送完毕，keep-alive返回true并准备下一批响应，否则返回false
+    bool finish_write();
+    // 流式响应还没有发送完，或者HTTP/2连接上还有可以发送的数据（iovec发送完后要调用refill取下一块/下一批）
+    bool streaming() const;
+    // 从流式响应的数据源取下一块放到iovec中（HTTP/2连接调度下一批），出错返回false
+    bool refill();
+    // 处理函数生成流式响应：设置数据源（连接负责释放）和Content-Type，然后返回STREAM_REQUEST
+    // mime为NULL表示Content-Type由数据源的head提供
+    void start_stream(Stream_Source * source, const char * mime);
+
+    // ------ 等待数据源（比如上游服务器的socket） ------
+    // 每个连接有一个按需创建的epoll作为等待集合，数据源返回AGAIN时把它的fd加进来；
+    // 连接没有数据可以发送时，把客户端的fd也加进来，再把这个epoll本身（EPOLLONESHOT）注册到事件循环上，
+    // 这样一个连接在事件循环里始终只有一个注册的fd，EPOLLONESHOT保证的串行处理不变
+    // 数据源返回了AGAIN，把它的fd加入等待集合，失败返回false
+    bool wait_source(Stream_Source * source);
+    // 是否有数据源在等待
+    bool is_waiting() const { return m_waiting; }
+    // 等待集合的epoll（io_uring后端用poll等待它可读）
+    int park_fd() const { return m_park_fd; }
+    // 等待集合就绪后由事件循环调用：所有数据源都重新尝试，返回客户端fd上就绪的事件（epoll后端）
+    int unpark();
+    // 客户端地址（io_uring后端接收连接时没有取地址，第一次使用时再取）
+    const sockaddr_in & get_address();
+    // 是否是HTTPS连接
+    bool is_tls() const { return m_ssl != NULL; }
+    // 解析读缓冲区中所有完整的HTTP请求并生成一批响应
+    bool process_request();
     // 解析HTTP请求
     HTTP_CODE process_read();
-    // 解析具体的信息
+    // 按路由表把请求分派给处理函数
     HTTP_CODE do_request();
+    // 静态文件处理函数（挂在路由表的/*path上）
+    static HTTP_CODE file_handler(http_conn * conn, const Route_Params & params, void * arg);
+    // 把URL映射到doc_root下的文件
+    HTTP_CODE serve_file();
     // 解析请求首行 - 解析请求分开写
     HTTP_CODE parse_request_line(char * text);
     // 解析请求头
     HTTP_CODE parse_headers(char * text);
     // 解析请求体
     HTTP_CODE parse_content(char * text);
+    // 解析Accept-Encoding头部
+    static int parse_accept_encoding(const char * text);
+    // 严格解析Content-Length的值：只能是十进制数字且不超过max，否则返回false
+    static bool parse_content_length(const char * text, long int max, long int & length);
+    // If-None-Match的值中是否有和etag匹配的（弱比较）
+    static bool etag_match(string_view list, const string & etag);
+    // 根据If-None-Match和If-Modified-Since判断客户端缓存的文件是否还有效
+    bool not_modified(const string & etag, time_t mtime);
+    // 根据If-Range判断Range是否还适用于当前的文件
+    bool if_range_match(File_Entry * entry);
+    // 解析Range头部，结果保存在m_ranges中
+    HTTP_CODE parse_range(off_t size);
     // 解析具体的某一行 - 从状态机 - 根据\n获取的
     LINE_STATUS parse_line();
+    // 获取当前请求中的某个头部的值，请求中没有这个头部返回空
+    string_view header(HEADER id) const { return has_header(id) ? m_headers[id] : string_view(); }
+    bool has_header(HEADER id) const { return m_header_mask & (1ULL << id); }
+    // 给处理函数使用的请求信息
+    METHOD get_method() const { return m_method; }
+    const char * get_url() const { return m_url; }
+    // 请求体（处理函数返回之前有效）
+    string_view content() const { return string_view(m_content, m_content_length); }
+    // 请求中的所有头部，包括头部表中没有的和重复出现的（处理函数返回之前有效），两者只有一个不为空：
+    // HTTP/1.1是读缓冲区中原样的头部行，行尾的\r\n（还有头部表中的头部的值末尾的空白）已经被改成了\0
+    // HTTP/2是解码出来的头部字段（包括伪头部），名字都是小写的
+    string_view header_block() const { return string_view(m_read_buf + m_header_start, m_header_end - m_header_start); }
+    const vector<Hpack_Field> * h2_fields() const { return m_h2_fields; }
     // 获取一行数据（因为你读到\n就不读了）
     char * get_line(){ return m_read_buf + m_start_line; }
-    // 释放内存映射
+    // 释放当前请求和这一批响应占用的文件
     void unmap();
+    // HTTPS端口接收的连接：创建SSL对象，握手在读写事件中非阻塞地完成
+    bool start_tls();
+    // 结束HTTP/2会话、释放TLS会话（连接关闭时调用）
+    void release_session();
+    // 把读写缓冲区还给缓冲区池（连接关闭时调用）
+    void release_buffers();
     // 响应HTTP请求
     bool process_write(HTTP_CODE ret);
     // 添加响应首行
     bool add_status_line(int status, const char * title);
     // 往缓冲区写入数据
     bool add_response(const char * format, ...);
+    // 往缓冲区写入预先生成好的数据（文件缓存里的响应头、常用的头部）
+    bool add_bytes(const char * data, int len);
+    bool add_bytes(string_view data) { return add_bytes(data.data(), data.size()); }
+    // 往缓冲区写入 name + 十进制数 + suffix
+    bool add_number(string_view name, unsigned long value, string_view suffix = Header_Builder::CRLF);
     // 响应体
     bool add_content( const char* content );
     bool add_content_type();
-    bool add_headers( int content_length );
-    bool add_content_length( int content_length );
+    bool add_headers( long content_length );
+    bool add_content_length( long content_length );
     bool add_linger();
+    bool add_date();
     bool add_blank_line();
+    bool add_content_range(long start, long end, long size);
+    // 把刚生成的响应加入到这一批响应中
+    void queue_response(char * body, long body_len);
+    // 把写缓冲区中刚生成的数据和一块响应体加入到iovec中（multipart响应的每一部分）
+    void queue_iov(char * body, long body_len);
+    // 生成206响应（单个范围或multipart/byteranges）
+    bool add_partial_content();
+    // 生成流式响应的响应头，数据源还没有准备好返回AGAIN，失败返回-1（这两种情况都不写入任何数据）
+    int add_stream_head();
+    // 一个请求处理完毕，准备解析流水线中的下一个请求
+    void finish_request();
+    // 请求中是否带了Upgrade: h2c和HTTP2-Settings
+    bool wants_h2c() const;
+    // 代价提示（取值见threadpool.h的TASK_CLASS），处理函数按这个请求要做的事情设置
+    // 同一个连接上的请求通常是同一类，这个连接下一次交给线程池的任务按它放进对应类别的队列
+    void set_cost_hint(int cls) { m_cost_hint = cls; }
+    int cost_hint() const { return m_cost_hint; }
 
+public:
+    // Reactor模式下交给工作线程的任务类型 0:读 1:写
+    int m_state;
+    // 交给线程池还没有执行完的任务数，不为0时工作线程可能正在使用这个连接，定时器到期也不能关闭
+    // 事件循环派发前加一，任务结束时减一；init不重置，fd被复用时旧任务的减一仍然要算数
+    atomic<int> m_tasks;
+
+private:
+    // 代价提示，每个请求路由之前重置为TASK_NORMAL
+    int m_cost_hint;
 
 private:
     // HTTP连接的Socket，该请求用于通信的
     int m_sockfd;
 
+    // 该连接所属事件循环的epoll树（每个事件循环一棵红黑树）
+    int m_epfd;
+
+    // 通信文件描述符的触发模式 0:LT 1:ET
+    int m_trig_mode;
+
+    // 事件处理模式 0:Reactor（工作线程读写） 1:Proactor（事件循环线程读写）
+    int m_actor_mode;
+
     // socket通信地址，存放发送请求端的
     sockaddr_in m_addr;
 
-    // 读缓冲区
-    char m_read_buf[READ_BUFFER_SIZE];
+    // 读缓冲区，有数据要读的时候才从缓冲区池借，可以扩容到m_buffer_max
+    char * m_read_buf;
+    int m_read_buf_size;
 
     // 标识读缓冲区中读入的客户端数据的最后一个字节的下一个位置
     // 比如一次读取不完，那么第二次读取就从下一个位置开始读取
     int m_read_index;
 
-    // 写缓冲区
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    // 写缓冲区，生成响应的时候才从缓冲区池借，发送完就还回去
+    char * m_write_buf;
+    int m_write_buf_size;
 
     int m_write_index; // 写缓冲区中待发送的字节数
 
@@ -137,27 +299,113 @@ private:
     // 当前正在解析行的起始位置
     int m_start_line;
 
+    // 当前正在解析行的结束位置（行尾的\0）
+    char * m_line_end;
+
     // 请求体的长度
     long int m_content_length;
+    // 请求体的起始位置：HTTP/1.1在读缓冲区中，HTTP/2在流收到的DATA里
+    const char * m_content;
 
     char * m_url; // 请求目标文件的文件名
     char * m_version; // 协议版本，只支持HTTP1.1
     METHOD m_method; // 请求版本
-    char * m_host; // 主机名
+    // 能识别的头部的值（指向读缓冲区），按HEADER下标存放，m_header_mask标记这个请求中出现了哪些
+    string_view m_headers[HEADER_COUNT];
+    uint64_t m_header_mask;
+    int m_header_start; // 头部行在读缓冲区中的范围（HTTP/1.1），读缓冲区扩容后不变
+    int m_header_end;
+    const vector<Hpack_Field> * m_h2_fields; // HTTP/2请求的头部字段，HTTP/1.1为NULL
+    const char * m_allow; // 405响应的Allow头部（路由表中这个路径支持的方法）
     bool m_linger; // http请求是否要保持连接
+    int m_accept_encoding; // 客户端接受的内容编码（CONTENT_ENCODING按位或）
 
-    char m_real_file[MAX_FILENAME]; // 请求的资源的url
+    File_Entry * m_file; // 从文件缓存中获取的目标文件，发送完毕后释放引用
+    Gzip_Entry * m_gzip; // 在线压缩的结果，NULL表示发送原文件
     struct stat m_file_stat; // 当前文件的状态
-    char * m_file_address; // 客户请求的目标文件被mmap到内存中的起始位置
+    char * m_file_address; // 客户请求的目标文件被mmap到内存中的起始位置（只有io_uring后端发送大文件时使用）
+
+    // epoll后端用sendfile发送文件内容，不再mmap
+    bool m_use_sendfile;    // 是否使用sendfile发送文件
+    off_t m_file_offset;    // 文件下一次从哪里开始发送
+    off_t m_file_remaining; // 文件还剩多少字节没有发送
+    long m_bytes_to_send;   // 整个响应（响应头+文件）还剩多少字节没有发送
 
     // 主状态机当前所处的状态
     CHECK_STATE m_checked_state;
 
     // 对其他的数据（和状态机相关的数据）进行初始化
     void init();
+    // 初始化解析一个请求的状态
+    void init_request();
+    // 初始化一批响应的状态
+    void init_response();
+    // 继续TLS握手，出错返回false；完成后检查是否切换到了kTLS
+    bool tls_handshake();
+    // 没有kTLS接收时，用SSL_read读到没有数据为止
+    bool tls_read();
+    // 没有kTLS发送时，用SSL_write代替sendmsg，返回值和errno的语义和sendmsg一致
+    int tls_writev(struct iovec * iv, int count);
+    // 等待客户端的事件：有数据源在等待时连同等待集合一起注册，否则直接注册客户端的fd
+    void arm(int ev);
+    void park(int ev);
+    // 读写缓冲区扩容到至少need字节
+    bool grow_read_buf(int need);
+    bool grow_write_buf(int need);
 
-    struct iovec m_iv[2];                   // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
+    // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
+    // 普通响应最多两块（响应头、响应体），multipart响应每个范围两块再加结尾，一批中最多有一个multipart响应
+    struct iovec m_iv[2 * MAX_PIPELINE + 2 * MAX_RANGES + 1];
     int m_iv_count;
+
+    // 一批响应中每个响应体占用的文件，整批发送完后一起释放
+    struct Response_Body {
+        File_Entry * file;
+        Gzip_Entry * gzip;
+        char * address;
+        long length;
+    };
+    Response_Body m_bodies[MAX_PIPELINE];
+    int m_body_count;
+    int m_response_start;   // 当前响应在写缓冲区中的起始位置
+    int m_response_count;   // 这一批中响应的数量
+    bool m_keep_alive;      // 这一批响应发送完后是否保持连接（由最后一个请求决定）
+    File_Entry * m_sendfile; // 这一批最后一个响应用sendfile发送的文件，NULL表示没有
+
+    // Range请求中的范围（闭区间）
+    struct Byte_Range {
+        off_t start;
+        off_t end;
+    };
+    Byte_Range m_ranges[MAX_RANGES];
+    int m_range_count;
+
+    // 流式响应的数据源，NULL表示没有或者已经发送完最后一块
+    Stream_Source * m_stream;
+    const char * m_stream_mime;
+    bool m_stream_head_pending; // 响应头还在等数据源，这时写缓冲区中没有这个响应的任何数据
+    bool m_stream_chunked;      // 响应体用chunked编码（数据源不知道长度），否则按Content-Length原样发送
+    METHOD m_stream_method;     // 响应头推迟生成时，请求已经被下一个请求覆盖了，这两个要单独保存
+    bool m_stream_linger;
+    // 流式响应当前这一块的缓冲区，从缓冲区池借，响应发送完后还回去
+    char * m_chunk_buf;
+    int m_chunk_buf_size;
+
+    // 收到连接前言或者升级之后，连接由HTTP/2会话处理，NULL表示HTTP/1.1
+    H2_Session * m_h2;
+
+    // 等待集合（epoll），-1表示还没有创建
+    int m_park_fd;
+    // 有数据源返回了AGAIN，还没有被唤醒
+    bool m_waiting;
+
+    // HTTPS连接的TLS会话，NULL表示明文连接
+    SSL * m_ssl;
+    bool m_tls_ready;       // 握手已经完成
+    bool m_tls_want_write;  // 握手在等待socket可写
+    // 握手后内核接管了加密/解密（kTLS），这个方向直接用recv/sendmsg/sendfile，文件内容仍然零拷贝
+    bool m_ktls_send;
+    bool m_ktls_recv;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,715 @@
+#include "proxy.h"
+#include "hpack.h"
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <ctype.h>
+#include <algorithm>
+
+// 不转发的请求头：逐跳头部、HTTP/2升级、由代理重新生成的头部
+static bool skip_request_header(int id) {
+    switch(id) {
+        case HEADER_CONNECTION:
+        case HEADER_KEEP_ALIVE:
+        case HEADER_TE:
+        case HEADER_TRAILER:
+        case HEADER_TRANSFER_ENCODING:
+        case HEADER_UPGRADE:
+        case HEADER_HTTP2_SETTINGS:
+        case HEADER_EXPECT:
+        case HEADER_CONTENT_LENGTH:
+        case HEADER_HOST:
+        case HEADER_X_FORWARDED_FOR:
+        case HEADER_X_FORWARDED_PROTO:
+        case HEADER_X_REAL_IP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 不转发给客户端的响应头（名字已经是小写的）：逐跳头部，以及由连接重新生成的长度和Date
+static bool skip_response_header(string_view name) {
+    static const string_view names[] = {
+        "connection", "keep-alive", "proxy-connection", "te", "trailer", "transfer-encoding", "upgrade",
+        "content-length", "date",
+    };
+    for(string_view n : names) {
+        if(n == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 逗号分隔的列表中是否有token（忽略大小写）
+static bool has_token(string_view list, string_view token) {
+    size_t len = token.size();
+    while(!list.empty()) {
+        size_t skip = list.find_first_not_of(" \t,");
+        if(skip == string_view::npos) {
+            break;
+        }
+        list.remove_prefix(skip);
+        size_t end = list.find_first_of(" \t,;");
+        string_view item = list.substr(0, end);
+        if(item.size() == len && strncasecmp(item.data(), token.data(), len) == 0) {
+            return true;
+        }
+        list.remove_prefix(item.size());
+        if(!list.empty() && list[0] == ';') {
+            // 参数（比如 chunked;q=1）跳到下一个逗号
+            size_t comma = list.find(',');
+            list.remove_prefix(comma == string_view::npos ? list.size() : comma);
+        }
+    }
+    return false;
+}
+
+// ------------------------------ Upstream_Group ------------------------------
+
+Upstream::~Upstream() {
+    for(Idle_Conn & c : idle) {
+        close(c.fd);
+    }
+}
+
+Upstream_Group::~Upstream_Group() {
+    for(Upstream * up : m_upstreams) {
+        delete up;
+    }
+}
+
+Upstream * Upstream_Group::select() {
+    time_t now = Coarse_Clock::now();
+    size_t n = m_upstreams.size();
+    unsigned start = m_next++;
+    Upstream * best = NULL;
+    for(size_t i = 0; i < n; i++) {
+        Upstream * up = m_upstreams[(start + i) % n];
+        if(up->down_until.load(memory_order_relaxed) > now) {
+            continue;
+        }
+        if(m_policy == PROXY_ROUND_ROBIN) {
+            best = up;
+            break;
+        }
+        // 最少连接：从轮询的位置开始找，连接数相同时轮流选择
+        if(!best || up->active.load(memory_order_relaxed) < best->active.load(memory_order_relaxed)) {
+            best = up;
+        }
+    }
+    if(!best) {
+        // 所有上游最近都失败过，还是按顺序试一个（可能已经恢复了）
+        best = m_upstreams[start % n];
+    }
+    best->active++;
+    return best;
+}
+
+// ------------------------------ Proxy_Source ------------------------------
+
+Proxy_Source::Proxy_Source(Upstream_Group * group, string & request, int method)
+    : m_group(group), m_upstream(NULL), m_fd(-1), m_reused(false), m_tries(0),
+      m_idempotent(method != http_conn::POST), m_head_only(method == http_conn::HEAD),
+      m_state(SENDING), m_sent(0), m_received(false), m_buf(NULL), m_buf_size(0), m_start(0), m_end(0),
+      m_status(0), m_content_length(Stream_Head::UNKNOWN_LENGTH), m_keep_alive(false),
+      m_body_mode(BODY_UNTIL_CLOSE), m_remaining(0), m_chunk_state(CHUNK_SIZE) {
+    m_request.swap(request);
+}
+
+Proxy_Source::~Proxy_Source() {
+    // 响应完整地读完了、上游没有要求关闭、也没有多余的数据，连接还能复用
+    release_conn(m_state == DONE && m_keep_alive && m_start == m_end);
+    Buffer_Pool::release(m_buf, m_buf_size);
+}
+
+int Proxy_Source::wait_events() const {
+    return (m_state == SENDING) ? EPOLLOUT : EPOLLIN;
+}
+
+void Proxy_Source::release_conn(bool reuse) {
+    if(m_fd != -1) {
+        // 连接可能还在客户端连接的等待集合里，放回连接池之前要删掉（关闭的fd会自动删除）
+        if(wait_epfd != -1) {
+            epoll_ctl(wait_epfd, EPOLL_CTL_DEL, m_fd, NULL);
+        }
+        if(reuse) {
+            Proxy::put_idle(m_upstream, m_fd);
+        } else {
+            close(m_fd);
+        }
+        m_fd = -1;
+    }
+    if(m_upstream) {
+        m_upstream->active--;
+        m_upstream = NULL;
+    }
+}
+
+bool Proxy_Source::connect_upstream() {
+    m_tries++;
+    m_upstream = m_group->select();
+    m_state = SENDING;
+    m_sent = 0;
+    m_start = m_end = 0;
+    m_fd = Proxy::take_idle(m_upstream);
+    m_reused = (m_fd != -1);
+    if(m_reused) {
+        return true;
+    }
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(m_fd < 0) {
+        return false;
+    }
+    // 请求和响应都是一次写完的小块，不等待Nagle合并
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // 非阻塞connect，连接完成（或失败）后socket可写，结果在send的时候得到
+    if(connect(m_fd, (struct sockaddr *)&m_upstream->addr, sizeof(m_upstream->addr)) < 0 && errno != EINPROGRESS) {
+        m_upstream->down_until = Coarse_Clock::now() + PROXY_FAIL_TIMEOUT;
+        return false;
+    }
+    return true;
+}
+
+bool Proxy_Source::retry() {
+    // 响应已经开始了，或者非幂等的请求已经完整地发出去了（上游可能已经处理了，不管连接是不是复用的）
+    if(m_received || (m_sent == m_request.size() && !m_idempotent)) {
+        return false;
+    }
+    if(m_upstream && !m_reused) {
+        // 新建的连接失败了，说明这个上游暂时不可用
+        m_upstream->down_until = Coarse_Clock::now() + PROXY_FAIL_TIMEOUT;
+    }
+    release_conn(false);
+    // 每个上游最多试一次，再加上一次复用连接失效后的重试
+    while(m_tries <= (int)m_group->size()) {
+        if(connect_upstream()) {
+            return true;
+        }
+        release_conn(false);
+    }
+    return false;
+}
+
+int Proxy_Source::head(Stream_Head * head) {
+    if(m_fd == -1 && m_state == SENDING && !connect_upstream() && !retry()) {
+        return -1;
+    }
+    while(m_state == SENDING || m_state == READING_HEAD) {
+        int ret = (m_state == SENDING) ? send_request() : read_head();
+        if(ret == AGAIN) {
+            return AGAIN;
+        }
+        if(ret < 0 && !retry()) {
+            return -1;
+        }
+    }
+    head->status = m_status;
+    head->reason = m_reason.c_str();
+    head->headers = m_headers;
+    head->content_length = m_content_length;
+    return 0;
+}
+
+int Proxy_Source::send_request() {
+    while(m_sent < m_request.size()) {
+        ssize_t n = send(m_fd, m_request.data() + m_sent, m_request.size() - m_sent, MSG_NOSIGNAL);
+        if(n < 0) {
+            // 连接还没有建立完成时send也返回EAGAIN
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? AGAIN : -1;
+        }
+        m_sent += n;
+    }
+    if(!m_buf) {
+        m_buf = Buffer_Pool::acquire(PROXY_BUFFER_SIZE, &m_buf_size);
+    }
+    m_state = READING_HEAD;
+    return 0;
+}
+
+int Proxy_Source::recv_more() {
+    if(m_start > 0) {
+        memmove(m_buf, m_buf + m_start, m_end - m_start);
+        m_end -= m_start;
+        m_start = 0;
+    }
+    if(m_end == m_buf_size) {
+        // 响应头或者chunked的一行太长了
+        return -1;
+    }
+    ssize_t n = recv(m_fd, m_buf + m_end, m_buf_size - m_end, 0);
+    if(n > 0) {
+        m_end += n;
+        m_received = true;
+        return n;
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return AGAIN;
+    }
+    // 上游关闭了连接
+    return -1;
+}
+
+int Proxy_Source::read_head() {
+    while(true) {
+        int ret = parse_head();
+        if(ret != AGAIN) {
+            if(ret < 0) {
+                // 无效的响应不重试
+                m_received = true;
+            }
+            return ret;
+        }
+        ret = recv_more();
+        if(ret < 0) {
+            return ret;
+        }
+    }
+}
+
+int Proxy_Source::parse_head() {
+    while(true) {
+        const char * begin = m_buf + m_start;
+        const char * end = (const char *)memmem(begin, m_end - m_start, "\r\n\r\n", 4);
+        if(!end) {
+            return AGAIN;
+        }
+        string_view block(begin, end - begin + 2);
+        m_start = end + 4 - m_buf;
+
+        // 状态行 HTTP/1.x 200 OK
+        size_t eol = block.find("\r\n");
+        string_view line = block.substr(0, eol);
+        if(line.size() < 12 || line.compare(0, 7, "HTTP/1.") != 0 || line[8] != ' ') {
+            return -1;
+        }
+        bool http11 = (line[7] == '1');
+        int status = 0;
+        for(int i = 9; i < 12; i++) {
+            if(line[i] < '0' || line[i] > '9') {
+                return -1;
+            }
+            status = status * 10 + (line[i] - '0');
+        }
+        if(status < 100) {
+            return -1;
+        }
+        if(status < 200) {
+            // 1xx（100 Continue、103 Early Hints）是中间响应，接着读最终的响应；不支持协议升级
+            if(status == 101) {
+                return -1;
+            }
+            continue;
+        }
+        m_status = status;
+        m_reason = string(line.size() > 13 ? line.substr(13) : string_view("OK"));
+
+        bool chunked = false, close_conn = !http11;
+        long content_length = -1;
+        m_headers.clear();
+        string_view rest = block.substr(eol + 2);
+        while(!rest.empty()) {
+            eol = rest.find("\r\n");
+            line = rest.substr(0, eol);
+            rest.remove_prefix(eol + 2);
+            size_t colon = line.find(':');
+            if(colon == string_view::npos || colon == 0) {
+                return -1;
+            }
+            string name(line.substr(0, colon));
+            for(char & c : name) {
+                c = tolower((unsigned char)c);
+            }
+            string_view value = line.substr(colon + 1);
+            while(!value.empty() && (value[0] == ' ' || value[0] == '\t')) {
+                value.remove_prefix(1);
+            }
+            while(!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+                value.remove_suffix(1);
+            }
+            if(name == "content-length") {
+                char * stop = NULL;
+                string digits(value);
+                content_length = strtol(digits.c_str(), &stop, 10);
+                if(digits.empty() || *stop != '\0' || content_length < 0) {
+                    return -1;
+                }
+            } else if(name == "transfer-encoding") {
+                chunked = has_token(value, "chunked");
+            } else if(name == "connection") {
+                if(has_token(value, "close")) {
+                    close_conn = true;
+                } else if(has_token(value, "keep-alive")) {
+                    close_conn = false;
+                }
+            }
+            if(skip_response_header(name)) {
+                continue;
+            }
+            m_headers += name;
+            m_headers += ": ";
+            m_headers.append(value.data(), value.size());
+            m_headers += "\r\n";
+        }
+
+        // 响应体的分帧（RFC 9112 6.3）
+        m_keep_alive = !close_conn;
+        if(m_head_only || status == 204 || status == 304) {
+            // HEAD的响应把上游的长度告诉客户端，204和304没有响应体
+            m_content_length = m_head_only ? ((content_length >= 0) ? content_length : Stream_Head::UNKNOWN_LENGTH)
+                                           : Stream_Head::NO_BODY;
+            m_state = DONE;
+        } else if(chunked) {
+            m_body_mode = BODY_CHUNKED;
+            m_chunk_state = CHUNK_SIZE;
+            m_content_length = Stream_Head::UNKNOWN_LENGTH;
+            m_state = BODY;
+        } else if(content_length >= 0) {
+            m_body_mode = BODY_LENGTH;
+            m_remaining = content_length;
+            m_content_length = content_length;
+            m_state = (content_length == 0) ? DONE : BODY;
+        } else {
+            // 没有长度，读到上游关闭连接为止，连接不能复用
+            m_body_mode = BODY_UNTIL_CLOSE;
+            m_content_length = Stream_Head::UNKNOWN_LENGTH;
+            m_keep_alive = false;
+            m_state = BODY;
+        }
+        // 收到响应了，请求不会再重试
+        string().swap(m_request);
+        return 0;
+    }
+}
+
+int Proxy_Source::fill(char * buf, int len) {
+    if(m_start < m_end) {
+        int n = std::min(len, m_end - m_start);
+        memcpy(buf, m_buf + m_start, n);
+        m_start += n;
+        return n;
+    }
+    // 缓冲区里没有数据了，直接读到调用者的缓冲区里，不再拷贝一次
+    ssize_t n = recv(m_fd, buf, len, 0);
+    if(n >= 0) {
+        return n;
+    }
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? AGAIN : -1;
+}
+
+int Proxy_Source::read(char * buf, int len) {
+    if(m_state == DONE) {
+        return 0;
+    }
+    if(m_state != BODY) {
+        return -1;
+    }
+    int n;
+    switch(m_body_mode) {
+        case BODY_LENGTH:
+            n = fill(buf, (int)std::min((long)len, m_remaining));
+            if(n == 0) {
+                // 上游提前关闭了连接，客户端已经收到了Content-Length，只能断开
+                return -1;
+            }
+            if(n > 0) {
+                m_remaining -= n;
+                if(m_remaining == 0) {
+                    m_state = DONE;
+                }
+            }
+            return n;
+        case BODY_CHUNKED:
+            return read_chunked(buf, len);
+        default:
+            n = fill(buf, len);
+            if(n == 0) {
+                m_state = DONE;
+            }
+            return n;
+    }
+}
+
+// 解码上游的chunked编码，只把数据交给调用者（连接会重新分块），块的数据直接读到调用者的缓冲区
+int Proxy_Source::read_chunked(char * buf, int len) {
+    while(true) {
+        if(m_remaining > 0) {
+            int n = fill(buf, (int)std::min((long)len, m_remaining));
+            if(n == 0) {
+                return -1;
+            }
+            if(n > 0) {
+                m_remaining -= n;
+                if(m_remaining == 0) {
+                    m_chunk_state = CHUNK_DATA_END;
+                }
+            }
+            return n;
+        }
+        // 块之间的一行：数据后面的\r\n、长度行（可能带扩展）、结尾的trailer
+        char * begin = m_buf + m_start;
+        char * eol = (char *)memmem(begin, m_end - m_start, "\r\n", 2);
+        if(!eol) {
+            int ret = recv_more();
+            if(ret < 0) {
+                return ret;
+            }
+            continue;
+        }
+        m_start = eol + 2 - m_buf;
+        switch(m_chunk_state) {
+            case CHUNK_DATA_END:
+                if(eol != begin) {
+                    return -1;
+                }
+                m_chunk_state = CHUNK_SIZE;
+                break;
+            case CHUNK_SIZE: {
+                char * stop = NULL;
+                *eol = '\0';
+                long size = strtol(begin, &stop, 16);
+                if(stop == begin || size < 0 || (*stop != '\0' && *stop != ';' && *stop != ' ' && *stop != '\t')) {
+                    return -1;
+                }
+                m_remaining = size;
+                m_chunk_state = (size == 0) ? CHUNK_TRAILER : CHUNK_DATA_END;
+                break;
+            }
+            default:
+                // trailer丢弃，空行表示响应结束
+                if(eol == begin) {
+                    m_state = DONE;
+                    return 0;
+                }
+                break;
+        }
+    }
+}
+
+// ------------------------------ Proxy ------------------------------
+
+Proxy * Proxy::get_instance() {
+    // C++11以后局部静态变量的初始化是线程安全的
+    static Proxy instance;
+    return &instance;
+}
+
+Proxy::~Proxy() {
+    for(Upstream_Group * group : m_groups) {
+        delete group;
+    }
+}
+
+int Proxy::take_idle(Upstream * up) {
+    time_t now = Coarse_Clock::now();
+    while(true) {
+        // 后放回的先用，最近用过的连接最可能还活着
+        up->idle_lock.lock();
+        if(up->idle.empty()) {
+            up->idle_lock.unlock();
+            return -1;
+        }
+        Idle_Conn c = up->idle.back();
+        up->idle.pop_back();
+        up->idle_lock.unlock();
+        // 空闲期间上游关闭了连接（或者发来了多余的数据）就不能再用了
+        char byte;
+        if(now - c.since < PROXY_IDLE_TIMEOUT && recv(c.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && errno == EAGAIN) {
+            return c.fd;
+        }
+        close(c.fd);
+    }
+}
+
+void Proxy::put_idle(Upstream * up, int fd) {
+    int evicted = -1;
+    up->idle_lock.lock();
+    if((int)up->idle.size() >= PROXY_MAX_IDLE) {
+        // 最早放回的连接最可能已经被上游关闭了
+        evicted = up->idle.front().fd;
+        up->idle.erase(up->idle.begin());
+    }
+    up->idle.push_back(Idle_Conn{fd, Coarse_Clock::now()});
+    up->idle_lock.unlock();
+    if(evicted != -1) {
+        close(evicted);
+    }
+}
+
+// host:port，host可以是IP也可以是主机名（启动时解析一次）
+static bool parse_upstream(const string & text, Upstream * up) {
+    size_t colon = text.rfind(':');
+    if(colon == string::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+    string host = text.substr(0, colon);
+    string port = text.substr(colon + 1);
+    struct addrinfo hints, * res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+        return false;
+    }
+    memcpy(&up->addr, res->ai_addr, sizeof(up->addr));
+    freeaddrinfo(res);
+    up->name = text;
+    return true;
+}
+
+bool Proxy::add(const string & spec, int policy) {
+    size_t eq = spec.find('=');
+    if(eq == string::npos || spec[0] != '/') {
+        return false;
+    }
+    string prefix = spec.substr(0, eq);
+    while(!prefix.empty() && prefix.back() == '/') {
+        prefix.pop_back();
+    }
+    if(prefix.find_first_of(":*") != string::npos) {
+        return false;
+    }
+    Upstream_Group * group = new Upstream_Group(policy);
+    size_t pos = eq + 1;
+    while(pos <= spec.size()) {
+        size_t comma = spec.find(',', pos);
+        if(comma == string::npos) {
+            comma = spec.size();
+        }
+        Upstream * up = new Upstream;
+        if(!parse_upstream(spec.substr(pos, comma - pos), up)) {
+            delete up;
+            delete group;
+            return false;
+        }
+        group->m_upstreams.push_back(up);
+        pos = comma + 1;
+    }
+    m_groups.push_back(group);
+
+    // /prefix本身和它下面的所有路径，前缀为空时就是整个站点
+    static const http_conn::METHOD methods[] = { http_conn::GET, http_conn::POST, http_conn::HEAD, http_conn::PUT,
+                                                 http_conn::DELETE, http_conn::OPTIONS };
+    Router * router = Router::get_instance();
+    string all = prefix + "/*path";
+    for(http_conn::METHOD m : methods) {
+        if(!router->add(m, all.c_str(), handler, group)) {
+            return false;
+        }
+        if(!prefix.empty() && !router->add(m, prefix.c_str(), handler, group)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 转发一个请求头：逐跳头部（包括Connection中列出的）和由代理重新生成的头部不转发，
+// X-Forwarded-For先收集起来，最后加上客户端的地址一起生成
+static void forward_header(string & out, string_view connection, string_view name, string_view value, string & forwarded) {
+    int id = header_table.find(name);
+    if(id == HEADER_X_FORWARDED_FOR) {
+        if(!forwarded.empty()) {
+            forwarded += ", ";
+        }
+        forwarded.append(value.data(), value.size());
+        return;
+    }
+    if((id >= 0 && skip_request_header(id)) || has_token(connection, name)
+       || (name.size() == 16 && strncasecmp(name.data(), "proxy-connection", 16) == 0)) {
+        return;
+    }
+    out.append(name.data(), name.size());
+    out += ": ";
+    out.append(value.data(), value.size());
+    out += "\r\n";
+}
+
+void Proxy::build_request(http_conn * conn, Upstream_Group * group, string & out) {
+    string_view body = conn->content();
+    out.reserve(512 + conn->header_block().size() + body.size());
+    out += method_names[conn->get_method()];
+    out += ' ';
+    out += conn->get_url();
+    out += " HTTP/1.1\r\nHost: ";
+    // HTTP/2的:authority已经放在了Host里
+    string_view host = conn->header(HEADER_HOST);
+    if(host.empty()) {
+        host = group->m_upstreams[0]->name;
+    }
+    out.append(host.data(), host.size());
+    out += "\r\n";
+
+    // 请求中的所有头部都转发（包括头部表中没有的和重复出现的），不只是解析出来的那些
+    string_view connection = conn->header(HEADER_CONNECTION);
+    string forwarded;
+    if(const vector<Hpack_Field> * fields = conn->h2_fields()) {
+        // HTTP/2客户端可以把Cookie拆成多个字段（RFC 9113 8.2.3），转发给HTTP/1.1上游时用"; "合并成一行
+        string cookie;
+        for(const Hpack_Field & f : *fields) {
+            if(f.name.empty() || f.name[0] == ':') {
+                continue;
+            }
+            if(f.name == "cookie") {
+                if(!cookie.empty()) {
+                    cookie += "; ";
+                }
+                cookie += f.value;
+                continue;
+            }
+            forward_header(out, connection, f.name, f.value, forwarded);
+        }
+        if(!cookie.empty()) {
+            forward_header(out, connection, "cookie", cookie, forwarded);
+        }
+    } else {
+        // 读缓冲区中原样的头部行，每一行以\0结束
+        string_view block = conn->header_block();
+        while(!block.empty()) {
+            size_t end = block.find('\0');
+            string_view line = block.substr(0, end);
+            block.remove_prefix((end == string_view::npos) ? block.size() : end + 1);
+            size_t colon = line.find(':');
+            // 空行（行尾剩下的\0）、没有':'的行、名字中有空白的行（解析时也忽略了）不转发
+            if(colon == string_view::npos || colon == 0 || line.substr(0, colon).find_first_of(" \t") != string_view::npos) {
+                continue;
+            }
+            string_view value = line.substr(colon + 1);
+            while(!value.empty() && (value[0] == ' ' || value[0] == '\t')) {
+                value.remove_prefix(1);
+            }
+            while(!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+                value.remove_suffix(1);
+            }
+            forward_header(out, connection, line.substr(0, colon), value, forwarded);
+        }
+    }
+
+    char ip[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &conn->get_address().sin_addr, ip, sizeof(ip));
+    out += "X-Forwarded-For: ";
+    if(!forwarded.empty()) {
+        out += forwarded;
+        out += ", ";
+    }
+    out += ip;
+    out += "\r\nX-Real-IP: ";
+    out += ip;
+    out += conn->is_tls() ? "\r\nX-Forwarded-Proto: https\r\n" : "\r\nX-Forwarded-Proto: http\r\n";
+    if(!body.empty() || conn->get_method() == http_conn::POST || conn->get_method() == http_conn::PUT) {
+        out += "Content-Length: ";
+        out += to_string(body.size());
+        out += "\r\n";
+    }
+    out += "\r\n";
+    out.append(body.data(), body.size());
+}
+
+http_conn::HTTP_CODE Proxy::handler(http_conn * conn, const Route_Params &, void * arg) {
+    Upstream_Group * group = (Upstream_Group *)arg;
+    // 请求（包括请求体）在读缓冲区里，处理函数返回后就会被流水线中的下一个请求覆盖，这里拷贝一份
+    string request;
+    build_request(conn, group, request);
+    conn->start_stream(new Proxy_Source(group, request, conn->get_method()), NULL);
+    return http_conn::STREAM_REQUEST;
+}
@@ -0,0 +1,167 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "http_conn.h"
+#include "router.h"
+#include "stream_source.h"
+#include "../locker/locker.h"
+using namespace std;
+
+// 连接池中每个上游最多保留多少个空闲连接
+const int PROXY_MAX_IDLE = 32;
+// 空闲连接超过这个时间（秒）就不再复用（上游一般会关闭空闲太久的连接）
+const int PROXY_IDLE_TIMEOUT = 30;
+// 连接上游失败后，这么多秒内不再选择它（所有上游都失败时还是会尝试）
+const int PROXY_FAIL_TIMEOUT = 5;
+// 上游响应头的上限，也是读取上游数据的缓冲区大小
+const int PROXY_BUFFER_SIZE = 16 * 1024;
+
+// 负载均衡策略
+enum PROXY_POLICY { PROXY_ROUND_ROBIN = 0, PROXY_LEAST_CONN };
+
+// 连接池中的一个空闲连接
+struct Idle_Conn {
+    int fd;
+    time_t since;               // 放回连接池的时间
+};
+
+// 一个上游服务器
+struct Upstream {
+    sockaddr_in addr;
+    string name;                // host:port，客户端的请求中没有Host时使用
+    atomic<int> active;         // 正在转发的请求数（最少连接）
+    atomic<time_t> down_until;  // 连接失败后暂时不选择
+
+    // 空闲的keep-alive连接，锁只保护取和还的一次push/pop
+    Locker idle_lock;
+    vector<Idle_Conn> idle;
+
+    Upstream() : active(0), down_until(0) {}
+    ~Upstream();
+};
+
+// 挂载在一个路径前缀上的一组上游，由所有线程共享
+class Upstream_Group {
+public:
+    Upstream_Group(int policy) : m_policy(policy), m_next(0) {}
+    ~Upstream_Group();
+
+    // 按策略选择一个上游（已经计入active），跳过最近连接失败的
+    Upstream * select();
+    size_t size() const { return m_upstreams.size(); }
+
+    vector<Upstream *> m_upstreams;
+
+private:
+    int m_policy;
+    atomic<unsigned> m_next;    // 轮询的位置（最少连接时用来打破平局）
+};
+
+/**
+ * 把一个请求转发给上游的数据源，作为流式响应交给http_conn
+ * 所有socket操作都是非阻塞的，还没有数据时返回AGAIN，由连接的等待集合等待上游的fd：
+ *  SENDING      连接上游（非阻塞connect）并发送请求
+ *  READING_HEAD 读取上游的响应头，跳过1xx，去掉逐跳头部
+ *  BODY         响应体按上游的分帧读取（Content-Length、chunked或者读到连接关闭），
+ *               每次最多读出调用者给的一块，客户端读得慢时上游的数据留在内核的接收缓冲区里
+ *  DONE         响应读完了，析构时连接放回上游的连接池
+ * 上游还没有返回任何数据就失败了（连接被拒绝、复用的空闲连接已经被上游关闭）时换一个上游重试，
+ * 已经发出的请求只有幂等的方法才重试
+*/
+class Proxy_Source : public Stream_Source {
+public:
+    Proxy_Source(Upstream_Group * group, string & request, int method);
+    ~Proxy_Source();
+
+    int head(Stream_Head * head);
+    int read(char * buf, int len);
+    int wait_fd() const { return m_fd; }
+    int wait_events() const;
+
+private:
+    enum STATE { SENDING = 0, READING_HEAD, BODY, DONE };
+    enum BODY_MODE { BODY_LENGTH = 0, BODY_CHUNKED, BODY_UNTIL_CLOSE };
+    enum CHUNK_STATE { CHUNK_SIZE = 0, CHUNK_DATA_END, CHUNK_TRAILER };
+
+    // 选择上游并取一个空闲连接或者发起新的连接
+    bool connect_upstream();
+    // 上游还没有响应就失败了，换一个连接重试，不能重试返回false
+    bool retry();
+    // 释放当前的上游连接，reuse为true时放回连接池
+    void release_conn(bool reuse);
+    int send_request();
+    int read_head();
+    // 解析缓冲区中的响应头：0完成，AGAIN不完整，-1无效
+    int parse_head();
+    int read_chunked(char * buf, int len);
+    // 先取缓冲区中剩下的数据，没有再从上游recv到buf中
+    int fill(char * buf, int len);
+    // 从上游读更多的数据到缓冲区（解析响应头和chunked的长度行时使用）
+    int recv_more();
+
+private:
+    Upstream_Group * m_group;
+    Upstream * m_upstream;
+    int m_fd;
+    bool m_reused;              // 当前连接是从连接池中取的
+    int m_tries;                // 已经尝试了几个连接
+    bool m_idempotent;
+    bool m_head_only;           // HEAD请求，响应没有响应体
+
+    STATE m_state;
+    string m_request;           // 请求行、头部和请求体，收到响应头之前保留，用于重试
+    size_t m_sent;
+    bool m_received;            // 上游已经返回了数据，不能再重试
+
+    char * m_buf;               // 从上游读到的、还没有交给调用者的数据
+    int m_buf_size;
+    int m_start;
+    int m_end;
+
+    int m_status;
+    string m_reason;
+    string m_headers;           // 转发给客户端的头部（小写的名字）
+    long m_content_length;      // 交给Stream_Head的长度
+    bool m_keep_alive;          // 响应结束后连接能不能复用
+
+    BODY_MODE m_body_mode;
+    long m_remaining;           // Content-Length剩下的字节数，或者chunked当前这一块剩下的字节数
+    CHUNK_STATE m_chunk_state;
+};
+
+/**
+ * 反向代理（单例）：把路径前缀转发给一组上游，处理函数挂在路由表上
+ * 上游的空闲连接池按上游共享而不是按线程：Proactor模式下连接在工作线程中取出（处理函数里发送请求），
+ * 响应在事件循环线程中读完后归还，线程本地的连接池永远不会命中
+*/
+class Proxy {
+public:
+    static Proxy * get_instance();
+
+    // 解析 /prefix=host:port,host:port 并注册 /prefix 和 /prefix/*path 两条路由，失败返回false
+    bool add(const string & spec, int policy);
+
+    // 路由表的处理函数，arg是Upstream_Group
+    static http_conn::HTTP_CODE handler(http_conn * conn, const Route_Params & params, void * arg);
+
+    // 空闲连接池：取一个还活着的空闲连接，没有返回-1
+    static int take_idle(Upstream * up);
+    static void put_idle(Upstream * up, int fd);
+
+private:
+    Proxy() {}
+    ~Proxy();
+
+    // 生成转发给上游的请求：转发所有请求头（去掉逐跳头部，HTTP/2的Cookie合并成一行），加上X-Forwarded-*，请求体跟在后面
+    static void build_request(http_conn * conn, Upstream_Group * group, string & out);
+
+private:
+    vector<Upstream_Group *> m_groups;
+};
+
+#endif
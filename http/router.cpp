@@ -0,0 +1,207 @@
+#include "router.h"
+
+Route_Node::Route_Node() : param(NULL), wildcard(NULL) {
+    for(int i = 0; i < ROUTE_METHOD_COUNT; i++) {
+        handlers[i] = NULL;
+        args[i] = NULL;
+    }
+}
+
+Route_Node::~Route_Node() {
+    for(Route_Node * child : children) {
+        delete child;
+    }
+    delete param;
+    delete wildcard;
+}
+
+Router::Router() : m_root(new Route_Node) {}
+
+Router::~Router() {
+    delete m_root;
+}
+
+Router * Router::get_instance() {
+    // C++11以后局部静态变量的初始化是线程安全的
+    static Router instance;
+    return &instance;
+}
+
+bool Router::add(http_conn::METHOD method, const char * pattern, Route_Handler handler, void * arg) {
+    string_view p(pattern);
+    if(p.empty() || p[0] != '/' || !handler) {
+        return false;
+    }
+    int params = 0;
+    for(char c : p) {
+        if(c == ':' || c == '*') {
+            params++;
+        }
+    }
+    if(params > ROUTE_MAX_PARAMS) {
+        return false;
+    }
+    Route_Node * node = insert(m_root, p);
+    if(!node || node->handlers[method]) {
+        return false;
+    }
+    node->handlers[method] = handler;
+    node->args[method] = arg;
+    if(!node->allow.empty()) {
+        node->allow += ", ";
+    }
+    node->allow += method_names[method];
+    return true;
+}
+
+// 参数名不能为空，也不能再包含参数或者通配符
+static bool valid_name(string_view name) {
+    return !name.empty() && name.find_first_of(":*/") == string_view::npos;
+}
+
+Route_Node * Router::insert(Route_Node * node, string_view pattern) {
+    if(pattern.empty()) {
+        return node;
+    }
+    if(pattern[0] == ':') {
+        size_t end = pattern.find('/');
+        string_view name = pattern.substr(1, (end == string_view::npos) ? end : end - 1);
+        if(!valid_name(name)) {
+            return NULL;
+        }
+        // 同一个位置上只能有一个参数节点，参数名也必须相同
+        if(!node->param) {
+            node->param = new Route_Node;
+            node->param->name = string(name);
+        } else if(node->param->name != name) {
+            return NULL;
+        }
+        return insert(node->param, (end == string_view::npos) ? string_view() : pattern.substr(end));
+    }
+    if(pattern[0] == '*') {
+        string_view name = pattern.substr(1);
+        if(!valid_name(name)) {
+            return NULL;
+        }
+        if(!node->wildcard) {
+            node->wildcard = new Route_Node;
+            node->wildcard->name = string(name);
+        } else if(node->wildcard->name != name) {
+            return NULL;
+        }
+        return node->wildcard;
+    }
+    size_t end = pattern.find_first_of(":*");
+    if(end == string_view::npos) {
+        return insert_static(node, pattern, string_view());
+    }
+    return insert_static(node, pattern.substr(0, end), pattern.substr(end));
+}
+
+Route_Node * Router::insert_static(Route_Node * node, string_view literal, string_view rest) {
+    size_t i = node->indices.find(literal[0]);
+    if(i == string::npos) {
+        Route_Node * child = new Route_Node;
+        child->prefix = string(literal);
+        node->indices.push_back(literal[0]);
+        node->children.push_back(child);
+        return insert(child, rest);
+    }
+    Route_Node * child = node->children[i];
+    size_t common = 0;
+    while(common < literal.size() && common < child->prefix.size() && literal[common] == child->prefix[common]) {
+        common++;
+    }
+    if(common < child->prefix.size()) {
+        // 新的路径只和子节点共享前一部分，把子节点拆成公共前缀和剩下的部分
+        Route_Node * split = new Route_Node;
+        split->prefix = child->prefix.substr(0, common);
+        child->prefix.erase(0, common);
+        split->indices.push_back(child->prefix[0]);
+        split->children.push_back(child);
+        node->children[i] = split;
+        child = split;
+    }
+    if(common == literal.size()) {
+        return insert(child, rest);
+    }
+    return insert_static(child, literal.substr(common), rest);
+}
+
+bool Router::lookup(const Route_Node * node, string_view path, int method, Route_Params & params,
+                    const Route_Node ** found, const Route_Node ** path_node) const {
+    if(path.empty()) {
+        if(node->has_handler()) {
+            if(method >= 0 && node->handlers[method]) {
+                *found = node;
+                return true;
+            }
+            if(!*path_node) {
+                *path_node = node;
+            }
+        }
+    } else {
+        // 1.静态子节点：第一个字节确定唯一的候选
+        size_t i = node->indices.find(path[0]);
+        if(i != string::npos) {
+            const Route_Node * child = node->children[i];
+            if(path.compare(0, child->prefix.size(), child->prefix) == 0
+               && lookup(child, path.substr(child->prefix.size()), method, params, found, path_node)) {
+                return true;
+            }
+        }
+        // 2.参数：匹配到下一个'/'，后面匹配失败就撤销这个参数
+        if(node->param && path[0] != '/') {
+            size_t end = path.find('/');
+            if(end == string_view::npos) {
+                end = path.size();
+            }
+            int count = params.count;
+            params.names[count] = node->param->name;
+            params.values[count] = path.substr(0, end);
+            params.count++;
+            if(lookup(node->param, path.substr(end), method, params, found, path_node)) {
+                return true;
+            }
+            params.count = count;
+        }
+    }
+    // 3.通配符：匹配剩下的整个路径
+    const Route_Node * wildcard = node->wildcard;
+    if(wildcard) {
+        if(method >= 0 && wildcard->handlers[method]) {
+            params.names[params.count] = wildcard->name;
+            params.values[params.count] = path;
+            params.count++;
+            *found = wildcard;
+            return true;
+        }
+        if(!*path_node) {
+            *path_node = wildcard;
+        }
+    }
+    return false;
+}
+
+ROUTE_RESULT Router::match(int method, const char * url, Route_Match * match) const {
+    string_view path(url);
+    size_t query = path.find('?');
+    if(query != string_view::npos) {
+        path = path.substr(0, query);
+    }
+    match->params.count = 0;
+    match->allow = "";
+    const Route_Node * found = NULL;
+    const Route_Node * path_node = NULL;
+    if(method < ROUTE_METHOD_COUNT && lookup(m_root, path, method, match->params, &found, &path_node)) {
+        match->handler = found->handlers[method];
+        match->arg = found->args[method];
+        match->allow = found->allow.c_str();
+        return ROUTE_FOUND;
+    }
+    if(path_node) {
+        match->allow = path_node->allow.c_str();
+        return ROUTE_METHOD_NOT_ALLOWED;
+    }
+    return ROUTE_NOT_FOUND;
+}
@@ -0,0 +1,102 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <string_view>
+#include "http_conn.h"
+using namespace std;
+
+// 一条路由最多能有多少个参数（包括通配符）
+const int ROUTE_MAX_PARAMS = 8;
+// 能识别的请求方法的数量（和http_conn::METHOD一致）
+const int ROUTE_METHOD_COUNT = http_conn::CONNECT + 1;
+
+// 路径中匹配到的参数，name指向路由表，value指向请求的URL，匹配过程不分配内存
+struct Route_Params {
+    string_view names[ROUTE_MAX_PARAMS];
+    string_view values[ROUTE_MAX_PARAMS];
+    int count;
+
+    // 按名字取参数的值（未经过百分号解码），没有这个参数返回空
+    string_view get(string_view name) const {
+        for(int i = 0; i < count; i++) {
+            if(names[i] == name) {
+                return values[i];
+            }
+        }
+        return string_view();
+    }
+};
+
+// 处理函数：返回HTTP_CODE，由http_conn::process_write（HTTP/2是H2_Session::respond）生成响应
+// 需要发送动态内容时调用conn->start_stream后返回STREAM_REQUEST；arg是注册时传入的参数
+typedef http_conn::HTTP_CODE (*Route_Handler)(http_conn * conn, const Route_Params & params, void * arg);
+
+// 匹配结果
+enum ROUTE_RESULT { ROUTE_FOUND = 0, ROUTE_NOT_FOUND, ROUTE_METHOD_NOT_ALLOWED };
+
+struct Route_Match {
+    Route_Handler handler;
+    void * arg;
+    Route_Params params;
+    const char * allow;     // 匹配到的路径支持的方法（405响应的Allow头部）
+};
+
+// 压缩前缀树（radix trie）的节点
+struct Route_Node {
+    string prefix;                  // 静态节点：和父节点之间的一段路径（多条路由的公共前缀合并成一个节点）
+    string indices;                 // 每个静态子节点prefix的第一个字节，查找子节点时只比较一个字节
+    vector<Route_Node *> children;  // 静态子节点
+    Route_Node * param;             // :name 子节点，匹配到下一个'/'为止
+    Route_Node * wildcard;          // *name 子节点，匹配剩下的整个路径
+    string name;                    // 参数节点和通配符节点的参数名
+
+    Route_Handler handlers[ROUTE_METHOD_COUNT]; // 按方法存放的处理函数，NULL表示这个方法没有注册
+    void * args[ROUTE_METHOD_COUNT];
+    string allow;                   // 这个节点注册了的方法，逗号分隔
+
+    Route_Node();
+    ~Route_Node();
+    bool has_handler() const { return !allow.empty(); }
+};
+
+/**
+ * 路由表（单例），按方法和路径模式把请求分派给处理函数
+ * 路径模式由三种片段组成：
+ *  - 静态片段  /api/login
+ *  - 参数      /user/:id        匹配一个路径段（不含'/'）
+ *  - 通配符    *path            只能出现在最后（比如 /static/ 后面接 *path），匹配剩下的整个路径（可以为空）
+ * 所有路由编译成一棵压缩前缀树，匹配时间只和URL的长度有关，和路由的数量无关，匹配过程不分配内存
+ * 优先级：静态片段 > 参数 > 通配符，某个分支匹配失败时回溯到下一个优先级，
+ * 所以 /api/:name 和挂在根路径通配符上的静态文件可以同时存在
+ * 路由在服务器启动时（事件循环和线程池开始运行之前）注册，之后只读，匹配不加锁
+*/
+class Router {
+public:
+    static Router * get_instance();
+
+    // 注册一条路由，路径模式不合法或者和已有的路由冲突时返回false
+    bool add(http_conn::METHOD method, const char * pattern, Route_Handler handler, void * arg = NULL);
+
+    // 匹配一个请求，method小于0（不认识的方法）时只判断路径是否存在
+    // url中'?'之后的查询字符串不参与匹配
+    ROUTE_RESULT match(int method, const char * url, Route_Match * match) const;
+
+private:
+    Router();
+    ~Router();
+
+    // 把pattern插入到node下面，node本身的片段已经匹配完了
+    Route_Node * insert(Route_Node * node, string_view pattern);
+    Route_Node * insert_static(Route_Node * node, string_view literal, string_view rest);
+
+    // 在node下面匹配path，找到注册了method的节点返回true；路径匹配但方法不匹配时记录在path_node中
+    bool lookup(const Route_Node * node, string_view path, int method, Route_Params & params,
+                const Route_Node ** found, const Route_Node ** path_node) const;
+
+private:
+    Route_Node * m_root;
+};
+
+#endif
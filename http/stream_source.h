@@ -0,0 +1,52 @@
+#ifndef STREAM_SOURCE_H
+#define STREAM_SOURCE_H
+
+#include <string_view>
+using namespace std;
+
+// 数据源提供的响应头（反向代理从上游的响应中得到）
+struct Stream_Head {
+    // content_length的特殊值：长度未知（HTTP/1.1用chunked编码），没有响应体（1xx、204、304）
+    static const long UNKNOWN_LENGTH = -1;
+    static const long NO_BODY = -2;
+
+    int status;
+    const char * reason;    // 状态行中的原因短语（以\0结尾）
+    string_view headers;    // 额外的头部，每一行是 "name: value\r\n"（名字是小写的，HTTP/2可以直接使用）
+    long content_length;
+};
+
+/**
+ * 流式响应的数据源（动态内容的处理函数实现这个接口，交给http_conn::start_stream）
+ * 响应体的长度事先不知道，连接自动用chunked编码发送，每发送完一块才会再调用一次read，
+ * 所以一个流式响应最多只占用一块http_conn::STREAM_CHUNK_SIZE大小的缓冲区，客户端读得慢时由EPOLLOUT控制节奏
+ * read可能在事件循环线程（Proactor、io_uring）中调用，不能阻塞
+ *
+ * 数据来自另一个socket（比如上游服务器）时，head和read可以返回AGAIN，
+ * 连接把wait_fd()挂到自己的等待集合上，wait_events()就绪后再调用一次，等待期间不占用线程
+*/
+class Stream_Source {
+public:
+    // 数据还没有到，等wait_fd()就绪后再试
+    static const int AGAIN = -2;
+
+    Stream_Source() : wait_epfd(-1) {}
+    virtual ~Stream_Source() {}
+
+    // 往buf中写入最多len字节，返回写入的字节数，返回0表示数据已经全部写完，返回-1表示出错（断开连接）
+    virtual int read(char * buf, int len) = 0;
+
+    // 发送响应头之前调用：返回0表示响应头已经准备好（默认是200、start_stream时的Content-Type、长度未知），
+    // 返回AGAIN表示还要等待，返回-1表示失败（连接回复502）
+    virtual int head(Stream_Head *) { return 0; }
+
+    // 返回AGAIN时要等待的fd和事件（EPOLLIN/EPOLLOUT）
+    virtual int wait_fd() const { return -1; }
+    virtual int wait_events() const { return 0; }
+
+    // wait_fd()注册在哪个epoll上（连接的等待集合），-1表示没有注册；
+    // 数据源在关闭wait_fd()之前不需要处理，在把它交给别人（比如放回连接池）之前要先从这里删除
+    int wait_epfd;
+};
+
+#endif
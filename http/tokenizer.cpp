@@ -0,0 +1,78 @@
+#include "tokenizer.h"
+// 向量实现只在x86上编译，其他架构只有标量实现
+#if defined(__x86_64__) || defined(__i386__)
+#define TOKENIZER_X86 1
+#include <immintrin.h>
+#endif
+
+// 标量实现，也用于处理向量实现剩下的不足一个向量的尾部
+static const char * find2_scalar(const char * p, const char * end, char a, char b) {
+    for(; p < end; p++) {
+        if(*p == a || *p == b) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef TOKENIZER_X86
+// SSE4.2：用pcmpestri一次在16个字节中查找任意一个目标字节
+__attribute__((target("sse4.2")))
+static const char * find2_sse42(const char * p, const char * end, char a, char b) {
+    const __m128i needle = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while(end - p >= 16) {
+        __m128i data = _mm_loadu_si128((const __m128i *)p);
+        int idx = _mm_cmpestri(needle, 2, data, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return find2_scalar(p, end, a, b);
+}
+
+// AVX2：一次比较32个字节，两个目标字节的比较结果合并后取第一个置位的位置
+__attribute__((target("avx2")))
+static const char * find2_avx2(const char * p, const char * end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    while(end - p >= 32) {
+        __m256i data = _mm256_loadu_si256((const __m256i *)p);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(data, va), _mm256_cmpeq_epi8(data, vb));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    // 支持AVX2的CPU一定支持SSE4.2
+    return find2_sse42(p, end, a, b);
+}
+#endif
+
+Tokenizer::Find2_Func Tokenizer::m_find2 = Tokenizer::select();
+
+Tokenizer::Find2_Func Tokenizer::select() {
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return find2_avx2;
+    }
+    if(__builtin_cpu_supports("sse4.2")) {
+        return find2_sse42;
+    }
+#endif
+    return find2_scalar;
+}
+
+const char * Tokenizer::impl_name() {
+#ifdef TOKENIZER_X86
+    if(m_find2 == find2_avx2) {
+        return "avx2";
+    }
+    if(m_find2 == find2_sse42) {
+        return "sse4.2";
+    }
+#endif
+    return "scalar";
+}
@@ -0,0 +1,31 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+/**
+ * 向量化的HTTP报文分词工具
+ * 一次比较16（SSE4.2）或32（AVX2）个字节来查找行尾和分隔符，
+ * 运行时根据CPU支持的指令集选择实现，都不支持（或者不是x86）时使用逐字节比较的标量实现
+ * 每种实现的结果完全相同，只是速度不同
+*/
+class Tokenizer {
+public:
+    // 在[p, end)中查找第一个等于a或者b的字节，找不到返回end
+    static const char * find2(const char * p, const char * end, char a, char b) {
+        return m_find2(p, end, a, b);
+    }
+
+    // 当前使用的实现的名字（avx2、sse4.2、scalar）
+    static const char * impl_name();
+
+private:
+    typedef const char * (*Find2_Func)(const char * p, const char * end, char a, char b);
+
+    // 根据CPU支持的指令集选择实现
+    static Find2_Func select();
+
+    static Find2_Func m_find2;
+};
+
+#endif
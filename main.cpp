@@ -16,7 +16,20 @@ int main(int argc, char * argv[]) {
     // ------ 服务器信息 -------
     Server server;
     // 服务器初始化
-    server.server_init(config);
+    if(!server.server_init(config)) {
+        return 1;
+    }
+
+    // 线程池
+    server.thread_pool();
+
+    // 监听（每个事件循环一个SO_REUSEPORT监听socket）
+    if(!server.event_listen()) {
+        return 1;
+    }
+
+    // 运行
+    server.event_loop();
 
 
     return 0;
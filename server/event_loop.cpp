@@ -0,0 +1,736 @@
+#include "event_loop.h"
+
+Event_Loop::Event_Loop() : m_id(0), m_lfd(-1), m_tls_lfd(-1), m_epfd(-1), m_wakeup_fd(-1), m_sig_fd(-1),
+    m_io_backend(0), m_users(NULL), m_users_timer(NULL), m_pool(NULL), m_report_latency(false), m_last_tick(0),
+    m_ring(NULL), m_uring_conns(NULL), m_started(false), m_stop(false) {
+
+}
+
+Event_Loop::~Event_Loop() {
+    if(m_lfd != -1) {
+        close(m_lfd);
+    }
+    if(m_tls_lfd != -1) {
+        close(m_tls_lfd);
+    }
+    if(m_wakeup_fd != -1) {
+        close(m_wakeup_fd);
+    }
+    if(m_epfd != -1) {
+        close(m_epfd);
+    }
+}
+
+bool Event_Loop::init(int id, int port, int tls_port, int lfd_trig_mode, int cfd_trig_mode, int socket_linger_opt, int actor_mode, int io_backend,
+                      http_conn * users, Client_Data * users_timer, Task_Pool * pool) {
+    m_id = id;
+    m_lfd_trig_mode = lfd_trig_mode;
+    m_cfd_trig_mode = cfd_trig_mode;
+    m_actor_mode = actor_mode;
+    m_io_backend = io_backend;
+    m_users = users;
+    m_users_timer = users_timer;
+    m_pool = pool;
+    m_utils.init(TIME_SLOT);
+
+    // 每个事件循环创建自己的监听socket，开启了TLS再创建一个HTTPS的监听socket
+    m_lfd = create_listener(port, socket_linger_opt);
+    if(m_lfd < 0) {
+        return false;
+    }
+    if(tls_port > 0) {
+        m_tls_lfd = create_listener(tls_port, socket_linger_opt);
+        if(m_tls_lfd < 0) {
+            return false;
+        }
+    }
+
+    // 创建本事件循环自己的epoll树
+    m_epfd = epoll_create(5);
+    if(m_epfd < 0) {
+        return false;
+    }
+    m_utils.addfd(m_epfd, m_lfd, false, m_lfd_trig_mode);
+    if(m_tls_lfd != -1) {
+        m_utils.addfd(m_epfd, m_tls_lfd, false, m_lfd_trig_mode);
+    }
+
+    // 唤醒用的eventfd，stop时写入，让epoll_wait立刻返回
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_wakeup_fd < 0) {
+        return false;
+    }
+    m_utils.addfd(m_epfd, m_wakeup_fd, false, 0);
+    return true;
+}
+
+int Event_Loop::create_listener(int port, int socket_linger_opt) {
+    int lfd = socket(PF_INET, SOCK_STREAM, 0);
+    if(lfd < 0) {
+        return -1;
+    }
+
+    // 是否强制关闭连接
+    struct linger tmp = {0, 1};
+    if(socket_linger_opt == 1) {
+        tmp.l_onoff = 1;
+    }
+    setsockopt(lfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+
+    // 端口复用，SO_REUSEPORT让多个监听socket绑定到同一个端口上，由内核做负载均衡
+    int reuse = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(setsockopt(lfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        close(lfd);
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if(bind(lfd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(lfd, 5) < 0) {
+        close(lfd);
+        return -1;
+    }
+    return lfd;
+}
+
+void Event_Loop::watch_signal(int sig_fd) {
+    m_sig_fd = sig_fd;
+    m_utils.addfd(m_epfd, m_sig_fd, false, 0);
+}
+
+void Event_Loop::set_report_latency(bool on) {
+    m_report_latency = on;
+}
+
+bool Event_Loop::start() {
+    if(pthread_create(&m_thread, NULL, worker, this) != 0) {
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void * Event_Loop::worker(void * arg) {
+    Event_Loop * loop = (Event_Loop *)arg;
+    loop->loop();
+    return loop;
+}
+
+void Event_Loop::stop() {
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_wakeup_fd, &one, sizeof(one));
+}
+
+void Event_Loop::join() {
+    if(m_started) {
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+}
+
+void Event_Loop::loop() {
+    if(m_io_backend == 1) {
+        if(uring_loop()) {
+            return;
+        }
+        // io_uring创建失败（比如内存不够锁定），这个事件循环回退到epoll
+        printf("event loop %d io_uring init failure, fall back to epoll\n", m_id);
+        m_io_backend = 0;
+    }
+    epoll_loop();
+}
+
+void Event_Loop::epoll_loop() {
+    m_last_tick = Coarse_Clock::now();
+    while(!m_stop) {
+        // 定时器不再使用SIGALRM（信号只会送到一个线程上），而是由epoll_wait的超时驱动
+        int timeout = (int)(m_last_tick + TIME_SLOT - Coarse_Clock::now()) * 1000;
+        if(timeout < 0) {
+            timeout = 0;
+        }
+        int number = epoll_wait(m_epfd, m_events, MAX_EVENT_NUMBER, timeout);
+        if(number < 0 && errno != EINTR) {
+            printf("event loop %d epoll failure\n", m_id);
+            break;
+        }
+
+        for(int i = 0; i < number; i++) {
+            uint64_t data = m_events[i].data.u64;
+            int sockfd = (int)(uint32_t)data;
+            if(data & http_conn::PARK_EVENT) {
+                // 连接在等待数据源，等待集合中有fd就绪了
+                deal_with_park(sockfd);
+            } else if(sockfd == m_lfd || sockfd == m_tls_lfd) {
+                // 处理新到的客户连接
+                deal_client_connection(sockfd);
+            } else if(sockfd == m_wakeup_fd) {
+                uint64_t count;
+                ::read(m_wakeup_fd, &count, sizeof(count));
+            } else if(sockfd == m_sig_fd) {
+                // 处理信号
+                deal_with_signal();
+            } else if(m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                // 服务器端关闭连接，移除对应的定时器
+                deal_timer(m_users_timer[sockfd].timer, sockfd);
+            } else if(m_events[i].events & EPOLLIN) {
+                // 处理客户连接上接收到的数据
+                deal_with_read(sockfd);
+            } else if(m_events[i].events & EPOLLOUT) {
+                deal_with_write(sockfd);
+            }
+        }
+
+        time_t cur = Coarse_Clock::now();
+        if(cur - m_last_tick >= TIME_SLOT) {
+            m_utils.m_timer_lst.tick();
+            report_latency();
+            m_last_tick = cur;
+        }
+    }
+}
+
+bool Event_Loop::deal_client_connection(int lfd) {
+    bool tls = (lfd == m_tls_lfd);
+    struct sockaddr_in client_address;
+    socklen_t client_addrlength = sizeof(client_address);
+    if(m_lfd_trig_mode == 0) {
+        // LT模式，一次只接收一个连接
+        int connfd = accept(lfd, (struct sockaddr *)&client_address, &client_addrlength);
+        if(connfd < 0) {
+            return false;
+        }
+        add_client(connfd, client_address, tls);
+    } else {
+        // ET模式，要一直接收到没有新连接为止
+        while(true) {
+            int connfd = accept(lfd, (struct sockaddr *)&client_address, &client_addrlength);
+            if(connfd < 0) {
+                break;
+            }
+            add_client(connfd, client_address, tls);
+        }
+        return false;
+    }
+    return true;
+}
+
+void Event_Loop::add_client(int connfd, struct sockaddr_in client_address, bool tls) {
+    if(connfd >= MAX_FD || http_conn::m_user_cout >= MAX_FD) {
+        m_utils.show_error(connfd, "Internal server busy");
+        return;
+    }
+    // io_uring后端的连接不注册到epoll上
+    int epfd = (m_io_backend == 1) ? -1 : m_epfd;
+    m_users[connfd].init(connfd, client_address, epfd, m_cfd_trig_mode, m_actor_mode);
+    // HTTPS端口接收的连接，第一次读事件时开始握手
+    if(tls && !m_users[connfd].start_tls()) {
+        m_users[connfd].close_conn();
+        return;
+    }
+
+    // 创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到本事件循环的链表中
+    m_users_timer[connfd].address = client_address;
+    m_users_timer[connfd].sockfd = connfd;
+    m_users_timer[connfd].epfd = epfd;
+    m_users_timer[connfd].loop = this;
+    add_timer(connfd);
+}
+
+void Event_Loop::add_timer(int sockfd) {
+    Util_Timer * timer = new Util_Timer;
+    timer->user_data = &m_users_timer[sockfd];
+    timer->cb_func = (m_io_backend == 1) ? uring_cb_func : timer_cb_func;
+    timer->expire_time = Coarse_Clock::now() + 3 * TIME_SLOT;
+    m_users_timer[sockfd].timer = timer;
+    m_utils.m_timer_lst.add_timer(timer);
+}
+
+void Event_Loop::deal_with_signal() {
+    char signals[1024];
+    int ret = recv(m_sig_fd, signals, sizeof(signals), 0);
+    if(ret <= 0) {
+        return;
+    }
+    for(int i = 0; i < ret; i++) {
+        switch(signals[i]) {
+            case SIGTERM:
+            case SIGINT: {
+                m_stop = true;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void Event_Loop::report_latency() {
+    if(!m_report_latency) {
+        return;
+    }
+    static const char * names[POOL_CLASS_NUM] = {"cheap", "normal", "expensive"};
+    Latency_Stat stats[POOL_CLASS_NUM];
+    m_pool->latency_report(stats);
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        // 这段时间没有任务的类别不输出，任务很少时可能没有抽样到延迟
+        if(stats[c].count > 0 && stats[c].p99_us >= 0) {
+            printf("pool %s: %lu tasks, p50 %ldus, p99 %ldus\n", names[c], stats[c].count, stats[c].p50_us, stats[c].p99_us);
+        } else if(stats[c].count > 0) {
+            printf("pool %s: %lu tasks\n", names[c], stats[c].count);
+        }
+    }
+}
+
+bool Event_Loop::dispatch(int sockfd, int state) {
+    http_conn * conn = m_users + sockfd;
+    conn->m_tasks++;
+    if(!m_pool->submit([conn, state] {
+        conn->m_state = state;
+        conn->process();
+        conn->m_tasks--;
+    }, conn->cost_hint())) {
+        conn->m_tasks--;
+        return false;
+    }
+    return true;
+}
+
+void Event_Loop::deal_with_read(int sockfd) {
+    Util_Timer * timer = m_users_timer[sockfd].timer;
+    if(m_actor_mode == 0) {
+        // Reactor：连接有活动就延后定时器，读和处理都交给工作线程
+        adjust_timer(timer);
+        if(!dispatch(sockfd, 0)) {
+            deal_timer(timer, sockfd);
+        }
+        return;
+    }
+    // Proactor：事件循环线程读取数据，再把请求交给线程池处理
+    if(m_users[sockfd].read() && dispatch(sockfd, 0)) {
+        adjust_timer(timer);
+    } else {
+        deal_timer(timer, sockfd);
+    }
+}
+
+void Event_Loop::deal_with_write(int sockfd) {
+    Util_Timer * timer = m_users_timer[sockfd].timer;
+    if(m_actor_mode == 0) {
+        adjust_timer(timer);
+        if(!dispatch(sockfd, 1)) {
+            deal_timer(timer, sockfd);
+        }
+        return;
+    }
+    if(!m_users[sockfd].write()) {
+        deal_timer(timer, sockfd);
+        return;
+    }
+    adjust_timer(timer);
+    // 这一批响应发送完了，读缓冲区里还有流水线请求，交给线程池接着处理
+    if(m_users[sockfd].has_pipelined() && !dispatch(sockfd, 0)) {
+        deal_timer(timer, sockfd);
+    }
+}
+
+void Event_Loop::deal_with_park(int sockfd) {
+    // 连接已经被关闭了（关闭时等待集合也关闭了，这是同一批中之前取到的事件）
+    if(!m_users_timer[sockfd].timer) {
+        return;
+    }
+    int events = m_users[sockfd].unpark();
+    if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        deal_timer(m_users_timer[sockfd].timer, sockfd);
+    } else if(events & EPOLLIN) {
+        // HTTP/2连接等待期间收到了新的帧
+        deal_with_read(sockfd);
+    } else {
+        // 数据源就绪了（或者客户端可写了），继续发送
+        deal_with_write(sockfd);
+    }
+}
+
+void Event_Loop::adjust_timer(Util_Timer * timer) {
+    if(!timer) {
+        return;
+    }
+    timer->expire_time = Coarse_Clock::now() + 3 * TIME_SLOT;
+    m_utils.m_timer_lst.update_timer(timer);
+}
+
+void Event_Loop::deal_timer(Util_Timer * timer, int sockfd) {
+    // 响应没发完连接就断开了，释放文件和读写缓冲区
+    release_conn(sockfd);
+    if(timer) {
+        cb_func(&m_users_timer[sockfd]);
+        m_utils.m_timer_lst.del_timer(timer);
+    }
+    m_users_timer[sockfd].timer = NULL;
+}
+
+void Event_Loop::release_conn(int sockfd) {
+    m_users[sockfd].unmap();
+    m_users[sockfd].release_buffers();
+    m_users[sockfd].release_session();
+}
+
+void Event_Loop::timer_cb_func(Client_Data * user_data) {
+    user_data->loop->expire(user_data->sockfd);
+}
+
+void Event_Loop::expire(int sockfd) {
+    // tick返回后会释放这个定时器
+    m_users_timer[sockfd].timer = NULL;
+    if(m_users[sockfd].m_tasks > 0) {
+        // 工作线程还拿着这个连接（EPOLLONESHOT还没有重新注册），现在关闭会和它同时使用连接，
+        // 重新计时，等它处理完再说
+        add_timer(sockfd);
+        return;
+    }
+    // 和其他关闭路径一样先释放连接占用的资源（文件、缓冲区、TLS、HTTP/2会话、等待集合和上游连接）
+    release_conn(sockfd);
+    cb_func(&m_users_timer[sockfd]);
+}
+
+// ------------------------------ io_uring后端 ------------------------------
+
+static inline uint64_t uring_data(int op, int fd) {
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+bool Event_Loop::uring_loop() {
+    // SINGLE_ISSUER要求由使用它的线程来创建
+    m_ring = new IO_Uring;
+    if(!m_ring->init(URING_ENTRIES) || !m_ring->setup_buf_ring(0, URING_BUF_NUM, URING_BUF_SIZE)) {
+        delete m_ring;
+        m_ring = NULL;
+        return false;
+    }
+    m_uring_conns = new Uring_Conn[MAX_FD];
+
+    m_ring->prep_multishot_accept(m_lfd, uring_data(URING_ACCEPT, m_lfd));
+    m_ring->prep_poll_multishot(m_wakeup_fd, POLLIN, uring_data(URING_WAKEUP, m_wakeup_fd));
+    if(m_sig_fd != -1) {
+        m_ring->prep_poll_multishot(m_sig_fd, POLLIN, uring_data(URING_SIGNAL, m_sig_fd));
+    }
+    m_uring_ts.tv_sec = TIME_SLOT;
+    m_uring_ts.tv_nsec = 0;
+    m_ring->prep_timeout(&m_uring_ts, uring_data(URING_TIMEOUT, 0));
+
+    while(!m_stop) {
+        // 一次系统调用既提交上一轮产生的所有SQE，又等待新的完成事件
+        int ret = m_ring->submit_and_wait(1);
+        if(ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            printf("event loop %d io_uring failure\n", m_id);
+            break;
+        }
+        struct io_uring_cqe * cqe;
+        while((cqe = m_ring->peek_cqe()) != NULL) {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            m_ring->cqe_seen();
+            uring_deal_with_cqe(user_data, res, flags);
+        }
+    }
+
+    delete m_ring;
+    m_ring = NULL;
+    delete [] m_uring_conns;
+    m_uring_conns = NULL;
+    return true;
+}
+
+void Event_Loop::uring_deal_with_cqe(uint64_t user_data, int res, unsigned flags) {
+    int op = (int)(user_data >> 32);
+    int fd = (int)(uint32_t)user_data;
+    switch(op) {
+        case URING_ACCEPT: {
+            uring_deal_with_accept(res, flags);
+            break;
+        }
+        case URING_RECV: {
+            uring_deal_with_recv(fd, res, flags);
+            break;
+        }
+        case URING_SEND: {
+            uring_deal_with_send(fd, res);
+            break;
+        }
+        case URING_SHUTDOWN: {
+            // send没有完整发出去，链接的shutdown被取消了
+            // 连接还要继续发送的话，uring_send会重新链接一个；连接已经在关闭了就在这里补一个
+            if(res < 0) {
+                m_uring_conns[fd].shutdown_queued = false;
+                if(m_uring_conns[fd].closing) {
+                    shutdown(fd, SHUT_RDWR);
+                }
+            }
+            break;
+        }
+        case URING_PARK: {
+            uring_deal_with_park(fd);
+            break;
+        }
+        case URING_CLOSE:
+        case URING_CANCEL: {
+            break;
+        }
+        case URING_TIMEOUT: {
+            m_utils.m_timer_lst.tick();
+            report_latency();
+            m_ring->prep_timeout(&m_uring_ts, uring_data(URING_TIMEOUT, 0));
+            break;
+        }
+        case URING_WAKEUP: {
+            uint64_t count;
+            ::read(m_wakeup_fd, &count, sizeof(count));
+            if(!(flags & IORING_CQE_F_MORE)) {
+                m_ring->prep_poll_multishot(m_wakeup_fd, POLLIN, uring_data(URING_WAKEUP, m_wakeup_fd));
+            }
+            break;
+        }
+        case URING_SIGNAL: {
+            deal_with_signal();
+            if(!(flags & IORING_CQE_F_MORE)) {
+                m_ring->prep_poll_multishot(m_sig_fd, POLLIN, uring_data(URING_SIGNAL, m_sig_fd));
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void Event_Loop::uring_deal_with_accept(int res, unsigned flags) {
+    if(res >= 0) {
+        // multishot accept不返回对端地址，地址目前也只是保存起来，这里就不再调用getpeername了
+        struct sockaddr_in client_address;
+        bzero(&client_address, sizeof(client_address));
+        int connfd = res;
+        if(connfd >= MAX_FD || http_conn::m_user_cout >= MAX_FD) {
+            m_utils.show_error(connfd, "Internal server busy");
+        } else {
+            add_client(connfd, client_address, false);
+            Uring_Conn & uc = m_uring_conns[connfd];
+            uc.recving = true;
+            uc.sending = false;
+            uc.closing = false;
+            uc.shutdown_queued = false;
+            uc.polling = false;
+            m_ring->prep_multishot_recv(connfd, 0, uring_data(URING_RECV, connfd));
+        }
+    }
+    // 内核结束了multishot（比如出错），重新提交
+    if(!(flags & IORING_CQE_F_MORE)) {
+        m_ring->prep_multishot_accept(m_lfd, uring_data(URING_ACCEPT, m_lfd));
+    }
+}
+
+void Event_Loop::uring_deal_with_recv(int sockfd, int res, unsigned flags) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    bool more = flags & IORING_CQE_F_MORE;
+    if(res > 0) {
+        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        bool ok = m_users[sockfd].read_from(m_ring->get_buf(bid), res);
+        m_ring->recycle_buf(bid);
+        if(!uc.closing) {
+            if(!ok) {
+                // 读缓冲区满了
+                uring_close_conn(sockfd);
+            } else {
+                adjust_timer(m_users_timer[sockfd].timer);
+                // 正在发送的时候只把数据收下来，发送完成后再处理
+                if(!uc.sending) {
+                    uring_process(sockfd);
+                }
+            }
+        }
+        if(!more) {
+            if(uc.closing) {
+                uc.recving = false;
+                uring_try_release(sockfd);
+            } else {
+                m_ring->prep_multishot_recv(sockfd, 0, uring_data(URING_RECV, sockfd));
+            }
+        }
+        return;
+    }
+
+    if(res == -ENOBUFS && !uc.closing && !more) {
+        // provided buffer暂时用完了，重新提交recv
+        m_ring->prep_multishot_recv(sockfd, 0, uring_data(URING_RECV, sockfd));
+        return;
+    }
+
+    // 对方关闭连接（或者我们shutdown了），或者出错
+    if(!more) {
+        uc.recving = false;
+    }
+    uring_close_conn(sockfd);
+    uring_try_release(sockfd);
+}
+
+void Event_Loop::uring_process(int sockfd) {
+    http_conn & conn = m_users[sockfd];
+    // HTTP/1.1的流式响应在等数据源，流水线中后面的请求先留在读缓冲区里
+    if(conn.has_response()) {
+        return;
+    }
+    if(!conn.process_request()) {
+        uring_close_conn(sockfd);
+        uring_try_release(sockfd);
+        return;
+    }
+    // 请求还不完整，等待更多数据（HTTP/2连接上可能还有流在等数据源）
+    if(!conn.has_response()) {
+        if(conn.is_waiting()) {
+            uring_park(sockfd);
+        }
+        return;
+    }
+    int iov_count = 0;
+    conn.get_write_iov(iov_count);
+    if(iov_count > 0) {
+        uring_send(sockfd);
+    } else {
+        // 流式响应的响应头还在等数据源
+        uring_next(sockfd);
+    }
+}
+
+void Event_Loop::uring_send(int sockfd) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    int iov_count = 0;
+    bzero(&uc.msg, sizeof(uc.msg));
+    uc.msg.msg_iov = m_users[sockfd].get_write_iov(iov_count);
+    uc.msg.msg_iovlen = iov_count;
+    uc.sending = true;
+    // 流式响应还没有发送完的时候也不能链接shutdown
+    if(m_users[sockfd].is_linger() || m_users[sockfd].streaming()) {
+        m_ring->prep_sendmsg(sockfd, &uc.msg, MSG_NOSIGNAL, 0, uring_data(URING_SEND, sockfd));
+    } else {
+        // 非keep-alive：sendmsg后面链接一个shutdown，发送完成后内核直接shutdown，挂着的recv随之结束
+        // MSG_WAITALL保证流式socket上send要么发完要么出错，出错时链接的shutdown会被取消
+        m_ring->prep_sendmsg(sockfd, &uc.msg, MSG_NOSIGNAL | MSG_WAITALL, IOSQE_IO_LINK, uring_data(URING_SEND, sockfd));
+        m_ring->prep_shutdown(sockfd, SHUT_RDWR, uring_data(URING_SHUTDOWN, sockfd));
+        uc.shutdown_queued = true;
+    }
+}
+
+void Event_Loop::uring_deal_with_send(int sockfd, int res) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    uc.sending = false;
+    if(res < 0 || uc.closing) {
+        uring_close_conn(sockfd);
+        uring_try_release(sockfd);
+        return;
+    }
+    http_conn & conn = m_users[sockfd];
+    // 大文件要发送很久，发送有进展也要延后定时器
+    adjust_timer(m_users_timer[sockfd].timer);
+    if(!conn.advance_write(res)) {
+        // 没发完，接着发
+        uring_send(sockfd);
+        return;
+    }
+    uring_next(sockfd);
+}
+
+void Event_Loop::uring_next(int sockfd) {
+    http_conn & conn = m_users[sockfd];
+    // 流式响应上一块发送完了才取下一块，客户端读得慢时内存不会堆积
+    while(conn.streaming()) {
+        if(!conn.refill()) {
+            uring_close_conn(sockfd);
+            uring_try_release(sockfd);
+            return;
+        }
+        int iov_count = 0;
+        conn.get_write_iov(iov_count);
+        if(iov_count > 0) {
+            uring_send(sockfd);
+            return;
+        }
+        // 数据源还没有数据
+        if(conn.is_waiting()) {
+            uring_park(sockfd);
+            return;
+        }
+    }
+    if(!conn.finish_write()) {
+        uring_close_conn(sockfd);
+        uring_try_release(sockfd);
+        return;
+    }
+    // 发送期间收到的（或者上一批放不下的）流水线请求
+    if(conn.has_pipelined()) {
+        uring_process(sockfd);
+    } else if(conn.is_waiting()) {
+        uring_park(sockfd);
+    }
+}
+
+void Event_Loop::uring_park(int sockfd) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    if(uc.polling || uc.closing) {
+        return;
+    }
+    // 单次poll，就绪后由uring_deal_with_park处理，连接还要等待时再提交
+    uc.polling = true;
+    m_ring->prep_poll_add(m_users[sockfd].park_fd(), POLLIN, uring_data(URING_PARK, sockfd));
+}
+
+void Event_Loop::uring_deal_with_park(int sockfd) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    uc.polling = false;
+    if(uc.closing) {
+        uring_try_release(sockfd);
+        return;
+    }
+    adjust_timer(m_users_timer[sockfd].timer);
+    m_users[sockfd].unpark();
+    // 正在发送的话，发送完成后uring_next会接着取数据
+    if(!uc.sending) {
+        uring_next(sockfd);
+    }
+}
+
+void Event_Loop::uring_close_conn(int sockfd) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    if(uc.closing) {
+        return;
+    }
+    uc.closing = true;
+    if(!uc.shutdown_queued) {
+        shutdown(sockfd, SHUT_RDWR);
+    }
+    // 等待集合上的poll不会因为shutdown结束，要取消掉
+    if(uc.polling) {
+        m_ring->prep_cancel(uring_data(URING_PARK, sockfd), uring_data(URING_CANCEL, sockfd));
+    }
+    Util_Timer * timer = m_users_timer[sockfd].timer;
+    if(timer) {
+        m_utils.m_timer_lst.del_timer(timer);
+        m_users_timer[sockfd].timer = NULL;
+    }
+}
+
+void Event_Loop::uring_try_release(int sockfd) {
+    Uring_Conn & uc = m_uring_conns[sockfd];
+    if(!uc.closing || uc.recving || uc.sending || uc.polling) {
+        return;
+    }
+    // 在途操作都结束了，才能关闭fd，否则fd可能被复用
+    m_users[sockfd].unmap();
+    m_users[sockfd].release_buffers();
+    m_users[sockfd].release_session();
+    m_ring->prep_close(sockfd, uring_data(URING_CLOSE, sockfd));
+    uc.closing = false;
+    http_conn::m_user_cout--;
+}
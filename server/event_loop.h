@@ -0,0 +1,193 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <cassert>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <atomic>
+
+#include "../threadpool/task_pool.h"
+#include "../http/http_conn.h"
+#include "../timer/list_timer.h"
+#include "uring.h"
+
+const int MAX_FD = 65535;               // 最大的文件描述符数量（用于控制epoll的数量）
+const int MAX_EVENT_NUMBER = 10000;     // 最大的事件数量（事件作为任务放入到任务队列中）
+const int TIME_SLOT = 5;                // 等待时间，单位秒，当连接在Timeslot的时间内重新发送，就会重置时间（用于HTTP请求）
+
+const int URING_ENTRIES = 1024;         // io_uring提交队列的大小
+const int URING_BUF_NUM = 512;          // provided buffer的数量（必须是2的幂）
+const int URING_BUF_SIZE = 4096;        // 每块provided buffer的大小
+
+// io_uring后端：user_data的高32位是操作类型，低32位是fd
+enum URING_OP { URING_ACCEPT = 1, URING_RECV, URING_SEND, URING_SHUTDOWN, URING_CLOSE, URING_TIMEOUT, URING_WAKEUP, URING_SIGNAL,
+                URING_PARK, URING_CANCEL };
+
+// io_uring后端每个连接上在途操作的状态
+struct Uring_Conn {
+    bool recving;       // multishot recv还挂着
+    bool sending;       // sendmsg还没有完成
+    bool closing;       // 连接正在关闭，等在途操作都结束后再close
+    bool shutdown_queued; // 已经链接了一个shutdown在send后面
+    bool polling;       // 在poll连接的等待集合（流式响应的数据源返回了AGAIN）
+    struct msghdr msg;  // sendmsg在完成之前要一直有效
+};
+
+/**
+ * 事件循环类（subreactor），每个事件循环运行在一个线程上
+ * 每个事件循环拥有：
+ *  - 自己的epoll树和events数组
+ *  - 自己的监听socket（设置了SO_REUSEPORT，内核按四元组把新连接分摊到各个监听socket上）
+ *  - 自己的定时器链表，只管理自己接收的那部分连接
+ * users和users_timer数组是所有事件循环共享的，因为fd在进程内唯一，
+ * 每个事件循环只会访问自己接收的那些fd对应的下标，互不干扰
+ *
+ * I/O后端可以选择epoll或者io_uring
+ *  - epoll：就绪通知 + recv/writev，按actor_mode分为Reactor和Proactor
+ *  - io_uring：完成通知，multishot accept/recv把数据直接放到provided buffer里，
+ *    请求在事件循环线程里直接处理（thread-per-core，不经过线程池），
+ *    不需要每次都epoll_ctl(MOD)重新注册EPOLLONESHOT，非keep-alive连接的send后面链接一个shutdown
+*/
+class Event_Loop {
+public:
+    Event_Loop();
+    ~Event_Loop();
+
+    // 初始化事件循环：创建监听socket（tls_port大于0时再创建一个HTTPS监听socket）、epoll树和唤醒用的eventfd
+    bool init(int id, int port, int tls_port, int lfd_trig_mode, int cfd_trig_mode, int socket_linger_opt, int actor_mode, int io_backend,
+              http_conn * users, Client_Data * users_timer, Task_Pool * pool);
+
+    // 让该事件循环额外监听信号管道的读端（只有一个事件循环负责处理信号）
+    void watch_signal(int sig_fd);
+
+    // 定时器检查时是否输出线程池每个代价类别的任务数和延迟（-T 1）
+    void set_report_latency(bool on);
+
+    // 在新线程中运行事件循环
+    bool start();
+
+    // 在当前线程中运行事件循环，直到stop被调用或收到终止信号
+    // 根据I/O后端选择epoll_loop或者uring_loop
+    void loop();
+
+    // 通知事件循环退出（可以在其他线程中调用）
+    void stop();
+
+    // 等待事件循环线程结束
+    void join();
+
+private:
+    // 线程函数，arg为Event_Loop对象
+    static void * worker(void * arg);
+
+    // epoll后端的事件循环
+    void epoll_loop();
+
+    // io_uring后端的事件循环，io_uring创建失败时返回false
+    bool uring_loop();
+
+    // 创建一个绑定到port的SO_REUSEPORT监听socket，失败返回-1
+    static int create_listener(int port, int socket_linger_opt);
+
+    // 处理监听socket（明文或HTTPS）上的新连接
+    bool deal_client_connection(int lfd);
+
+    // 初始化新连接和它的定时器，tls表示是HTTPS端口接收的连接
+    void add_client(int connfd, struct sockaddr_in client_address, bool tls);
+
+    // 处理信号管道上的信号
+    void deal_with_signal();
+
+    // 把连接交给线程池处理，state是Reactor模式下的任务类型 0:读 1:写，按连接的代价提示排队
+    bool dispatch(int sockfd, int state);
+
+    // 定时器检查时调用：打开了输出时，输出线程池每个代价类别这段时间的任务数和延迟
+    void report_latency();
+
+    // 处理读事件和写事件
+    // Reactor：只把读/写任务交给线程池，由工作线程完成读写和处理
+    // Proactor：事件循环线程完成读写，线程池只负责解析请求和生成响应
+    void deal_with_read(int sockfd);
+    void deal_with_write(int sockfd);
+
+    // 连接的等待集合（数据源的fd和客户端的fd）有事件就绪
+    void deal_with_park(int sockfd);
+
+    // 连接有数据传输，将定时器往后延迟
+    void adjust_timer(Util_Timer * timer);
+
+    // 关闭连接并删除定时器
+    void deal_timer(Util_Timer * timer, int sockfd);
+
+    // 给连接创建定时器，加到本事件循环的链表中
+    void add_timer(int sockfd);
+
+    // 释放连接占用的文件、读写缓冲区和会话（TLS、HTTP/2、等待集合、上游连接）
+    void release_conn(int sockfd);
+
+    // epoll后端定时器的回调函数，交给连接所属的事件循环处理
+    static void timer_cb_func(Client_Data * user_data);
+
+    // 连接超时：没有工作线程在处理它就关闭，否则重新计时
+    void expire(int sockfd);
+
+    // ------ io_uring后端 ------
+    // 处理一个完成事件
+    void uring_deal_with_cqe(uint64_t user_data, int res, unsigned flags);
+    void uring_deal_with_accept(int res, unsigned flags);
+    void uring_deal_with_recv(int sockfd, int res, unsigned flags);
+    void uring_deal_with_send(int sockfd, int res);
+    void uring_deal_with_park(int sockfd);
+    // 解析读缓冲区中的请求，生成了响应就提交sendmsg
+    void uring_process(int sockfd);
+    void uring_send(int sockfd);
+    // 这一批发送完了（或者数据源就绪了）：取流式响应的下一块，没有数据就等待，响应结束后处理流水线请求
+    void uring_next(int sockfd);
+    // 用poll等待连接的等待集合
+    void uring_park(int sockfd);
+    // 开始关闭连接：shutdown让挂着的recv结束，并删除定时器
+    void uring_close_conn(int sockfd);
+    // 连接上没有在途操作了，提交close
+    void uring_try_release(int sockfd);
+
+private:
+    int m_id;                       // 事件循环编号
+    int m_lfd;                      // 本事件循环自己的监听文件描述符（SO_REUSEPORT）
+    int m_tls_lfd;                  // 本事件循环自己的HTTPS监听文件描述符，-1表示没有开启TLS
+    int m_epfd;                     // 本事件循环自己的epoll树
+    int m_wakeup_fd;                // eventfd，用于其他线程唤醒epoll_wait
+    int m_sig_fd;                   // 信号管道读端，-1表示不处理信号
+    int m_lfd_trig_mode;            // 监听文件描述符的trig模式
+    int m_cfd_trig_mode;            // 通信文件描述符的trig模式
+    int m_actor_mode;               // 事件处理模式 0:Reactor 1:Proactor
+    int m_io_backend;               // I/O后端 0:epoll 1:io_uring
+    epoll_event m_events[MAX_EVENT_NUMBER];
+
+    http_conn * m_users;            // 所有事件循环共享的连接数组
+    Client_Data * m_users_timer;    // 所有事件循环共享的定时器数据数组
+    Task_Pool * m_pool;             // 所有事件循环共享的线程池
+    bool m_report_latency;          // 是否输出线程池的延迟
+
+    Utils m_utils;                  // 本事件循环的定时器链表
+    time_t m_last_tick;             // 上一次检查定时器的时间
+
+    IO_Uring * m_ring;              // io_uring后端的ring，在事件循环线程里创建
+    Uring_Conn * m_uring_conns;     // io_uring后端每个连接的在途操作状态，按fd下标访问
+    struct __kernel_timespec m_uring_ts; // 定时器检查间隔
+
+    pthread_t m_thread;             // 运行该事件循环的线程
+    bool m_started;                 // 是否通过start在新线程中运行
+    atomic<bool> m_stop;            // 是否结束事件循环
+};
+
+#endif
@@ -1,23 +1,69 @@
 #include "server.h"
 
-Server::Server() {
-
+Server::Server() : users(NULL), m_pool(NULL), m_loops(NULL), users_timer(NULL) {
+    m_pipe_fd[0] = -1;
+    m_pipe_fd[1] = -1;
 }
 
 Server::~Server() {
-
+    // 线程池最先析构：剩下的任务执行完之前，它们访问的连接和事件循环都不能释放
+    Gzip_Cache::get_instance()->set_pool(NULL);
+    delete m_pool;
+    delete [] m_loops;
+    delete [] users;
+    delete [] users_timer;
+    if(m_pipe_fd[0] != -1) {
+        close(m_pipe_fd[0]);
+        close(m_pipe_fd[1]);
+    }
 }
 
 bool Server::server_init(Config config) {
     m_port = config.port;
+    m_tls_port = config.tls_port;
     m_sql_thread_num = config.sql_thread_num;
     m_conn_thread_num = config.conn_thread_num;
+    m_conn_thread_min = config.conn_thread_min;
+    m_pool_report = config.pool_report;
     m_log_open = config.log_open;
     m_log_write_way = config.log_write_way;
     m_socket_linger_opt = config.socket_linger_opt;
     m_actor_mode = config.actor_mode;
     m_lfd_trig_mode = config.lfd_trig_mode;
     m_cfd_trig_mode = config.cfd_trig_mode;
+    m_reactor_num = config.reactor_num;
+    m_io_backend = config.io_backend;
+
+    // 所有线程共享的秒级时钟，提供当前时间和Date响应头
+    Coarse_Clock::init();
+    // 所有事件循环和工作线程共享的打开文件缓存
+    File_Cache::get_instance()->init(doc_root, (long)config.cache_size * 1024 * 1024);
+    Gzip_Cache::get_instance()->init((long)config.gzip_cache_size * 1024 * 1024);
+    // 连接的读写缓冲区可以扩容到的上限
+    http_conn::m_buffer_max = config.buffer_max_size * 1024;
+    // 所有事件循环的TLS连接共享的证书、会话缓存和票据密钥
+    if(m_tls_port > 0 && !Tls_Context::get_instance()->init(config.tls_cert, config.tls_key)) {
+        printf("load tls certificate %s / key %s failure\n", config.tls_cert.c_str(), config.tls_key.c_str());
+        return false;
+    }
+
+    // 反向代理的前缀先注册，代理整个站点（/）时静态文件的路由会注册失败，请求全部转发给上游
+    for(const string & spec : config.upstreams) {
+        if(!Proxy::get_instance()->add(spec, config.proxy_policy)) {
+            printf("invalid upstream %s\n", spec.c_str());
+            return false;
+        }
+    }
+
+    // 静态文件是挂在/*path上的一个处理函数，动态接口注册更具体的路径，优先于静态文件匹配
+    Router * router = Router::get_instance();
+    router->add(http_conn::GET, "/*path", http_conn::file_handler);
+    router->add(http_conn::HEAD, "/*path", http_conn::file_handler);
+
+    // 连接数组按fd下标访问，所有事件循环共享
+    users = new http_conn[MAX_FD];
+    users_timer = new Client_Data[MAX_FD];
+    return true;
 }
 
 
@@ -26,4 +72,66 @@ void Server::server_init(string username, string password, string databasename)
     m_username = username;
     m_password = password;
     m_database_name = databasename;
-}
\ No newline at end of file
+}
+
+void Server::thread_pool() {
+    m_pool = new Task_Pool(m_conn_thread_num, 10000, m_conn_thread_min);
+    // io_uring后端的在线压缩在后台执行，也交给这个线程池
+    Gzip_Cache::get_instance()->set_pool(m_pool);
+}
+
+bool Server::event_listen() {
+    // 信号通过管道统一交给第0个事件循环处理
+    if(socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipe_fd) < 0) {
+        return false;
+    }
+    utils.setnonblocking(m_pipe_fd[1]);
+    Utils::u_pipefd = m_pipe_fd;
+
+    utils.addsig(SIGPIPE, SIG_IGN);
+    utils.addsig(SIGTERM, utils.sig_handler, false);
+    utils.addsig(SIGINT, utils.sig_handler, false);
+
+    // 启动时探测一次io_uring，老内核上回退到epoll
+    if(m_io_backend == 1 && !IO_Uring::supported()) {
+        printf("io_uring is not supported by this kernel, fall back to epoll\n");
+        m_io_backend = 0;
+    }
+    // 没有kTLS时TLS记录要在用户态加解密，io_uring后端的recv/sendmsg直接操作socket，只能使用epoll后端
+    if(m_io_backend == 1 && m_tls_port > 0) {
+        printf("tls is served by the epoll backend, fall back to epoll\n");
+        m_io_backend = 0;
+    }
+    printf("http tokenizer: %s\n", Tokenizer::impl_name());
+
+    m_loops = new Event_Loop[m_reactor_num];
+    for(int i = 0; i < m_reactor_num; i++) {
+        if(!m_loops[i].init(i, m_port, m_tls_port, m_lfd_trig_mode, m_cfd_trig_mode, m_socket_linger_opt, m_actor_mode, m_io_backend,
+                            users, users_timer, m_pool)) {
+            printf("event loop %d init failure\n", i);
+            return false;
+        }
+    }
+    m_loops[0].watch_signal(m_pipe_fd[0]);
+    // 线程池是所有事件循环共享的，只由第0个事件循环输出
+    m_loops[0].set_report_latency(m_pool_report == 1);
+    return true;
+}
+
+void Server::event_loop() {
+    // 第1..N-1个事件循环各自运行在一个线程上，第0个在当前线程运行并负责处理信号
+    for(int i = 1; i < m_reactor_num; i++) {
+        if(!m_loops[i].start()) {
+            printf("event loop %d start failure\n", i);
+        }
+    }
+    m_loops[0].loop();
+
+    // 第0个事件循环退出说明收到了终止信号，通知其他事件循环退出
+    for(int i = 1; i < m_reactor_num; i++) {
+        m_loops[i].stop();
+    }
+    for(int i = 1; i < m_reactor_num; i++) {
+        m_loops[i].join();
+    }
+}
@@ -18,10 +18,13 @@
 #include "../http/http_conn.h"
 #include "../config/config.h"
 #include "../timer/list_timer.h"
-
-const int MAX_FD = 65535;               // 最大的文件描述符数量（用于控制epoll的数量）
-const int MAX_EVENT_NUMBER = 10000;     // 最大的事件数量（事件作为任务放入到任务队列中）
-const int TIME_SLOT = 5;                // 等待时间，单位秒，当连接在Timeslot的时间内重新发送，就会重置时间（用于HTTP请求）
+#include "../cache/file_cache.h"
+#include "../cache/gzip_cache.h"
+#include "../http/router.h"
+#include "../http/proxy.h"
+#include "../http/tokenizer.h"
+#include "../tls/tls_context.h"
+#include "event_loop.h"
 
 // 服务器类，main函数创建一个服务器类进行执行
 // 服务器类为主要建立连接的类，用于建立和客户端的连接线程池、数据库的连接池等等
@@ -39,9 +42,19 @@ public:
     // 初始化服务器数据库信息
     void server_init(string username, string password, string databasename);
 
+    // 创建线程池
+    void thread_pool();
+
+    // 创建信号管道和所有事件循环（每个事件循环有自己的监听socket和epoll树）
+    bool event_listen();
+
+    // 运行所有事件循环，直到收到SIGTERM/SIGINT
+    void event_loop();
+
 private:
     // ------ 服务器信息 ------
     int m_port;                 // 服务器运行的端口号
+    int m_tls_port;             // HTTPS端口，0表示不开启TLS
     int m_actor_mode;           // 核反应堆模式
     char * m_root_path;         // 服务器根目录的路径
     
@@ -52,19 +65,21 @@ private:
     int m_sql_thread_num;       // 数据库连接线程数量
 
     // ------ 网络通信信息 ------
-    int m_lfd;                  // Server需要监听客户端发来的请求，lfd为监听的文件描述符
     int m_lfd_trig_mode;        // 监听文件描述符的trig模式（水平或边沿）
     int m_cfd_trig_mode;        // 通信文件描述符的trig模式（水平或边沿）
     int m_socket_linger_opt;    // socket是否开启linger模式
     // 连接信息（每一个通过HTTP发送请求的客户端被记录）
     http_conn * users;          // 初始化后会对其分配内存空间
-    // 线程池（所有线程保存到该ThreadPool中）
-    ThreadPool<http_conn> * m_pool;
-    int m_conn_thread_num;      // 线程池的线程数量
+    // 线程池（所有线程保存到该Task_Pool中），请求和后台压缩都交给它
+    Task_Pool * m_pool;
+    int m_conn_thread_num;      // 线程池的线程数量（上限）
+    int m_conn_thread_min;      // 线程池最少的线程数量
+    int m_pool_report;          // 是否定时输出线程池的延迟
 
-    // epoll事件，用于保存epoll树的事件信息，因为epoll_wait需要传递该参数
-    epoll_event events[MAX_EVENT_NUMBER];
-    int epfd;                   // epoll树，保存树的节点
+    // 事件循环（multi-reactor），每个事件循环有自己的epoll树、events数组和SO_REUSEPORT监听socket
+    Event_Loop * m_loops;
+    int m_reactor_num;          // 事件循环的数量
+    int m_io_backend;           // I/O后端 0:epoll 1:io_uring
     
     // ------ 日志信息 -------
     int m_log_open;             // 是否打开日志记录
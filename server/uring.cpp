@@ -0,0 +1,308 @@
+#include "uring.h"
+
+// 内核共享内存的读写需要内存屏障
+#define URING_LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define URING_STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static int uring_setup(unsigned entries, struct io_uring_params * p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, void * arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// 每个事件循环的io_uring只会被它自己的线程提交，SINGLE_ISSUER让内核省掉一些同步
+// SINGLE_ISSUER是6.0加入的，multishot recv也是6.0，所以能创建成功就说明特性够用
+static const unsigned URING_SETUP_FLAGS = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+
+IO_Uring::IO_Uring() : m_ring_fd(-1), m_sq_local_tail(0), m_sq_submitted(0),
+    m_ring_ptr(MAP_FAILED), m_ring_size(0), m_sqes_size(0),
+    m_buf_ring(NULL), m_buf_ring_size(0), m_bufs(NULL), m_buf_nr(0), m_buf_size(0) {
+
+}
+
+IO_Uring::~IO_Uring() {
+    if(m_ring_fd != -1) {
+        close(m_ring_fd);
+    }
+    if(m_ring_ptr != MAP_FAILED) {
+        munmap(m_ring_ptr, m_ring_size);
+        munmap(m_sqes, m_sqes_size);
+    }
+    if(m_buf_ring) {
+        munmap(m_buf_ring, m_buf_ring_size);
+    }
+    delete [] m_bufs;
+}
+
+bool IO_Uring::supported() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = URING_SETUP_FLAGS;
+    int fd = uring_setup(4, &p);
+    if(fd < 0) {
+        // ENOSYS: 内核不支持 EINVAL: 内核太老 EPERM: 被seccomp或者sysctl禁用
+        return false;
+    }
+
+    // 注册一个provided buffer ring试试（5.19）
+    bool ok = (p.features & IORING_FEAT_SINGLE_MMAP) && (p.features & IORING_FEAT_NODROP);
+    if(ok) {
+        size_t size = sysconf(_SC_PAGESIZE);
+        void * ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if(ring == MAP_FAILED) {
+            ok = false;
+        } else {
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = (uint64_t)(uintptr_t)ring;
+            reg.ring_entries = 1;
+            reg.bgid = 0;
+            ok = (uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0);
+            munmap(ring, size);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+bool IO_Uring::init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = URING_SETUP_FLAGS;
+    m_ring_fd = uring_setup(entries, &p);
+    if(m_ring_fd < 0) {
+        return false;
+    }
+
+    // SQ和CQ共用一块mmap（IORING_FEAT_SINGLE_MMAP），大小取两者中大的那个
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    m_ring_ptr = mmap(NULL, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_ring_ptr == MAP_FAILED) {
+        return false;
+    }
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+    if(m_sqes == MAP_FAILED) {
+        munmap(m_ring_ptr, m_ring_size);
+        m_ring_ptr = MAP_FAILED;
+        return false;
+    }
+
+    char * ptr = (char *)m_ring_ptr;
+    m_sq_head = (unsigned *)(ptr + p.sq_off.head);
+    m_sq_tail = (unsigned *)(ptr + p.sq_off.tail);
+    m_sq_mask = *(unsigned *)(ptr + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(ptr + p.sq_off.array);
+    m_cq_head = (unsigned *)(ptr + p.cq_off.head);
+    m_cq_tail = (unsigned *)(ptr + p.cq_off.tail);
+    m_cq_mask = *(unsigned *)(ptr + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(ptr + p.cq_off.cqes);
+
+    // SQ的间接数组直接一一对应，之后就不用再管它了
+    for(unsigned i = 0; i < p.sq_entries; i++) {
+        m_sq_array[i] = i;
+    }
+    m_sq_local_tail = m_sq_submitted = *m_sq_tail;
+    return true;
+}
+
+bool IO_Uring::setup_buf_ring(int bgid, int nr, int size) {
+    m_buf_nr = nr;
+    m_buf_size = size;
+    m_buf_ring_size = nr * sizeof(struct io_uring_buf);
+    void * ring = mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    m_buf_ring = (struct io_uring_buf_ring *)ring;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = nr;
+    reg.bgid = bgid;
+    if(uring_register(m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return false;
+    }
+
+    // 把所有缓冲区都交给内核
+    m_bufs = new char[(size_t)nr * size];
+    m_buf_ring->tail = 0;
+    for(int i = 0; i < nr; i++) {
+        recycle_buf(i);
+    }
+    return true;
+}
+
+char * IO_Uring::get_buf(int bid) {
+    return m_bufs + (size_t)bid * m_buf_size;
+}
+
+void IO_Uring::recycle_buf(int bid) {
+    unsigned short tail = m_buf_ring->tail;
+    // 不能用m_buf_ring->bufs：内核头文件里的__DECLARE_FLEX_ARRAY在C++下会多出一个空结构体，
+    // bufs的偏移变成8而不是0，最后一项会写到ring外面。这里直接从ring的起始地址开始算
+    struct io_uring_buf * buf = (struct io_uring_buf *)m_buf_ring + (tail & (m_buf_nr - 1));
+    buf->addr = (uint64_t)(uintptr_t)get_buf(bid);
+    buf->len = m_buf_size;
+    buf->bid = bid;
+    URING_STORE_RELEASE(&m_buf_ring->tail, (unsigned short)(tail + 1));
+}
+
+struct io_uring_sqe * IO_Uring::get_sqe() {
+    unsigned head = URING_LOAD_ACQUIRE(m_sq_head);
+    if(m_sq_local_tail - head > m_sq_mask) {
+        // 提交队列满了，先提交一次再取
+        submit_and_wait(0);
+        head = URING_LOAD_ACQUIRE(m_sq_head);
+        if(m_sq_local_tail - head > m_sq_mask) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe * sqe = &m_sqes[m_sq_local_tail & m_sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_local_tail++;
+    return sqe;
+}
+
+int IO_Uring::submit_and_wait(unsigned wait_nr) {
+    unsigned to_submit = m_sq_local_tail - m_sq_submitted;
+    URING_STORE_RELEASE(m_sq_tail, m_sq_local_tail);
+    m_sq_submitted = m_sq_local_tail;
+    if(to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    int ret = uring_enter(m_ring_fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    if(ret < 0) {
+        return -errno;
+    }
+    return ret;
+}
+
+struct io_uring_cqe * IO_Uring::peek_cqe() {
+    unsigned head = *m_cq_head;
+    if(head == URING_LOAD_ACQUIRE(m_cq_tail)) {
+        return NULL;
+    }
+    return &m_cqes[head & m_cq_mask];
+}
+
+void IO_Uring::cqe_seen() {
+    URING_STORE_RELEASE(m_cq_head, *m_cq_head + 1);
+}
+
+void IO_Uring::prep_multishot_accept(int fd, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    // 不设置SOCK_NONBLOCK：阻塞的socket上io_uring会自己等待可写并重试，
+    // 带MSG_WAITALL的send可以在内核里一次完成，不会把部分发送的结果返回给用户态
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_multishot_recv(int fd, int bgid, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bgid;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_sendmsg(int fd, struct msghdr * msg, unsigned msg_flags, unsigned sqe_flags, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = msg_flags;
+    sqe->flags = sqe_flags;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_shutdown(int fd, int how, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    sqe->fd = fd;
+    sqe->len = how;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_close(int fd, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_poll_multishot(int fd, unsigned poll_mask, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_mask;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_poll_add(int fd, unsigned poll_mask, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = poll_mask;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_cancel(uint64_t target, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = user_data;
+}
+
+void IO_Uring::prep_timeout(struct __kernel_timespec * ts, uint64_t user_data) {
+    struct io_uring_sqe * sqe = get_sqe();
+    if(!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)ts;
+    sqe->len = 1;
+    sqe->user_data = user_data;
+}
@@ -0,0 +1,95 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+/**
+ * io_uring的简单封装类（直接使用系统调用，不依赖liburing）
+ * 一个IO_Uring只能被一个线程使用（创建时设置了IORING_SETUP_SINGLE_ISSUER），
+ * 所以必须在事件循环自己的线程里init
+ *
+ * 除了提交队列(SQ)和完成队列(CQ)之外，还封装了一个provided buffer ring，
+ * multishot recv会由内核从这个ring里挑一块缓冲区放数据，用完再还回去
+*/
+class IO_Uring {
+public:
+    IO_Uring();
+    ~IO_Uring();
+
+    // 探测内核是否支持本服务器需要的io_uring特性（multishot accept/recv、provided buffer ring）
+    // 需要6.0以上的内核，不支持时服务器回退到epoll
+    static bool supported();
+
+    // 创建io_uring，entries为提交队列的大小
+    bool init(unsigned entries);
+
+    // 注册provided buffer ring，nr个大小为size的缓冲区，组号为bgid（nr必须是2的幂）
+    bool setup_buf_ring(int bgid, int nr, int size);
+
+    // 获取第bid块缓冲区的地址
+    char * get_buf(int bid);
+
+    // 把第bid块缓冲区还给内核
+    void recycle_buf(int bid);
+
+    // 获取一个空闲的SQE，提交队列满了会先提交一次
+    struct io_uring_sqe * get_sqe();
+
+    // 提交所有SQE，并至少等待wait_nr个完成事件
+    int submit_and_wait(unsigned wait_nr);
+
+    // 取一个完成事件，没有就返回NULL；处理完后要调用cqe_seen
+    struct io_uring_cqe * peek_cqe();
+    void cqe_seen();
+
+    // ------ 各种操作的准备函数 ------
+    void prep_multishot_accept(int fd, uint64_t user_data);
+    void prep_multishot_recv(int fd, int bgid, uint64_t user_data);
+    void prep_sendmsg(int fd, struct msghdr * msg, unsigned msg_flags, unsigned sqe_flags, uint64_t user_data);
+    void prep_shutdown(int fd, int how, uint64_t user_data);
+    void prep_close(int fd, uint64_t user_data);
+    void prep_poll_multishot(int fd, unsigned poll_mask, uint64_t user_data);
+    void prep_poll_add(int fd, unsigned poll_mask, uint64_t user_data);
+    // 取消user_data为target的在途操作（被取消的操作以-ECANCELED完成）
+    void prep_cancel(uint64_t target, uint64_t user_data);
+    void prep_timeout(struct __kernel_timespec * ts, uint64_t user_data);
+
+private:
+    int m_ring_fd;
+
+    // 提交队列
+    unsigned * m_sq_head;
+    unsigned * m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned * m_sq_array;
+    struct io_uring_sqe * m_sqes;
+    unsigned m_sq_local_tail;   // 还没有提交给内核的尾部
+    unsigned m_sq_submitted;    // 已经提交给内核的尾部
+
+    // 完成队列
+    unsigned * m_cq_head;
+    unsigned * m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe * m_cqes;
+
+    // mmap出来的内存
+    void * m_ring_ptr;
+    size_t m_ring_size;
+    size_t m_sqes_size;
+
+    // provided buffer ring
+    struct io_uring_buf_ring * m_buf_ring;
+    size_t m_buf_ring_size;
+    char * m_bufs;
+    int m_buf_nr;
+    int m_buf_size;
+};
+
+#endif
@@ -0,0 +1,79 @@
+// 响应头生成的微基准：原来add_response的做法（状态行、Content-Length、Content-Type、Connection、空行各一次vsnprintf）
+// 和Header_Builder的做法（预先生成的字节串memcpy + 查表转换数字）生成同样的响应头，输出每个响应头的耗时
+// 编译运行（在仓库根目录）：
+//   g++ -std=c++17 -O2 test/bench_header.cpp http/header_builder.cpp -o /tmp/bench_header && /tmp/bench_header
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "../http/header_builder.h"
+
+static char buf[1024];
+static int used;
+
+static void add_response(const char * format, ...) {
+    va_list arg_list;
+    va_start(arg_list, format);
+    used += vsnprintf(buf + used, sizeof(buf) - used, format, arg_list);
+    va_end(arg_list);
+}
+
+static void add_bytes(string_view data) {
+    memcpy(buf + used, data.data(), data.size());
+    used += data.size();
+}
+
+// 原来的做法
+static void build_vsnprintf(long length) {
+    used = 0;
+    add_response("%s %d %s\r\n", "HTTP/1.1", 200, "OK");
+    add_response("Content-Length: %ld\r\n", length);
+    add_response("Content-Type:%s\r\n", "text/html");
+    add_response("Connection: %s\r\n", "keep-alive");
+    add_response("%s", "\r\n");
+}
+
+// Header_Builder的做法
+static void build_template(long length) {
+    used = 0;
+    add_bytes(Header_Builder::status_line(200, "OK"));
+    add_bytes(Header_Builder::CONTENT_LENGTH);
+    used += Header_Builder::format_ulong(buf + used, length);
+    add_bytes(Header_Builder::CRLF);
+    add_bytes(Header_Builder::CONTENT_TYPE_HTML);
+    add_bytes(Header_Builder::KEEP_ALIVE);
+    add_bytes(Header_Builder::CRLF);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char * name, void (*build)(long)) {
+    const int rounds = 5000000;
+    volatile char sink = 0;
+    double start = now();
+    for(int i = 0; i < rounds; i++) {
+        build(1000 + i);
+        sink += buf[used - 1];
+    }
+    printf("%-10s %6.1f ns/response\n", name, (now() - start) * 1e9 / rounds);
+}
+
+int main() {
+    char expect[1024];
+    build_vsnprintf(123456);
+    memcpy(expect, buf, used);
+    int expect_len = used;
+    build_template(123456);
+    if(used != expect_len || memcmp(expect, buf, used) != 0) {
+        printf("mismatch\n");
+        return 1;
+    }
+    run("vsnprintf", build_vsnprintf);
+    run("template", build_template);
+    return 0;
+}
@@ -0,0 +1,68 @@
+// 线程池吞吐的基准：一个提交线程（相当于事件循环）不断addRequest，工作线程数从1增加到64，
+// 分别测试默认的Steal_Queue和Ring_Queue，输出每秒执行的任务数
+// 每个任务空转work_ns纳秒（默认0，只测调度开销），线程池满了提交线程就让出CPU再试
+// 编译运行（在仓库根目录）：
+//   g++ -std=c++17 -O2 test/bench_threadpool.cpp locker/locker.cpp -lpthread -o /tmp/bench_threadpool && /tmp/bench_threadpool [tasks] [work_ns]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include <atomic>
+#include <vector>
+#include "../threadpool/threadpool.h"
+
+static atomic<long> done(0);
+static long work_ns = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct Bench_Task {
+    int m_state;
+    void process() {
+        if(work_ns > 0) {
+            double end = now() + work_ns / 1e9;
+            while(now() < end) {}
+        }
+        done.fetch_add(1, memory_order_relaxed);
+    }
+};
+
+template <class Queue>
+static double run(int workers, long count) {
+    vector<Bench_Task> tasks(count);
+    done = 0;
+    ThreadPool<Bench_Task, Queue> * pool = new ThreadPool<Bench_Task, Queue>(workers, 10000);
+    double start = now();
+    for(long i = 0; i < count; i++) {
+        while(!pool->addRequest(&tasks[i], 0)) {
+            sched_yield();
+        }
+    }
+    while(done.load() < count) {
+        sched_yield();
+    }
+    double used = now() - start;
+    delete pool;
+    return count / used;
+}
+
+int main(int argc, char * argv[]) {
+    long count = (argc > 1) ? atol(argv[1]) : 1000000;
+    work_ns = (argc > 2) ? atol(argv[2]) : 0;
+    // 线程池创建线程时会输出日志，结果输出到stderr
+    if(!freopen("/dev/null", "w", stdout)) {
+        return 1;
+    }
+    fprintf(stderr, "%ld tasks, %ld ns each\nworkers  steal(tasks/s)  ring(tasks/s)\n", count, work_ns);
+    for(int workers = 1; workers <= 64; workers *= 2) {
+        double steal = run<Steal_Queue<Bench_Task>>(workers, count);
+        double ring = run<Ring_Queue<Bench_Task>>(workers, count);
+        fprintf(stderr, "%7d  %14.0f  %13.0f\n", workers, steal, ring);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// 向量化分词的微基准：按parse_line/parse_headers的方式切分一个典型的浏览器请求（查找行尾，再查找每行的':'），
+// 比较Tokenizer当前选择的实现（avx2/sse4.2）和逐字节的标量实现，输出每个请求的耗时
+// 编译运行（在仓库根目录）：
+//   g++ -std=c++17 -O2 test/bench_tokenizer.cpp http/tokenizer.cpp -o /tmp/bench_tokenizer && /tmp/bench_tokenizer
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../http/tokenizer.h"
+
+static const char request[] =
+    "GET /static/js/app.3f9c1d2e.js?v=20240501 HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/products/list?page=2&sort=price\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; _ga=GA1.1.1234567890.1714540800; _gid=GA1.1.987654321.1714540800\r\n"
+    "If-None-Match: \"5f3a-65b2c1d0\"\r\n"
+    "If-Modified-Since: Wed, 01 May 2024 08:00:00 GMT\r\n"
+    "\r\n";
+
+typedef const char * (*Find2)(const char * p, const char * end, char a, char b);
+
+static const char * find2_scalar(const char * p, const char * end, char a, char b) {
+    for(; p < end; p++) {
+        if(*p == a || *p == b) {
+            return p;
+        }
+    }
+    return end;
+}
+
+static const char * find2_tokenizer(const char * p, const char * end, char a, char b) {
+    return Tokenizer::find2(p, end, a, b);
+}
+
+// 切分一个请求，返回找到的':'的个数（防止被优化掉）
+static int tokenize(Find2 find2, const char * p, const char * end) {
+    int colons = 0;
+    while(p < end) {
+        const char * eol = find2(p, end, '\r', '\n');
+        if(eol == p) {
+            break;
+        }
+        if(find2(p, eol, ':', ':') != eol) {
+            colons++;
+        }
+        p = eol + 2;
+    }
+    return colons;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char * name, Find2 find2) {
+    const int rounds = 2000000;
+    const char * end = request + sizeof(request) - 1;
+    volatile int sink = 0;
+    double start = now();
+    for(int i = 0; i < rounds; i++) {
+        sink += tokenize(find2, request, end);
+    }
+    double used = now() - start;
+    printf("%-10s %6.1f ns/request  %5.2f GB/s\n", name, used * 1e9 / rounds, (sizeof(request) - 1) * (double)rounds / used / 1e9);
+}
+
+int main() {
+    const char * end = request + sizeof(request) - 1;
+    if(tokenize(find2_scalar, request, end) != tokenize(find2_tokenizer, request, end)) {
+        printf("mismatch\n");
+        return 1;
+    }
+    printf("request %zu bytes, tokenizer %s\n", sizeof(request) - 1, Tokenizer::impl_name());
+    run("scalar", find2_scalar);
+    run(Tokenizer::impl_name(), find2_tokenizer);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// 测试程序共用的检查宏：失败时输出位置和表达式，继续执行后面的检查，最后由check_report汇总
+// 每个测试程序是一个独立的可执行文件，和服务器的所有源文件（main.cpp除外）一起编译，返回0表示全部通过
+// 编译运行所有测试：.vscode/tasks.json中的run tests任务
+
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond) do { \
+        if(!(cond)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            check_failures++; \
+        } \
+    } while(0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+
+// 输出结果，返回给main作为退出码
+static int check_report(const char * name) {
+    if(check_failures > 0) {
+        printf("%s: %d check(s) failed\n", name, check_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef TEST_CONN_DRIVER_H
+#define TEST_CONN_DRIVER_H
+
+// 测试用的连接：不经过epoll（和io_uring后端一样epfd为-1），请求用read_from放进读缓冲区，响应直接从iovec里取
+
+#include <sys/socket.h>
+#include <string>
+#include "../http/http_conn.h"
+
+// 一个不接入事件循环的连接
+class Conn_Driver {
+public:
+    Conn_Driver() : m_open(true) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, m_fds);
+        sockaddr_in addr = {};
+        m_conn.init(m_fds[0], addr, -1, 0, 1);
+    }
+    ~Conn_Driver() {
+        // 和事件循环释放连接时一样
+        m_conn.close_conn();
+        m_conn.unmap();
+        m_conn.release_buffers();
+        m_conn.release_session();
+        close(m_fds[1]);
+    }
+
+    // 收到data，返回生成的所有响应（流水线中的请求都处理完）
+    string feed(const string & data) {
+        string out;
+        if(!m_conn.read_from(data.data(), data.size())) {
+            m_open = false;
+            return out;
+        }
+        while(m_open) {
+            if(!m_conn.process_request()) {
+                m_open = false;
+                break;
+            }
+            if(!m_conn.has_response()) {
+                break;
+            }
+            int iov_count = 0;
+            struct iovec * iov = m_conn.get_write_iov(iov_count);
+            int total = 0;
+            for(int i = 0; i < iov_count; i++) {
+                out.append((const char *)iov[i].iov_base, iov[i].iov_len);
+                total += iov[i].iov_len;
+            }
+            m_conn.advance_write(total);
+            if(!m_conn.finish_write()) {
+                m_open = false;
+                break;
+            }
+            if(!m_conn.has_pipelined()) {
+                break;
+            }
+        }
+        return out;
+    }
+
+    // 连接是否还保持着
+    bool open() const { return m_open; }
+
+private:
+    http_conn m_conn;
+    int m_fds[2];
+    bool m_open;
+};
+
+// 一个HTTP/2帧（帧头加上负载）
+inline string h2_frame(int type, int flags, int stream, const string & payload) {
+    string f;
+    f += (char)(payload.size() >> 16);
+    f += (char)(payload.size() >> 8);
+    f += (char)payload.size();
+    f += (char)type;
+    f += (char)flags;
+    f += (char)(stream >> 24);
+    f += (char)(stream >> 16);
+    f += (char)(stream >> 8);
+    f += (char)stream;
+    return f + payload;
+}
+
+// 响应中状态行的个数
+inline int count_status(const string & out, const char * status) {
+    int count = 0;
+    for(size_t pos = out.find(status); pos != string::npos; pos = out.find(status, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+#endif
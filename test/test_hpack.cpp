@@ -0,0 +1,151 @@
+// HPACK的测试：RFC 7541附录C的例子（C.3不用Huffman、C.4用Huffman、C.6动态表满了要淘汰），
+// 编码器的输出能被解码器还原，以及各种格式错误的头部块
+
+#include <string>
+#include <vector>
+#include "check.h"
+#include "../http/hpack.h"
+
+// 十六进制字符串（可以有空格）转成字节
+static string unhex(const char * text) {
+    string out;
+    int high = -1;
+    for(const char * p = text; *p; p++) {
+        int v = (*p >= '0' && *p <= '9') ? *p - '0' : (*p >= 'a' && *p <= 'f') ? *p - 'a' + 10 : -1;
+        if(v < 0) {
+            continue;
+        }
+        if(high < 0) {
+            high = v;
+        } else {
+            out.push_back((char)(high << 4 | v));
+            high = -1;
+        }
+    }
+    return out;
+}
+
+static bool decode(Hpack_Decoder & decoder, const string & block, vector<Hpack_Field> & fields) {
+    fields.clear();
+    return decoder.decode((const uint8_t *)block.data(), block.size(), fields);
+}
+
+// 用一个新的解码器解码，期望失败
+static bool rejects(const string & block) {
+    Hpack_Decoder decoder;
+    vector<Hpack_Field> fields;
+    return !decode(decoder, block, fields);
+}
+
+// 解码一个头部块，结果和expect（name, value交替）一致
+static void expect_fields(Hpack_Decoder & decoder, const char * hex, const vector<string> & expect) {
+    vector<Hpack_Field> fields;
+    CHECK(decode(decoder, unhex(hex), fields));
+    CHECK_EQ(fields.size() * 2, expect.size());
+    for(size_t i = 0; i < fields.size() && i * 2 + 1 < expect.size(); i++) {
+        CHECK_EQ(fields[i].name, expect[i * 2]);
+        CHECK_EQ(fields[i].value, expect[i * 2 + 1]);
+    }
+}
+
+// C.3和C.4：同一个连接上的三个请求，第二、三个请求引用前面加入动态表的条目
+static void requests(const char * first, const char * second, const char * third) {
+    Hpack_Decoder decoder;
+    expect_fields(decoder, first, {
+        ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com" });
+    expect_fields(decoder, second, {
+        ":method", "GET", ":scheme", "http", ":path", "/", ":authority", "www.example.com",
+        "cache-control", "no-cache" });
+    expect_fields(decoder, third, {
+        ":method", "GET", ":scheme", "https", ":path", "/index.html", ":authority", "www.example.com",
+        "custom-key", "custom-value" });
+}
+
+int main() {
+    // C.3 不用Huffman编码的请求
+    requests("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+             "8286 84be 5808 6e6f 2d63 6163 6865",
+             "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65");
+
+    // C.4 用Huffman编码的请求
+    requests("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+             "8286 84be 5886 a8eb 1064 9cbf",
+             "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf");
+
+    // C.6 用Huffman编码的响应，动态表上限256字节，第二、三个响应会淘汰最旧的条目
+    {
+        Hpack_Decoder decoder(256);
+        expect_fields(decoder,
+            "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6"
+            "2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3", {
+            ":status", "302", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+            "location", "https://www.example.com" });
+        expect_fields(decoder, "4883 640e ffc1 c0bf", {
+            ":status", "307", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:21 GMT",
+            "location", "https://www.example.com" });
+        expect_fields(decoder,
+            "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab"
+            "77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f"
+            "9587 3160 65c0 03ed 4ee5 b106 3d50 07", {
+            ":status", "200", "cache-control", "private", "date", "Mon, 21 Oct 2013 20:13:22 GMT",
+            "location", "https://www.example.com", "content-encoding", "gzip",
+            "set-cookie", "foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1" });
+    }
+
+    // 编码器的输出：常用状态码用静态表下标，其他的都是不索引的字面量，值超过126字节时长度是多字节整数
+    {
+        string block;
+        Hpack_Encoder::status(block, 200);
+        CHECK_EQ(block, unhex("88"));
+        Hpack_Encoder::status(block, 418);
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_LENGTH, 1234567890UL);
+        Hpack_Encoder::literal(block, Hpack_Encoder::CONTENT_TYPE, "text/html");
+        Hpack_Encoder::literal(block, "x-upstream", string(300, 'v'));
+        Hpack_Decoder decoder;
+        vector<Hpack_Field> fields;
+        CHECK(decode(decoder, block, fields));
+        CHECK_EQ(fields.size(), 5u);
+        if(fields.size() == 5) {
+            CHECK(fields[0].name == ":status" && fields[0].value == "200");
+            CHECK(fields[1].name == ":status" && fields[1].value == "418");
+            CHECK(fields[2].name == "content-length" && fields[2].value == "1234567890");
+            CHECK(fields[3].name == "content-type" && fields[3].value == "text/html");
+            CHECK(fields[4].name == "x-upstream" && fields[4].value == string(300, 'v'));
+        }
+        // 不加入动态表：62号下标还不存在
+        CHECK(!decode(decoder, unhex("be"), fields));
+    }
+
+    // Huffman：结尾填充是不超过7位的全1
+    {
+        Hpack_Decoder decoder;
+        expect_fields(decoder, "0481 1f", { ":path", "a" });
+        CHECK(rejects(unhex("0481 18")));           // 填充不是全1
+        CHECK(rejects(unhex("0482 1fff")));         // 填充超过7位
+        CHECK(rejects(unhex("0484 ffff ffff")));    // 字符串中出现EOS
+    }
+
+    // 下标为0、超出静态表和动态表、长度超出头部块、整数溢出
+    CHECK(rejects(unhex("80")));
+    CHECK(rejects(unhex("be")));
+    CHECK(rejects(unhex("0485 61")));
+    CHECK(rejects(unhex("ffff ffff ffff ff01")));
+    CHECK(rejects(unhex("ff")));
+
+    // 动态表大小更新不能超过SETTINGS中的上限，更新为0会清空动态表
+    CHECK(!rejects(unhex("3fe1 1f")));
+    CHECK(rejects(unhex("3fe2 1f")));
+    {
+        Hpack_Decoder decoder;
+        vector<Hpack_Field> fields;
+        CHECK(decode(decoder, unhex("4104 686f 7374 be"), fields));
+        CHECK(fields.size() == 2 && fields[1].name == ":authority" && fields[1].value == "host");
+        CHECK(!decode(decoder, unhex("20be"), fields));
+    }
+
+    // 解码出来的内容太多
+    CHECK(rejects(string(Hpack_Decoder::MAX_DECODED_SIZE / 42 + 1, (char)0x82)));
+    CHECK(!rejects(string(Hpack_Decoder::MAX_DECODED_SIZE / 42, (char)0x82)));
+
+    return check_report("test_hpack");
+}
@@ -0,0 +1,69 @@
+// 编译期完美哈希表的测试：每个已知的名字都能找到自己的下标，忽略大小写，其他名字都找不到
+
+#include <string>
+#include "check.h"
+#include "../http/header_table.h"
+
+// 第i个字符的大小写翻转
+static string flip_case(string_view name, size_t i) {
+    string s(name);
+    char c = s[i];
+    if(c >= 'a' && c <= 'z') {
+        s[i] = c - 'a' + 'A';
+    } else if(c >= 'A' && c <= 'Z') {
+        s[i] = c - 'A' + 'a';
+    }
+    return s;
+}
+
+// table中的每个key：原样、全小写、全大写、每个字符单独翻转大小写都能找到，多一个字符、少一个字符、改一个字符都找不到
+template <size_t N, size_t SIZE>
+static void check_table(const Perfect_Hash<N, SIZE> & table, const array<string_view, N> & names) {
+    CHECK(table.valid());
+    for(size_t i = 0; i < N; i++) {
+        string_view name = names[i];
+        string lower, upper;
+        for(char c : name) {
+            lower += Perfect_Hash<N, SIZE>::to_lower(c);
+            upper += (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+        }
+        CHECK_EQ(table.find(name), (int)i);
+        CHECK_EQ(table.find(lower), (int)i);
+        CHECK_EQ(table.find(upper), (int)i);
+        for(size_t j = 0; j < name.size(); j++) {
+            CHECK_EQ(table.find(flip_case(name, j)), (int)i);
+        }
+        CHECK_EQ(table.find(string(name) + "x"), -1);
+        CHECK_EQ(table.find(name.substr(0, name.size() - 1)), -1);
+        string changed(name);
+        changed[changed.size() - 1] ^= 0x40;
+        CHECK_EQ(table.find(changed), -1);
+        // 只对ASCII字母忽略大小写
+        string high(name);
+        high[0] |= 0x80;
+        CHECK_EQ(table.find(high), -1);
+    }
+}
+
+int main() {
+    check_table(header_table, header_names);
+    check_table(method_table, method_names);
+
+    // 不认识的名字
+    CHECK_EQ(header_table.find(""), -1);
+    CHECK_EQ(header_table.find("X-Unknown"), -1);
+    CHECK_EQ(header_table.find("Content-Length "), -1);
+    CHECK_EQ(header_table.find("Content_Length"), -1);
+    CHECK_EQ(header_table.find(string_view("Host\0", 5)), -1);
+    CHECK_EQ(method_table.find("PATCH"), -1);
+    CHECK_EQ(method_table.find("GE"), -1);
+
+    // 另外一组很短的key，哈希表只比key多一点
+    constexpr array<string_view, 5> words = {{ "x", "yz", "zy", "abc", "cba" }};
+    constexpr Perfect_Hash<5, 8> small(words);
+    static_assert(small.valid(), "no collision-free seed for words");
+    check_table(small, words);
+    CHECK_EQ(small.find("y"), -1);
+
+    return check_report("test_perfect_hash");
+}
@@ -0,0 +1,165 @@
+// 反向代理解码上游chunked响应的测试：本地监听一个端口作为上游，响应一段一段地发送，
+// 每当Proxy_Source没有数据可读（返回AGAIN）时才发下一段，覆盖长度行、块数据和trailer被拆开的各种情况
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "../http/proxy.h"
+
+static int listen_fd = -1;
+static Upstream_Group * group = NULL;
+
+// 一次转发的结果
+struct Result {
+    bool ok;            // 响应头和响应体都完整地读完了
+    string body;
+    string headers;
+    bool reused;        // 连接放回了连接池
+};
+
+static void setup() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 8);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr *)&addr, &len);
+
+    group = new Upstream_Group(PROXY_ROUND_ROBIN);
+    Upstream * up = new Upstream;
+    up->addr = addr;
+    up->name = "127.0.0.1";
+    group->m_upstreams.push_back(up);
+}
+
+// 上游依次发送pieces，发完之后close_at_end为true时关闭连接；读响应体时每次最多读read_len字节
+static Result run(const vector<string> & pieces, int read_len, bool close_at_end = false) {
+    Result result = { false, "", "", false };
+    string request = "GET / HTTP/1.1\r\nHost: test\r\n\r\n";
+    Proxy_Source * source = new Proxy_Source(group, request, http_conn::GET);
+    Stream_Head head;
+    int ret = source->head(&head);
+
+    // 上游收下整个请求
+    int conn = accept(listen_fd, NULL, NULL);
+    string received;
+    char buf[256];
+    while(received.find("\r\n\r\n") == string::npos) {
+        if(ret == Stream_Source::AGAIN) {
+            ret = source->head(&head);
+        }
+        ssize_t n = recv(conn, buf, sizeof(buf), MSG_DONTWAIT);
+        if(n > 0) {
+            received.append(buf, n);
+        }
+    }
+
+    // 发送下一段并等它到达，没有可以发的了返回false
+    size_t next = 0;
+    auto feed = [&]() -> bool {
+        if(next < pieces.size()) {
+            send(conn, pieces[next].data(), pieces[next].size(), MSG_NOSIGNAL);
+            next++;
+        } else if(close_at_end && conn != -1) {
+            close(conn);
+            conn = -1;
+        } else {
+            return false;
+        }
+        struct pollfd pfd = { source->wait_fd(), POLLIN, 0 };
+        poll(&pfd, 1, 1000);
+        return true;
+    };
+
+    while(ret == Stream_Source::AGAIN && feed()) {
+        ret = source->head(&head);
+    }
+    if(ret == 0) {
+        CHECK_EQ(head.status, 200);
+        CHECK_EQ(head.content_length, Stream_Head::UNKNOWN_LENGTH);
+        result.headers = string(head.headers);
+        while(true) {
+            int n = source->read(buf, read_len);
+            if(n > 0) {
+                result.body.append(buf, n);
+            } else if(n == 0) {
+                result.ok = true;
+                break;
+            } else if(n != Stream_Source::AGAIN || !feed()) {
+                break;
+            }
+        }
+    }
+    if(conn != -1) {
+        close(conn);
+    }
+    Upstream * up = group->m_upstreams[0];
+    size_t idle = up->idle.size();
+    delete source;
+    result.reused = (up->idle.size() > idle);
+    return result;
+}
+
+// 把一个响应拆成每段n字节
+static vector<string> split(const string & text, size_t n) {
+    vector<string> pieces;
+    for(size_t i = 0; i < text.size(); i += n) {
+        pieces.push_back(text.substr(i, n));
+    }
+    return pieces;
+}
+
+static const string chunked_head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nX-Upstream: a\r\n\r\n";
+
+int main() {
+    Coarse_Clock::init();
+    setup();
+
+    // 块扩展、十六进制大小写、trailer；各种拆分方式和读取大小得到同样的结果
+    const string body = "5\r\nhello\r\n6;name=value\r\n world\r\nA\r\n0123456789\r\n1f\r\n" + string(31, 'x')
+                      + "\r\n0\r\nX-Trailer: t\r\n\r\n";
+    const string expect = "hello world0123456789" + string(31, 'x');
+    for(size_t piece : { (size_t)1000, (size_t)1, (size_t)2, (size_t)3, (size_t)7 }) {
+        for(int read_len : { 64, 1, 4 }) {
+            Result r = run(split(chunked_head + body, piece), read_len);
+            CHECK(r.ok);
+            CHECK_EQ(r.body, expect);
+            // 逐跳头部不转发，连接完整地读完了可以复用
+            CHECK_EQ(r.headers, "x-upstream: a\r\n");
+            CHECK(r.reused);
+        }
+    }
+
+    // 只有结束块
+    {
+        Result r = run({ chunked_head + "0\r\n\r\n" }, 64);
+        CHECK(r.ok && r.body.empty() && r.reused);
+    }
+
+    // 结束之后上游多发了数据：响应正常结束，但是连接不能复用
+    {
+        Result r = run({ chunked_head + "2\r\nok\r\n0\r\n\r\nHTTP/1.1" }, 64);
+        CHECK(r.ok && r.body == "ok");
+        CHECK(!r.reused);
+    }
+
+    // 格式错误：块数据后面不是\r\n、长度不是十六进制、负数、长度行里有多余的字符
+    CHECK(!run({ chunked_head + "5\r\nhelloX\r\n0\r\n\r\n" }, 64).ok);
+    CHECK(!run({ chunked_head + "zz\r\nhello\r\n0\r\n\r\n" }, 64).ok);
+    CHECK(!run({ chunked_head + "-5\r\nhello\r\n0\r\n\r\n" }, 64).ok);
+    CHECK(!run({ chunked_head + "5x\r\nhello\r\n0\r\n\r\n" }, 64).ok);
+
+    // 上游在块数据中间、长度行中间、trailer之前关闭了连接
+    CHECK(!run({ chunked_head + "5\r\nhel" }, 64, true).ok);
+    CHECK(!run({ chunked_head + "5\r\nhello\r\n1" }, 64, true).ok);
+    CHECK(!run({ chunked_head + "5\r\nhello\r\n0\r\n" }, 64, true).ok);
+
+    delete group;
+    close(listen_fd);
+    return check_report("test_proxy_chunked");
+}
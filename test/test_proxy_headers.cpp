@@ -0,0 +1,126 @@
+// 反向代理转发请求头的测试：头部表中没有的头部和重复的头部都要原样转发，逐跳头部不转发，
+// HTTP/2客户端拆开的Cookie合并成一行；本地监听一个端口作为上游，检查它收到的请求
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <string>
+#include "check.h"
+#include "conn_driver.h"
+#include "../http/proxy.h"
+#include "../http/hpack.h"
+
+static int listen_fd = -1;
+
+// 上游收到的请求头（到空行为止）
+static string upstream_request() {
+    string received;
+    struct pollfd pfd = { listen_fd, POLLIN, 0 };
+    if(poll(&pfd, 1, 1000) != 1) {
+        return received;
+    }
+    int conn = accept(listen_fd, NULL, NULL);
+    char buf[1024];
+    while(received.find("\r\n\r\n") == string::npos) {
+        struct pollfd cfd = { conn, POLLIN, 0 };
+        if(poll(&cfd, 1, 1000) != 1) {
+            break;
+        }
+        ssize_t n = recv(conn, buf, sizeof(buf), 0);
+        if(n <= 0) {
+            break;
+        }
+        received.append(buf, n);
+    }
+    close(conn);
+    return received;
+}
+
+static bool has_line(const string & request, const string & line) {
+    return request.find("\r\n" + line + "\r\n") != string::npos;
+}
+
+int main() {
+    Coarse_Clock::init();
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 8);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr *)&addr, &len);
+    CHECK(Proxy::get_instance()->add("/api=127.0.0.1:" + to_string(ntohs(addr.sin_port)), PROXY_ROUND_ROBIN));
+
+    // HTTP/1.1
+    {
+        Conn_Driver d;
+        d.feed("GET /api/items?id=1 HTTP/1.1\r\n"
+               "Host: example.com\r\n"
+               "X-Request-Id: abc-123\r\n"
+               "X-Api-Key:  key \r\n"
+               "Sec-Fetch-Mode: cors\r\n"
+               "DNT: 1\r\n"
+               "Accept: text/html\r\n"
+               "Accept: application/json\r\n"
+               "Cookie: a=1\r\n"
+               "Connection: keep-alive, X-Hop\r\n"
+               "X-Hop: secret\r\n"
+               "Proxy-Connection: keep-alive\r\n"
+               "Keep-Alive: timeout=5\r\n"
+               "Content-Length: 0\r\n"
+               "X-Forwarded-For: 10.0.0.1\r\n"
+               "X-Forwarded-For: 10.0.0.2\r\n"
+               "Bad Name: x\r\n"
+               "\r\n");
+        string request = upstream_request();
+        CHECK(request.compare(0, 32, "GET /api/items?id=1 HTTP/1.1\r\nHo") == 0);
+        CHECK(has_line(request, "Host: example.com"));
+        CHECK(has_line(request, "X-Request-Id: abc-123"));
+        CHECK(has_line(request, "X-Api-Key: key"));
+        CHECK(has_line(request, "Sec-Fetch-Mode: cors"));
+        CHECK(has_line(request, "DNT: 1"));
+        // 重复的头部每一行都转发
+        CHECK(has_line(request, "Accept: text/html"));
+        CHECK(has_line(request, "Accept: application/json"));
+        CHECK(has_line(request, "Cookie: a=1"));
+        // 逐跳头部和Connection中列出的头部不转发，名字中有空白的行不转发
+        CHECK(request.find("Connection:") == string::npos);
+        CHECK(request.find("X-Hop") == string::npos);
+        CHECK(request.find("Keep-Alive") == string::npos);
+        CHECK(request.find("Content-Length") == string::npos);
+        CHECK(request.find("Bad Name") == string::npos);
+        // 所有X-Forwarded-For合并后再加上客户端的地址
+        CHECK(has_line(request, "X-Forwarded-For: 10.0.0.1, 10.0.0.2, 0.0.0.0"));
+        CHECK(has_line(request, "X-Forwarded-Proto: http"));
+    }
+
+    // HTTP/2（prior knowledge）：Cookie拆成了三个字段
+    {
+        string block;
+        Hpack_Encoder::literal(block, 2, "GET");
+        Hpack_Encoder::literal(block, 6, "http");
+        Hpack_Encoder::literal(block, 4, "/api/h2");
+        Hpack_Encoder::literal(block, 1, "example.com");
+        Hpack_Encoder::literal(block, "cookie", "a=1");
+        Hpack_Encoder::literal(block, "x-request-id", "h2-1");
+        Hpack_Encoder::literal(block, "cookie", "b=2");
+        Hpack_Encoder::literal(block, "accept", "*/*");
+        Hpack_Encoder::literal(block, "cookie", "c=3");
+        Hpack_Encoder::literal(block, "te", "trailers");
+        Conn_Driver d;
+        d.feed("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + h2_frame(4, 0, 0, "") + h2_frame(1, 0x5, 1, block));
+        string request = upstream_request();
+        CHECK(request.compare(0, 23, "GET /api/h2 HTTP/1.1\r\nH") == 0);
+        CHECK(has_line(request, "Host: example.com"));
+        CHECK(has_line(request, "cookie: a=1; b=2; c=3"));
+        CHECK(has_line(request, "x-request-id: h2-1"));
+        CHECK(has_line(request, "accept: */*"));
+        CHECK(request.find("cookie: a=1\r\n") == string::npos);
+        CHECK(request.find(":method") == string::npos);
+        CHECK(request.find("te:") == string::npos);
+    }
+
+    close(listen_fd);
+    return check_report("test_proxy_headers");
+}
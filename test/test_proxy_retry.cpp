@@ -0,0 +1,112 @@
+// 反向代理重试的测试：上游收下整个请求后没有响应就关闭了连接，
+// 非幂等的请求（POST）可能已经被上游处理了，不能再发给下一个连接；幂等的请求（GET）换一个连接重试
+
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <string>
+#include "check.h"
+#include "../http/proxy.h"
+
+static int listen_fd = -1;
+static Upstream_Group * group = NULL;
+
+static void setup() {
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, (sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 8);
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd, (sockaddr *)&addr, &len);
+
+    group = new Upstream_Group(PROXY_ROUND_ROBIN);
+    Upstream * up = new Upstream;
+    up->addr = addr;
+    up->name = "127.0.0.1";
+    group->m_upstreams.push_back(up);
+}
+
+// 上游有没有新的连接在等待accept
+static bool pending_conn(int timeout_ms) {
+    struct pollfd pfd = { listen_fd, POLLIN, 0 };
+    return poll(&pfd, 1, timeout_ms) == 1;
+}
+
+// 上游接受一个连接并收下整个请求（头部和length字节的请求体），返回连接和收到的请求
+static int accept_request(Proxy_Source * source, Stream_Head * head, long length, string & received) {
+    int conn = accept(listen_fd, NULL, NULL);
+    char buf[256];
+    received.clear();
+    while(true) {
+        size_t end = received.find("\r\n\r\n");
+        if(end != string::npos && received.size() >= end + 4 + length) {
+            break;
+        }
+        // 请求可能还没有发完
+        source->head(head);
+        ssize_t n = recv(conn, buf, sizeof(buf), MSG_DONTWAIT);
+        if(n > 0) {
+            received.append(buf, n);
+        }
+    }
+    return conn;
+}
+
+// 上游关闭连接后，等数据源看到连接断开，返回head的结果
+static int after_close(Proxy_Source * source, Stream_Head * head) {
+    struct pollfd pfd = { source->wait_fd(), POLLIN, 0 };
+    poll(&pfd, 1, 1000);
+    return source->head(head);
+}
+
+int main() {
+    Coarse_Clock::init();
+    setup();
+
+    // POST：上游收下了请求就关闭了连接，不重试，也不会有第二个连接
+    {
+        string request = "POST /order HTTP/1.1\r\nHost: test\r\nContent-Length: 5\r\n\r\nhello";
+        Proxy_Source * source = new Proxy_Source(group, request, http_conn::POST);
+        Stream_Head head;
+        CHECK_EQ(source->head(&head), Stream_Source::AGAIN);
+        string received;
+        int conn = accept_request(source, &head, 5, received);
+        CHECK(received.compare(0, 12, "POST /order ") == 0);
+        close(conn);
+        CHECK_EQ(after_close(source, &head), -1);
+        CHECK(!pending_conn(200));
+        delete source;
+    }
+
+    // GET：同样的情况换一个新的连接重试，第二个连接上的响应正常返回
+    {
+        string request = "GET /page HTTP/1.1\r\nHost: test\r\n\r\n";
+        Proxy_Source * source = new Proxy_Source(group, request, http_conn::GET);
+        Stream_Head head;
+        CHECK_EQ(source->head(&head), Stream_Source::AGAIN);
+        string received;
+        int conn = accept_request(source, &head, 0, received);
+        close(conn);
+        CHECK_EQ(after_close(source, &head), Stream_Source::AGAIN);
+        CHECK(pending_conn(1000));
+        conn = accept_request(source, &head, 0, received);
+        CHECK(received.compare(0, 10, "GET /page ") == 0);
+        const char * response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+        send(conn, response, strlen(response), MSG_NOSIGNAL);
+        struct pollfd pfd = { source->wait_fd(), POLLIN, 0 };
+        poll(&pfd, 1, 1000);
+        CHECK_EQ(source->head(&head), 0);
+        CHECK_EQ(head.status, 200);
+        char buf[16];
+        CHECK_EQ(source->read(buf, sizeof(buf)), 2);
+        CHECK_EQ(source->read(buf, sizeof(buf)), 0);
+        close(conn);
+        delete source;
+    }
+
+    delete group;
+    close(listen_fd);
+    return check_report("test_proxy_retry");
+}
@@ -0,0 +1,133 @@
+// Range请求的测试：单个范围、后缀范围、多个范围（multipart/byteranges）、416、语法错误时忽略Range、If-Range
+// 文件放在临时目录中，由文件缓存提供，连接的epfd为-1，文件内容直接在iovec里
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <utime.h>
+#include <string>
+#include "check.h"
+#include "conn_driver.h"
+#include "../http/router.h"
+#include "../cache/file_cache.h"
+
+// 文件内容：0123456789abcdefghijklmnopqrstuvwxyz
+static const string content = "0123456789abcdefghijklmnopqrstuvwxyz";
+static const time_t mtime = 1000000000;
+
+// 发送一个GET请求，extra是附加的头部
+static string get(const string & extra) {
+    Conn_Driver d;
+    return d.feed("GET /a.txt HTTP/1.1\r\n" + extra + "\r\n");
+}
+
+// 响应头中name的值，没有返回空串
+static string header_of(const string & out, const string & name) {
+    size_t pos = out.find("\r\n" + name + ":");
+    if(pos == string::npos) {
+        return "";
+    }
+    pos += name.size() + 3;
+    while(out[pos] == ' ') {
+        pos++;
+    }
+    return out.substr(pos, out.find("\r\n", pos) - pos);
+}
+
+// 响应体
+static string body_of(const string & out) {
+    size_t pos = out.find("\r\n\r\n");
+    return (pos == string::npos) ? "" : out.substr(pos + 4);
+}
+
+// 只有一个范围时的响应：206、Content-Range和这一段内容
+static void single(const string & range, const string & content_range, const string & body) {
+    string out = get("Range: " + range + "\r\n");
+    CHECK_EQ(out.compare(0, 13, "HTTP/1.1 206 "), 0);
+    CHECK_EQ(header_of(out, "Content-Range"), "bytes " + content_range);
+    CHECK_EQ(header_of(out, "Content-Length"), to_string(body.size()));
+    CHECK_EQ(body_of(out), body);
+}
+
+// 忽略Range，返回整个文件
+static void ignored(const string & extra) {
+    string out = get(extra);
+    CHECK_EQ(out.compare(0, 13, "HTTP/1.1 200 "), 0);
+    CHECK(header_of(out, "Content-Range").empty());
+    CHECK_EQ(body_of(out), content);
+}
+
+int main() {
+    Coarse_Clock::init();
+    char dir[] = "/tmp/test_range_XXXXXX";
+    if(!mkdtemp(dir)) {
+        return 1;
+    }
+    string path = string(dir) + "/a.txt";
+    FILE * fp = fopen(path.c_str(), "w");
+    fwrite(content.data(), 1, content.size(), fp);
+    fclose(fp);
+    struct utimbuf times = { mtime, mtime };
+    utime(path.c_str(), &times);
+
+    File_Cache::get_instance()->init(dir, 1 << 20);
+    Router::get_instance()->add(http_conn::GET, "/*path", http_conn::file_handler);
+
+    // 单个范围、开放的范围、后缀范围、超出文件的结束位置截断到文件末尾
+    single("bytes=0-4", "0-4/36", "01234");
+    single("bytes=10-", "10-35/36", content.substr(10));
+    single("bytes=-3", "33-35/36", "xyz");
+    single("bytes=-100", "0-35/36", content);
+    single("bytes=30-99", "30-35/36", content.substr(30));
+    // 单位不区分大小写，不满足的范围被跳过
+    single("BYTES=50-60, 1-2", "1-2/36", "12");
+
+    // 多个范围：multipart/byteranges，Content-Length和实际的响应体一致
+    {
+        string out = get("Range: bytes=0-1, 10-12, -2\r\n");
+        CHECK_EQ(out.compare(0, 13, "HTTP/1.1 206 "), 0);
+        string type = header_of(out, "Content-Type");
+        const string prefix = "multipart/byteranges; boundary=";
+        CHECK_EQ(type.compare(0, prefix.size(), prefix), 0);
+        string boundary = type.substr(prefix.size());
+        CHECK(!boundary.empty());
+        string body = body_of(out);
+        CHECK_EQ(header_of(out, "Content-Length"), to_string(body.size()));
+        string expect = "\r\n--" + boundary + "\r\nContent-Type:text/plain\r\nContent-Range: bytes 0-1/36\r\n\r\n01"
+                      + "\r\n--" + boundary + "\r\nContent-Type:text/plain\r\nContent-Range: bytes 10-12/36\r\n\r\nabc"
+                      + "\r\n--" + boundary + "\r\nContent-Type:text/plain\r\nContent-Range: bytes 34-35/36\r\n\r\nyz"
+                      + "\r\n--" + boundary + "--\r\n";
+        CHECK_EQ(body, expect);
+    }
+
+    // 没有一个范围在文件内：416，Content-Range给出文件大小
+    {
+        string out = get("Range: bytes=36-40\r\n");
+        CHECK_EQ(out.compare(0, 13, "HTTP/1.1 416 "), 0);
+        CHECK_EQ(header_of(out, "Content-Range"), "bytes */36");
+        out = get("Range: bytes=-0\r\n");
+        CHECK_EQ(out.compare(0, 13, "HTTP/1.1 416 "), 0);
+    }
+
+    // 语法错误或者不认识的单位：忽略Range
+    ignored("Range: bytes=5-1\r\n");
+    ignored("Range: bytes=a-b\r\n");
+    ignored("Range: bytes=1-2x\r\n");
+    ignored("Range: bytes=\r\n");
+    ignored("Range: items=0-1\r\n");
+    ignored("Range: bytes=0-1;3-4\r\n");
+
+    // If-Range：ETag和Last-Modified匹配时使用Range，否则返回整个文件
+    {
+        string etag = header_of(get(""), "ETag");
+        CHECK(!etag.empty());
+        single("bytes=0-1\r\nIf-Range: " + etag, "0-1/36", "01");
+        ignored("Range: bytes=0-1\r\nIf-Range: \"other\"\r\n");
+        ignored("Range: bytes=0-1\r\nIf-Range: W/" + etag + "\r\n");
+        single("bytes=0-1\r\nIf-Range: " + File_Cache::http_date(mtime), "0-1/36", "01");
+        ignored("Range: bytes=0-1\r\nIf-Range: " + File_Cache::http_date(mtime + 1) + "\r\n");
+    }
+
+    unlink(path.c_str());
+    rmdir(dir);
+    return check_report("test_range");
+}
@@ -0,0 +1,171 @@
+// HTTP/1.1请求边界（Content-Length）和流水线的测试，请求体超过上限时HTTP/1.1和HTTP/2都回复413
+
+#include <string>
+#include <vector>
+#include "check.h"
+#include "conn_driver.h"
+#include "../http/router.h"
+#include "../http/hpack.h"
+
+// 处理函数收到的请求体
+static vector<string> bodies;
+
+static http_conn::HTTP_CODE echo_handler(http_conn * conn, const Route_Params &, void *) {
+    bodies.push_back(string(conn->content()));
+    return http_conn::NO_RESOURCE;
+}
+
+// Content-Length的值不合法：回复400并且关闭连接，后面的流水线请求不再处理
+static void bad_length(const char * value) {
+    bodies.clear();
+    Conn_Driver d;
+    string out = d.feed(string("POST /echo HTTP/1.1\r\nContent-Length: ") + value + "\r\n\r\nhelloGET /echo HTTP/1.1\r\n\r\n");
+    CHECK_EQ(count_status(out, "HTTP/1.1 400 "), 1);
+    CHECK_EQ(count_status(out, "HTTP/1.1 "), 1);
+    CHECK(!d.open());
+    CHECK(bodies.empty());
+}
+
+// Content-Length格式正确但是超过了读缓冲区的上限：不等请求体到达就回复413并且关闭连接
+static void too_large(const string & value) {
+    bodies.clear();
+    Conn_Driver d;
+    string out = d.feed("POST /echo HTTP/1.1\r\nContent-Length: " + value + "\r\n\r\n");
+    CHECK_EQ(count_status(out, "HTTP/1.1 413 "), 1);
+    CHECK_EQ(count_status(out, "HTTP/1.1 "), 1);
+    CHECK(!d.open());
+    CHECK(bodies.empty());
+}
+
+int main() {
+    Coarse_Clock::init();
+    Router::get_instance()->add(http_conn::POST, "/echo", echo_handler);
+    Router::get_instance()->add(http_conn::GET, "/echo", echo_handler);
+
+    // 请求体之后紧跟着下一个请求
+    {
+        bodies.clear();
+        Conn_Driver d;
+        string out = d.feed("POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhelloGET /echo HTTP/1.1\r\n\r\n");
+        CHECK_EQ(count_status(out, "HTTP/1.1 404 "), 2);
+        CHECK_EQ(bodies.size(), 2u);
+        CHECK(bodies.size() == 2 && bodies[0] == "hello" && bodies[1].empty());
+        CHECK(d.open());
+    }
+
+    // 请求体分几次到达
+    {
+        bodies.clear();
+        Conn_Driver d;
+        CHECK(d.feed("POST /echo HTTP/1.1\r\nContent-Length: 10\r\n\r\nhel").empty());
+        CHECK(d.feed("lo wo").empty());
+        string out = d.feed("rld");
+        CHECK_EQ(count_status(out, "HTTP/1.1 404 "), 1);
+        CHECK(bodies.size() == 1 && bodies[0] == "hello worl");
+        // 多出来的一个字节是下一个请求的开头
+        out = d.feed("GET /echo HTTP/1.1\r\n\r\n");
+        CHECK_EQ(count_status(out, "HTTP/1.1 400 "), 1);
+    }
+
+    // 请求体中有\r\n，并且分两次到达
+    {
+        bodies.clear();
+        Conn_Driver d;
+        CHECK(d.feed("POST /echo HTTP/1.1\r\nContent-Length: 6\r\n\r\na\r\n").empty());
+        string out = d.feed("b\r\n");
+        CHECK_EQ(count_status(out, "HTTP/1.1 404 "), 1);
+        CHECK(bodies.size() == 1 && bodies[0] == "a\r\nb\r\n");
+    }
+
+    // Content-Length: 0和前导零
+    {
+        bodies.clear();
+        Conn_Driver d;
+        string out = d.feed("POST /echo HTTP/1.1\r\nContent-Length: 0\r\n\r\nPOST /echo HTTP/1.1\r\nContent-Length: 003\r\n\r\nabc");
+        CHECK_EQ(count_status(out, "HTTP/1.1 404 "), 2);
+        CHECK(bodies.size() == 2 && bodies[0].empty() && bodies[1] == "abc");
+    }
+
+    // 负数、符号、非数字、空值
+    bad_length("-5");
+    bad_length("+5");
+    bad_length("5x");
+    bad_length("0x10");
+    bad_length("");
+    bad_length("5, 5");
+    // 超过读缓冲区上限、溢出
+    too_large(to_string(http_conn::m_buffer_max + 1));
+    too_large("99999999999999999999999");
+    // 请求头之后的部分（这里是请求行和Content-Length占掉的空间）也要算上
+    too_large(to_string(http_conn::m_buffer_max - 10));
+
+    // 重复的Content-Length，不管值是否相同
+    {
+        bodies.clear();
+        Conn_Driver d;
+        string out = d.feed("POST /echo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello");
+        CHECK_EQ(count_status(out, "HTTP/1.1 400 "), 1);
+        CHECK(!d.open());
+        CHECK(bodies.empty());
+    }
+    {
+        bodies.clear();
+        Conn_Driver d;
+        string out = d.feed("POST /echo HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\nhello!");
+        CHECK_EQ(count_status(out, "HTTP/1.1 400 "), 1);
+        CHECK(!d.open());
+    }
+
+    // 上限不是缓冲区池某一档的大小时，分档取整后多出来的部分也不能用
+    {
+        int saved = http_conn::m_buffer_max;
+        http_conn::m_buffer_max = 5000;
+        Conn_Driver d;
+        d.feed("GET /echo HTTP/1.1\r\nX-Pad: ");
+        for(int i = 0; i < 10 && d.open(); i++) {
+            d.feed(string(700, 'a'));
+        }
+        CHECK(!d.open());
+        http_conn::m_buffer_max = saved;
+    }
+
+    // HTTP/2：请求体超过上限的流回复413，再用RST_STREAM(NO_ERROR)结束，处理函数没有被调用，连接还能继续用
+    {
+        int saved = http_conn::m_buffer_max;
+        http_conn::m_buffer_max = 8192;
+        bodies.clear();
+        string block;
+        Hpack_Encoder::literal(block, 3, "POST");
+        Hpack_Encoder::literal(block, 6, "http");
+        Hpack_Encoder::literal(block, 4, "/echo");
+        Conn_Driver d;
+        string out = d.feed("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + h2_frame(4, 0, 0, "") + h2_frame(1, 0x4, 1, block)
+                            + h2_frame(0, 0, 1, string(5000, 'a')));
+        CHECK(out.find("The request body is larger") == string::npos);
+        out = d.feed(h2_frame(0, 0, 1, string(5000, 'b')));
+        CHECK(out.find("The request body is larger") != string::npos);
+        CHECK(out.find(h2_frame(3, 0, 1, string(4, '\0'))) != string::npos);
+        // 已经拒绝的流后面的DATA直接丢弃
+        d.feed(h2_frame(0, 0x1, 1, string(100, 'c')));
+        CHECK(bodies.empty());
+        // 同一个连接上的下一个流正常处理
+        block.clear();
+        Hpack_Encoder::literal(block, 3, "POST");
+        Hpack_Encoder::literal(block, 6, "http");
+        Hpack_Encoder::literal(block, 4, "/echo");
+        d.feed(h2_frame(1, 0x4, 3, block) + h2_frame(0, 0x1, 3, "hello"));
+        CHECK(bodies.size() == 1 && bodies[0] == "hello");
+        CHECK(d.open());
+        http_conn::m_buffer_max = saved;
+    }
+
+    // 解析函数本身
+    long length = -1;
+    CHECK(http_conn::parse_content_length("1234", 10000, length) && length == 1234);
+    CHECK(http_conn::parse_content_length("10000", 10000, length) && length == 10000);
+    CHECK(!http_conn::parse_content_length("10001", 10000, length));
+    CHECK(!http_conn::parse_content_length(" 1", 10000, length));
+    CHECK(!http_conn::parse_content_length("-0", 10000, length));
+
+    return check_report("test_request_framing");
+}
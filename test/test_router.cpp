@@ -0,0 +1,113 @@
+// 路由表的测试：静态片段、参数、通配符的优先级和回溯，压缩前缀树节点的拆分，405和Allow，冲突的路由
+
+#include <string>
+#include "check.h"
+#include "conn_driver.h"
+#include "../http/router.h"
+
+// 每条路由一个处理函数，按函数指针判断匹配到了哪一条
+static http_conn::HTTP_CODE h_login(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_login_post(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_api(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_user(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_user_delete(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_post(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_static(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_files(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_app(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+static http_conn::HTTP_CODE h_apple(http_conn *, const Route_Params &, void *) { return http_conn::NO_RESOURCE; }
+
+static int arg_value = 7;
+
+// 匹配到handler，参数依次是names和values
+static void found(int method, const char * url, Route_Handler handler, const vector<string> & params = {}) {
+    Route_Match m;
+    CHECK_EQ(Router::get_instance()->match(method, url, &m), ROUTE_FOUND);
+    CHECK(m.handler == handler);
+    CHECK_EQ((size_t)m.params.count * 2, params.size());
+    for(int i = 0; i < m.params.count && (size_t)i * 2 + 1 < params.size(); i++) {
+        CHECK_EQ(m.params.names[i], params[i * 2]);
+        CHECK_EQ(m.params.values[i], params[i * 2 + 1]);
+    }
+}
+
+// 路径存在但没有注册这个方法
+static void not_allowed(int method, const char * url, const char * allow) {
+    Route_Match m;
+    CHECK_EQ(Router::get_instance()->match(method, url, &m), ROUTE_METHOD_NOT_ALLOWED);
+    CHECK_EQ(string(m.allow), allow);
+}
+
+int main() {
+    Coarse_Clock::init();
+    Router * router = Router::get_instance();
+    CHECK(router->add(http_conn::GET, "/api/login", h_login, &arg_value));
+    CHECK(router->add(http_conn::POST, "/api/login", h_login_post));
+    CHECK(router->add(http_conn::GET, "/api/:name", h_api));
+    CHECK(router->add(http_conn::GET, "/user/:id", h_user));
+    CHECK(router->add(http_conn::DELETE, "/user/:id", h_user_delete));
+    CHECK(router->add(http_conn::GET, "/user/:id/posts/:post", h_post));
+    CHECK(router->add(http_conn::GET, "/static/*path", h_static));
+    CHECK(router->add(http_conn::GET, "/*path", h_files));
+    CHECK(router->add(http_conn::HEAD, "/*path", h_files));
+    // /app和/apple共享前缀，/apple先注册，插入/app时要拆分节点
+    CHECK(router->add(http_conn::GET, "/apple", h_apple));
+    CHECK(router->add(http_conn::GET, "/app", h_app));
+
+    // 注册失败：重复、参数名不同、参数名为空、不以'/'开头、没有处理函数
+    CHECK(!router->add(http_conn::GET, "/api/login", h_login));
+    CHECK(!router->add(http_conn::GET, "/user/:uid", h_user));
+    CHECK(!router->add(http_conn::GET, "/static/*file", h_static));
+    CHECK(!router->add(http_conn::GET, "/x/:", h_user));
+    CHECK(!router->add(http_conn::GET, "/x/*", h_user));
+    CHECK(!router->add(http_conn::GET, "x", h_user));
+    CHECK(!router->add(http_conn::GET, "/x", NULL));
+    CHECK(!router->add(http_conn::GET, "/:a/:b/:c/:d/:e/:f/:g/:h/:i", h_user));
+
+    // 静态片段优先于参数，注册时的参数原样返回
+    {
+        Route_Match m;
+        CHECK_EQ(router->match(http_conn::GET, "/api/login", &m), ROUTE_FOUND);
+        CHECK(m.handler == h_login && m.arg == &arg_value);
+    }
+    found(http_conn::POST, "/api/login", h_login_post);
+    found(http_conn::GET, "/api/logout", h_api, { "name", "logout" });
+    found(http_conn::GET, "/api/log", h_api, { "name", "log" });
+    found(http_conn::GET, "/user/42", h_user, { "id", "42" });
+    found(http_conn::DELETE, "/user/42", h_user_delete, { "id", "42" });
+    found(http_conn::GET, "/user/42/posts/7", h_post, { "id", "42", "post", "7" });
+    found(http_conn::GET, "/app", h_app);
+    found(http_conn::GET, "/apple", h_apple);
+    found(http_conn::GET, "/static/css/a.css", h_static, { "path", "css/a.css" });
+    found(http_conn::GET, "/static/", h_static, { "path", "" });
+    // 查询字符串不参与匹配
+    found(http_conn::GET, "/user/42?tab=posts", h_user, { "id", "42" });
+
+    // 回溯：静态片段和参数后面都匹配失败时，撤销参数，退回到根路径的通配符
+    found(http_conn::GET, "/api/login/x", h_files, { "path", "api/login/x" });
+    found(http_conn::GET, "/user/42/comments", h_files, { "path", "user/42/comments" });
+    found(http_conn::GET, "/user/42/posts/7/x", h_files, { "path", "user/42/posts/7/x" });
+    found(http_conn::GET, "/user/", h_files, { "path", "user/" });
+    found(http_conn::GET, "/ap", h_files, { "path", "ap" });
+    found(http_conn::GET, "/applesauce", h_files, { "path", "applesauce" });
+    found(http_conn::HEAD, "/static/a.css", h_files, { "path", "static/a.css" });
+    found(http_conn::GET, "/", h_files, { "path", "" });
+
+    // 405：Allow是最先匹配到路径的节点注册了的方法
+    not_allowed(http_conn::PUT, "/api/login", "GET, POST");
+    not_allowed(http_conn::PUT, "/user/42", "GET, DELETE");
+    not_allowed(http_conn::POST, "/api/other", "GET");
+    not_allowed(http_conn::POST, "/nothing/here", "GET, HEAD");
+    not_allowed(-1, "/user/42", "GET, DELETE");
+
+    // 通过连接发送：405响应带Allow头部
+    {
+        Conn_Driver d;
+        string out = d.feed("PUT /user/42 HTTP/1.1\r\nContent-Length: 0\r\n\r\n");
+        CHECK_EQ(out.compare(0, 13, "HTTP/1.1 405 "), 0);
+        CHECK(out.find("\r\nAllow: GET, DELETE\r\n") != string::npos);
+        CHECK(d.open());
+    }
+
+    return check_report("test_router");
+}
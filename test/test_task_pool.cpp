@@ -0,0 +1,158 @@
+// Task和Task_Pool的测试：内部缓冲区和堆上的可调用对象、只能移动的捕获、对象的析构，
+// future带回返回值和异常，线程池满了提交失败，析构时执行完剩下的任务
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "check.h"
+#include "../threadpool/task_pool.h"
+
+// 记录存活的对象个数
+static int alive = 0;
+
+template <int SIZE>
+struct Counted {
+    char pad[SIZE];
+    int * calls;
+    Counted(int * c) : calls(c) { alive++; }
+    Counted(const Counted & other) : calls(other.calls) { alive++; }
+    Counted(Counted && other) noexcept : calls(other.calls) { alive++; }
+    ~Counted() { alive--; }
+    void operator()() { (*calls)++; }
+};
+
+// 移动构造可能抛出异常的类型不放在内部
+struct Throwing_Move {
+    Throwing_Move() {}
+    Throwing_Move(Throwing_Move &&) {}
+    void operator()() {}
+};
+
+// 一种可调用对象：放在内部还是堆上，调用、移动、重置之后都没有多余或者泄漏的对象
+template <class F>
+static void check_callable(bool expect_inline) {
+    CHECK_EQ(Task::fits_inline<F>(), expect_inline);
+    int calls = 0;
+    {
+        Task a{F(&calls)};
+        CHECK_EQ(alive, 1);
+        CHECK((bool)a);
+        a();
+        Task b(std::move(a));
+        CHECK(!a);
+        CHECK_EQ(alive, 1);
+        b();
+        Task c;
+        CHECK(!c);
+        c = std::move(b);
+        CHECK(!b);
+        CHECK_EQ(alive, 1);
+        c();
+        // 移动赋值给一个非空的Task时，原来的对象被析构
+        Task d{F(&calls)};
+        CHECK_EQ(alive, 2);
+        d = std::move(c);
+        CHECK_EQ(alive, 1);
+        d();
+        d.reset();
+        CHECK(!d);
+        CHECK_EQ(alive, 0);
+        Task e{F(&calls)};
+    }
+    CHECK_EQ(calls, 4);
+    CHECK_EQ(alive, 0);
+}
+
+int main() {
+    // Task
+    CHECK_EQ(sizeof(Task), 64u);
+    check_callable<Counted<8>>(true);
+    check_callable<Counted<TASK_INLINE_SIZE - sizeof(int *)>>(true);
+    check_callable<Counted<TASK_INLINE_SIZE>>(false);
+    check_callable<Counted<256>>(false);
+    CHECK(!Task::fits_inline<Throwing_Move>());
+    {
+        // 只能移动的捕获
+        unique_ptr<int> p(new int(5));
+        int got = 0;
+        Task t([p = std::move(p), &got] { got = *p; });
+        Task u(std::move(t));
+        u();
+        CHECK_EQ(got, 5);
+        // 函数指针
+        static int hits = 0;
+        Task f(+[] { hits++; });
+        f();
+        CHECK_EQ(hits, 1);
+    }
+
+    // Task_Pool：返回值、void、异常
+    {
+        Task_Pool pool(2, 100);
+        optional<future<int>> sum = pool.submit_future([] { return 40 + 2; });
+        CHECK(sum.has_value());
+        CHECK_EQ(sum->get(), 42);
+
+        atomic<int> count(0);
+        optional<future<void>> done = pool.submit_future([&count] { count++; });
+        CHECK(done.has_value());
+        done->get();
+        CHECK_EQ(count.load(), 1);
+
+        optional<future<string>> failed = pool.submit_future([]() -> string { throw runtime_error("boom"); });
+        CHECK(failed.has_value());
+        bool caught = false;
+        try {
+            failed->get();
+        } catch(const runtime_error & e) {
+            caught = (string(e.what()) == "boom");
+        }
+        CHECK(caught);
+
+        // 只能移动的捕获，在工作线程里执行和析构
+        unique_ptr<int> p(new int(9));
+        optional<future<int>> moved = pool.submit_future([p = std::move(p)] { return *p; });
+        CHECK(moved.has_value() && moved->get() == 9);
+
+        // 很多任务：节点执行完放回空闲链表，可以一直提交
+        atomic<int> ran(0);
+        int submitted = 0;
+        for(int i = 0; i < 10000; i++) {
+            while(!pool.submit([&ran] { ran++; })) {
+                sched_yield();
+            }
+            submitted++;
+        }
+        pool.submit_future([] {})->get();
+        while(ran.load() < submitted) {
+            sched_yield();
+        }
+        CHECK_EQ(ran.load(), 10000);
+    }
+
+    // 线程池满了：submit返回false，submit_future返回nullopt；析构时执行完已经接受的任务
+    {
+        atomic<int> ran(0);
+        promise<void> gate;
+        shared_future<void> open = gate.get_future().share();
+        Task_Pool * pool = new Task_Pool(1, 4);
+        int accepted = 0;
+        bool full = false;
+        for(int i = 0; i < 100 && !full; i++) {
+            if(pool->submit([open, &ran] { open.wait(); ran++; })) {
+                accepted++;
+            } else {
+                full = true;
+            }
+        }
+        CHECK(full);
+        CHECK(accepted > 0 && accepted <= 5);
+        CHECK(!pool->submit_future([] { return 1; }).has_value());
+        gate.set_value();
+        delete pool;
+        CHECK_EQ(ran.load(), accepted);
+    }
+
+    return check_report("test_task_pool");
+}
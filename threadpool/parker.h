@@ -0,0 +1,114 @@
+#ifndef PARKER_H
+#define PARKER_H
+
+#include <atomic>
+#include <climits>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+using namespace std;
+
+// 没有任务时先自旋这么多轮（每轮检查一次队列），还是没有才睡眠
+const int PARK_SPIN_COUNT = 128;
+
+/**
+ * 工作线程的睡眠和唤醒：先自旋，再在futex上睡眠
+ *  - m_idle是已经登记睡眠、还没有被认领的线程数，唤醒者用CAS减一认领一个，
+ *    所以连续提交多个任务时，只有第一个看到睡眠者的提交者会唤醒，被唤醒的线程还没有开始运行时后面的提交者不会重复唤醒
+ *  - m_tokens是futex字，认领之后加一个令牌并futex_wake，睡眠者拿到令牌才返回，
+ *    唤醒发生在futex_wait之前也不会丢失（futex_wait发现令牌不是0会立即返回）
+ * 工作线程都在忙（或者还在自旋）时提交任务只有一次原子读，没有系统调用
+ * 只有一个CPU时自旋只会拖延提交任务的线程，直接睡眠
+*/
+class Parker {
+public:
+    Parker() : m_idle(0), m_tokens(0), m_spin(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? PARK_SPIN_COUNT : 0) {}
+
+    // 没有任务时调用：ready()返回true表示有任务了（或者线程池要结束了），不再睡眠
+    // timeout_ms大于等于0时最多睡眠这么久，超时并且没有被认领返回false，其他情况返回true
+    template <class Ready>
+    bool park(Ready ready, int timeout_ms = -1) {
+        for(int i = 0; i < m_spin; i++) {
+            if(ready()) {
+                return true;
+            }
+            cpu_relax();
+        }
+        m_idle.fetch_add(1, memory_order_relaxed);
+        // 和unpark_one中的屏障配对：要么这里看到了新的任务，要么那边看到了这个睡眠者
+        atomic_thread_fence(memory_order_seq_cst);
+        if(ready() && unregister()) {
+            return true;
+        }
+        struct timespec timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        bool timed = (timeout_ms >= 0);
+        while(true) {
+            int tokens = m_tokens.load(memory_order_acquire);
+            if(tokens > 0) {
+                if(m_tokens.compare_exchange_weak(tokens, tokens - 1, memory_order_acquire)) {
+                    return true;
+                }
+                continue;
+            }
+            if(syscall(SYS_futex, &m_tokens, FUTEX_WAIT_PRIVATE, 0, timed ? &timeout : NULL, NULL, 0) < 0
+               && errno == ETIMEDOUT) {
+                if(unregister()) {
+                    return false;
+                }
+                // 超时的同时被认领了，令牌马上就到
+                timed = false;
+            }
+        }
+    }
+
+    // 提交任务之后调用，有没被认领的睡眠者时唤醒一个
+    void unpark_one() {
+        atomic_thread_fence(memory_order_seq_cst);
+        int idle = m_idle.load(memory_order_relaxed);
+        while(idle > 0) {
+            if(m_idle.compare_exchange_weak(idle, idle - 1, memory_order_relaxed)) {
+                m_tokens.fetch_add(1, memory_order_release);
+                syscall(SYS_futex, &m_tokens, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+                return;
+            }
+        }
+    }
+
+    // 唤醒所有睡眠者（线程池结束），threads是线程总数
+    void unpark_all(int threads) {
+        m_tokens.fetch_add(threads, memory_order_release);
+        syscall(SYS_futex, &m_tokens, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+
+private:
+    // 撤销睡眠登记；已经被认领了返回false（令牌一定会来，要等着把它消耗掉）
+    bool unregister() {
+        int idle = m_idle.load(memory_order_relaxed);
+        while(idle > 0) {
+            if(m_idle.compare_exchange_weak(idle, idle - 1, memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+private:
+    // 两个计数都会被提交者和工作线程频繁访问，各占一个缓存行
+    alignas(64) atomic<int> m_idle;
+    alignas(64) atomic<int> m_tokens;   // futex系统调用要求是对齐的32位整数
+    int m_spin;
+};
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef QUEUE_POLICY_H
+#define QUEUE_POLICY_H
+
+#include <atomic>
+#include <exception>
+#include <sched.h>
+#include "../locker/locker.h"
+#include "work_deque.h"
+using namespace std;
+
+/**
+ * 线程池的任务队列策略（ThreadPool的第二个模板参数），需要提供：
+ *   Queue(int workers, int capacity)   capacity是线程池的任务上限，线程池保证队列中的任务不会超过它
+ *   void push(T * task, int self)      任意线程调用；self是当前工作线程的下标，不是工作线程时为-1
+ *   T * pop(int self)                  工作线程调用，没有任务返回NULL
+ *   bool empty() const                 近似判断，睡眠前最后检查一次
+ * 所有策略入队出队都不分配内存
+ *
+ *  Steal_Queue   每个工作线程一个Chase-Lev双端队列 + 全局注入队列 + 随机窃取（默认）
+ *  Ring_Queue    一个有界无锁MPMC环形队列，更轻，没有窃取
+*/
+
+// 每个工作线程本地队列的容量
+const int POOL_LOCAL_CAPACITY = 256;
+// 从全局队列一次最多搬到本地队列的任务数
+const int POOL_BATCH_SIZE = 32;
+// 每执行这么多个任务先看一次全局队列，本地队列一直不空时全局队列里的任务也不会饿死
+const int POOL_GLOBAL_INTERVAL = 61;
+
+/**
+ * 全局注入队列：事件循环线程（不是工作线程）提交的任务先放在这里，工作线程成批取走
+ * 有界环形数组，容量就是线程池的任务上限
+*/
+template <class T>
+class Inject_Queue {
+public:
+    explicit Inject_Queue(int capacity) : m_items(new T *[capacity]), m_capacity(capacity), m_head(0), m_count(0) {}
+    ~Inject_Queue() { delete [] m_items; }
+
+    Inject_Queue(const Inject_Queue &) = delete;
+    Inject_Queue & operator=(const Inject_Queue &) = delete;
+
+    // 满了返回false（线程池已经用任务总数限制了，正常不会满）
+    bool push(T * item) {
+        m_lock.lock();
+        if(m_count.load(memory_order_relaxed) == m_capacity) {
+            m_lock.unlock();
+            return false;
+        }
+        m_items[(m_head + m_count.load(memory_order_relaxed)) % m_capacity] = item;
+        m_count.store(m_count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        m_lock.unlock();
+        return true;
+    }
+
+    // 取出最多max个任务（先进先出），返回取出的个数
+    int pop_batch(T ** out, int max) {
+        m_lock.lock();
+        int n = m_count.load(memory_order_relaxed);
+        if(n > max) {
+            n = max;
+        }
+        for(int i = 0; i < n; i++) {
+            out[i] = m_items[m_head];
+            m_head = (m_head + 1) % m_capacity;
+        }
+        m_count.store(m_count.load(memory_order_relaxed) - n, memory_order_relaxed);
+        m_lock.unlock();
+        return n;
+    }
+
+    // 不加锁读到的个数，只用来判断要不要去取、取多少
+    int size() const { return m_count.load(memory_order_relaxed); }
+
+private:
+    Locker m_lock;
+    T ** m_items;
+    int m_capacity;
+    int m_head;
+    atomic<int> m_count;
+};
+
+/**
+ * 工作窃取：
+ *  - 工作线程自己提交的任务放进自己的Chase-Lev双端队列，不和别人竞争
+ *  - 事件循环提交的任务放进全局注入队列，工作线程本地没有任务时一次搬走一批，
+ *    一把锁的临界区只在搬运时进入一次，而不是每个任务进一次
+ *  - 本地和全局都没有任务时，从随机的一个工作线程开始依次窃取
+*/
+template <class T>
+class Steal_Queue {
+public:
+    Steal_Queue(int workers, int capacity);
+    ~Steal_Queue();
+
+    Steal_Queue(const Steal_Queue &) = delete;
+    Steal_Queue & operator=(const Steal_Queue &) = delete;
+
+    void push(T * task, int self);
+    T * pop(int self);
+    bool empty() const;
+
+private:
+    // 每个工作线程的状态
+    struct Worker {
+        unsigned seed;      // 选择窃取对象的随机数状态
+        unsigned tick;      // 取过的任务数，用来定期检查全局队列
+        Work_Deque<T> deque;
+
+        explicit Worker(int i) : seed(i * 2654435761u + 1), tick(0), deque(POOL_LOCAL_CAPACITY) {}
+    };
+
+    // 从全局队列搬一批任务，第一个直接返回，其余的放进本地队列
+    T * take_global(Worker * self);
+
+    // 从随机的工作线程开始依次窃取
+    T * steal(Worker * self);
+
+private:
+    int m_worker_number;
+    Worker ** m_workers;
+    Inject_Queue<T> m_inject;
+};
+
+template <class T>
+Steal_Queue<T>::Steal_Queue(int workers, int capacity)
+    : m_worker_number(workers), m_workers(new Worker *[workers]), m_inject(capacity) {
+    for(int i = 0; i < workers; i++) {
+        m_workers[i] = new Worker(i);
+    }
+}
+
+template <class T>
+Steal_Queue<T>::~Steal_Queue() {
+    for(int i = 0; i < m_worker_number; i++) {
+        delete m_workers[i];
+    }
+    delete [] m_workers;
+}
+
+template <class T>
+void Steal_Queue<T>::push(T * task, int self) {
+    if(self < 0 || !m_workers[self]->deque.push(task)) {
+        // 任务总数不超过线程池的上限，全局队列的容量就是这个上限，一定放得下
+        m_inject.push(task);
+    }
+}
+
+template <class T>
+bool Steal_Queue<T>::empty() const {
+    if(m_inject.size() > 0) {
+        return false;
+    }
+    for(int i = 0; i < m_worker_number; i++) {
+        if(m_workers[i]->deque.size() > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T>
+T * Steal_Queue<T>::take_global(Worker * self) {
+    int n = m_inject.size();
+    if(n == 0) {
+        return NULL;
+    }
+    // 每个线程只拿平均分到的那一份，剩下的留给其他线程，本地队列放不下的也不拿
+    n = n / m_worker_number + 1;
+    int room = self->deque.capacity() - self->deque.size() + 1;
+    if(n > room) {
+        n = room;
+    }
+    if(n > POOL_BATCH_SIZE) {
+        n = POOL_BATCH_SIZE;
+    }
+    T * batch[POOL_BATCH_SIZE];
+    n = m_inject.pop_batch(batch, n);
+    if(n == 0) {
+        return NULL;
+    }
+    // 倒着放进本地队列，自己从底部取的时候还是先进先出
+    for(int i = n - 1; i > 0; i--) {
+        self->deque.push(batch[i]);
+    }
+    return batch[0];
+}
+
+template <class T>
+T * Steal_Queue<T>::steal(Worker * self) {
+    if(m_worker_number == 1) {
+        return NULL;
+    }
+    // xorshift，每个线程从不同的位置开始，避免所有窃取者同时挤在同一个对象上
+    unsigned x = self->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    self->seed = x;
+    int start = x % m_worker_number;
+    for(int i = 0; i < m_worker_number; i++) {
+        Worker * victim = m_workers[(start + i) % m_worker_number];
+        if(victim == self) {
+            continue;
+        }
+        T * task = victim->deque.steal();
+        if(task) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+template <class T>
+T * Steal_Queue<T>::pop(int self) {
+    Worker * w = m_workers[self];
+    T * task = NULL;
+    if(++w->tick % POOL_GLOBAL_INTERVAL == 0) {
+        task = take_global(w);
+    }
+    if(!task) {
+        task = w->deque.pop();
+    }
+    if(!task) {
+        task = take_global(w);
+    }
+    if(!task) {
+        task = steal(w);
+    }
+    return task;
+}
+
+/**
+ * 有界无锁MPMC环形队列（Vyukov的算法）
+ * 每个槽位带一个序号：序号等于入队位置表示空闲，等于位置+1表示已经写入，
+ * 生产者和消费者各自用一次CAS抢位置，之后只读写自己的槽位，不需要锁
+ * 入队和出队的位置计数放在不同的缓存行上，生产者和消费者不会互相使对方的缓存行失效
+ * 槽位本身不填充（一万个任务填充后要占用640KB），相邻的槽位只有在同时被两个线程访问时才会伪共享
+*/
+template <class T>
+class Ring_Queue {
+public:
+    Ring_Queue(int workers, int capacity);
+    ~Ring_Queue() { delete [] m_cells; }
+
+    Ring_Queue(const Ring_Queue &) = delete;
+    Ring_Queue & operator=(const Ring_Queue &) = delete;
+
+    void push(T * task, int self);
+    T * pop(int self);
+    bool empty() const {
+        return m_dequeue_pos.load(memory_order_relaxed) >= m_enqueue_pos.load(memory_order_relaxed);
+    }
+
+private:
+    struct Cell {
+        atomic<size_t> seq;
+        T * task;
+    };
+
+    alignas(64) atomic<size_t> m_enqueue_pos;
+    alignas(64) atomic<size_t> m_dequeue_pos;
+    alignas(64) Cell * m_cells;
+    size_t m_mask;
+};
+
+template <class T>
+Ring_Queue<T>::Ring_Queue(int, int capacity) : m_enqueue_pos(0), m_dequeue_pos(0), m_cells(NULL), m_mask(0) {
+    if(capacity <= 0) {
+        throw exception();
+    }
+    // 容量向上取整到2的幂，下标用与运算
+    size_t size = 1;
+    while(size < (size_t)capacity) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_cells = new Cell[size];
+    for(size_t i = 0; i < size; i++) {
+        m_cells[i].seq.store(i, memory_order_relaxed);
+        m_cells[i].task = NULL;
+    }
+}
+
+template <class T>
+void Ring_Queue<T>::push(T * task, int) {
+    size_t pos = m_enqueue_pos.load(memory_order_relaxed);
+    while(true) {
+        Cell * cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+        if(diff == 0) {
+            if(m_enqueue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                cell->task = task;
+                // 发布：消费者看到新的序号时一定能看到任务
+                cell->seq.store(pos + 1, memory_order_release);
+                return;
+            }
+        } else {
+            // 位置被别的生产者抢走了，重新读；线程池在槽位释放之后才减少任务数，所以不会遇到满的情况
+            pos = m_enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+}
+
+template <class T>
+T * Ring_Queue<T>::pop(int) {
+    size_t pos = m_dequeue_pos.load(memory_order_relaxed);
+    while(true) {
+        Cell * cell = &m_cells[pos & m_mask];
+        size_t seq = cell->seq.load(memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+        if(diff == 0) {
+            if(m_dequeue_pos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                T * task = cell->task;
+                // 槽位留给下一圈的生产者
+                cell->seq.store(pos + m_mask + 1, memory_order_release);
+                return task;
+            }
+        } else if(diff < 0) {
+            // 没有生产者抢到这个位置，队列是空的
+            if((long)(m_enqueue_pos.load(memory_order_acquire) - pos) <= 0) {
+                return NULL;
+            }
+            // 生产者抢到了位置还没有写完（只差一次store），empty()已经认为不空了，
+            // 这里返回NULL工作线程会一直空转，等它发布；它可能被抢占了，所以让出CPU
+            sched_yield();
+            pos = m_dequeue_pos.load(memory_order_relaxed);
+        } else {
+            pos = m_dequeue_pos.load(memory_order_relaxed);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+using namespace std;
+
+// 可调用对象不超过这么多字节时直接放在Task内部，不分配内存
+// 48字节放得下几个指针加一个string，Task本身正好占一个缓存行
+const int TASK_INLINE_SIZE = 48;
+
+/**
+ * 类型擦除的任务：可以保存任意无参数的可调用对象（lambda、函数指针、函数对象），只能移动不能复制
+ * - 可调用对象不超过TASK_INLINE_SIZE字节、对齐不超过max_align_t、移动构造不抛异常时，
+ *   直接构造在内部的缓冲区里（小缓冲区优化），否则在堆上分配
+ * - 调用、移动和析构通过每个类型一张的静态函数表完成，Task本身只多一个指针
+ * 和std::function相比：不要求可复制（可以捕获unique_ptr、promise），内部缓冲区更大
+*/
+class Task {
+public:
+    Task() : m_ops(NULL) {}
+
+    template <class F, class = typename enable_if<!is_same<typename decay<F>::type, Task>::value>::type>
+    Task(F && f) : m_ops(NULL) {
+        assign(forward<F>(f));
+    }
+
+    Task(Task && other) noexcept : m_ops(other.m_ops) {
+        if(m_ops) {
+            m_ops->move(&other, this);
+            other.m_ops = NULL;
+        }
+    }
+
+    Task & operator=(Task && other) noexcept {
+        if(this != &other) {
+            reset();
+            m_ops = other.m_ops;
+            if(m_ops) {
+                m_ops->move(&other, this);
+                other.m_ops = NULL;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task & operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    // 执行任务（必须不是空的）
+    void operator()() { m_ops->invoke(this); }
+
+    // 是否保存了可调用对象
+    explicit operator bool() const { return m_ops != NULL; }
+
+    // 析构保存的可调用对象，变成空的
+    void reset() {
+        if(m_ops) {
+            m_ops->destroy(this);
+            m_ops = NULL;
+        }
+    }
+
+    // 这个类型的可调用对象能不能放在内部的缓冲区里
+    template <class F>
+    static constexpr bool fits_inline() {
+        return sizeof(F) <= TASK_INLINE_SIZE && alignof(F) <= alignof(max_align_t)
+            && is_nothrow_move_constructible<F>::value;
+    }
+
+private:
+    // 每个可调用对象类型一张函数表
+    struct Ops {
+        void (*invoke)(Task * self);
+        void (*move)(Task * from, Task * to);  // 把from中的对象移动到to，之后from中的对象已经析构
+        void (*destroy)(Task * self);
+    };
+
+    // 对象直接构造在缓冲区里
+    template <class F>
+    struct Inline_Ops {
+        static F * get(Task * t) { return reinterpret_cast<F *>(t->m_storage); }
+        static void invoke(Task * t) { (*get(t))(); }
+        static void move(Task * from, Task * to) {
+            new (to->m_storage) F(std::move(*get(from)));
+            get(from)->~F();
+        }
+        static void destroy(Task * t) { get(t)->~F(); }
+        static constexpr Ops ops = {&invoke, &move, &destroy};
+    };
+
+    // 缓冲区里只放一个指向堆上对象的指针，移动时只复制指针
+    template <class F>
+    struct Heap_Ops {
+        static F *& get(Task * t) { return *reinterpret_cast<F **>(t->m_storage); }
+        static void invoke(Task * t) { (*get(t))(); }
+        static void move(Task * from, Task * to) { new (to->m_storage) F *(get(from)); }
+        static void destroy(Task * t) { delete get(t); }
+        static constexpr Ops ops = {&invoke, &move, &destroy};
+    };
+
+    template <class F>
+    void assign(F && f) {
+        typedef typename decay<F>::type Fn;
+        if constexpr(fits_inline<Fn>()) {
+            new (m_storage) Fn(forward<F>(f));
+            m_ops = &Inline_Ops<Fn>::ops;
+        } else {
+            new (m_storage) Fn *(new Fn(forward<F>(f)));
+            m_ops = &Heap_Ops<Fn>::ops;
+        }
+    }
+
+private:
+    alignas(max_align_t) unsigned char m_storage[TASK_INLINE_SIZE];
+    const Ops * m_ops;
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <exception>
+#include <future>
+#include <optional>
+#include <type_traits>
+#include "threadpool.h"
+#include "task.h"
+using namespace std;
+
+/**
+ * 线程池中的一个任务节点，保存一个Task
+ * 节点在线程池创建时一次分配好，放在空闲链表（一个无锁环形队列）里，提交任务时取一个，执行完放回去
+*/
+struct Task_Node {
+    int m_state;                        // ThreadPool::addRequest需要，这里不使用
+    Ring_Queue<Task_Node> * m_free;     // 执行完之后放回的空闲链表
+    Task task;
+
+    void process() {
+        task();
+        task.reset();
+        m_free->push(this, -1);
+    }
+};
+
+/**
+ * 可以执行任意任务的线程池：ThreadPool<Task_Node>加上预先分配的任务节点
+ * 定时器回调、压缩、数据库和日志这类后台任务都交给同一个线程池调度，
+ * 和HTTP请求一样按代价类别排队（见threadpool.h的TASK_CLASS）
+ *  - submit            提交任务，不返回结果；捕获不超过TASK_INLINE_SIZE字节时没有任何内存分配
+ *  - submit_future     需要结果（或者异常）时使用，返回std::future；future的共享状态需要分配一次内存
+ * 任务不能抛出异常（和工作线程里的其他任务一样），需要把异常带回来时用submit_future
+ * 线程池满了（和addRequest一样）提交返回false / nullopt，由调用者决定放弃还是重试
+*/
+class Task_Pool {
+public:
+    // 参数和ThreadPool相同
+    Task_Pool(int thread_number = 8, int max_request = 10000, int min_thread = 0)
+        : m_nodes(NULL), m_free(NULL), m_pool(NULL) {
+        if(thread_number <= 0 || max_request <= 0) {
+            throw exception();
+        }
+        // 线程池中排队的任务不超过max_request，每个工作线程还可能有一个正在执行的任务，
+        // 节点按两者之和分配，通过了线程池的任务数检查就一定能取到节点
+        int count = max_request + thread_number;
+        m_nodes = new Task_Node[count];
+        m_free = new Ring_Queue<Task_Node>(thread_number, count);
+        for(int i = 0; i < count; i++) {
+            m_nodes[i].m_free = m_free;
+            m_free->push(m_nodes + i, -1);
+        }
+        m_pool = new ThreadPool<Task_Node>(thread_number, max_request, min_thread);
+    }
+
+    // 先析构线程池（执行完剩下的任务，节点都放回空闲链表），再释放节点
+    ~Task_Pool() {
+        delete m_pool;
+        delete m_free;
+        delete [] m_nodes;
+    }
+
+    Task_Pool(const Task_Pool &) = delete;
+    Task_Pool & operator=(const Task_Pool &) = delete;
+
+    // 提交一个任务，cls是代价类别
+    template <class F>
+    bool submit(F && f, int cls = TASK_NORMAL) {
+        Task_Node * node = m_free->pop(-1);
+        if(!node) {
+            return false;
+        }
+        node->task = Task(forward<F>(f));
+        if(!m_pool->addRequest(node, 0, cls)) {
+            node->task.reset();
+            m_free->push(node, -1);
+            return false;
+        }
+        return true;
+    }
+
+    // 提交一个任务，通过future取得它的返回值或者抛出的异常
+    template <class F, class R = typename invoke_result<typename decay<F>::type>::type>
+    optional<future<R>> submit_future(F && f, int cls = TASK_NORMAL) {
+        promise<R> result;
+        future<R> fut = result.get_future();
+        if(!submit(Future_Call<typename decay<F>::type, R>(forward<F>(f), std::move(result)), cls)) {
+            return nullopt;
+        }
+        return optional<future<R>>(std::move(fut));
+    }
+
+    // 每个代价类别的任务数和延迟，见ThreadPool::latency_report
+    void latency_report(Latency_Stat stats[POOL_CLASS_NUM]) { m_pool->latency_report(stats); }
+
+    // 当前的线程数
+    int thread_count() const { return m_pool->thread_count(); }
+
+private:
+    // 执行可调用对象，把结果或者异常交给promise
+    template <class F, class R>
+    struct Future_Call {
+        F fn;
+        promise<R> result;
+
+        template <class G>
+        Future_Call(G && g, promise<R> && p) : fn(forward<G>(g)), result(std::move(p)) {}
+
+        void operator()() {
+            try {
+                set(is_void<R>());
+            } catch(...) {
+                result.set_exception(current_exception());
+            }
+        }
+        void set(true_type) { fn(); result.set_value(); }
+        void set(false_type) { result.set_value(fn()); }
+    };
+
+private:
+    Task_Node * m_nodes;                // 所有任务节点
+    Ring_Queue<Task_Node> * m_free;     // 空闲的任务节点
+    ThreadPool<Task_Node> * m_pool;
+};
+
+#endif
@@ -4,154 +4,589 @@
 
 #include <pthread.h>
 #include <exception>
-#include <list>
+#include <atomic>
 #include <cstdio>
+#include <ctime>
 #include "../locker/locker.h"
+#include "queue_policy.h"
+#include "parker.h"
 using namespace std;
 
+// 任务在队列中等待超过这么多毫秒，说明线程不够用了，增加一个线程
+const int POOL_GROW_WAIT_MS = 5;
+// 两次增加线程之间至少间隔这么多毫秒，新线程还没来得及消化积压时不会一下子加满
+const int POOL_GROW_INTERVAL_MS = 5;
+// 空闲超过这么多毫秒的线程退出（线程数不低于下限）
+const int POOL_IDLE_TIMEOUT_MS = 30000;
+
+// 任务的代价类别，每个类别一个队列（优先级通道）
+//  - TASK_CHEAP      很快就能完成的任务，比如命中缓存的小文件
+//  - TASK_NORMAL     不知道代价的任务（默认）
+//  - TASK_EXPENSIVE  要占用工作线程很久的任务，比如大文件、在线压缩
+enum TASK_CLASS { TASK_CHEAP = 0, TASK_NORMAL, TASK_EXPENSIVE };
+const int POOL_CLASS_NUM = 3;
+// 各个类别的权重：所有类别都有任务时，每13个任务中按8:4:1取
+// 只要有一个类别不空就不会让线程闲着，空的类别的份额让给其他类别
+const int POOL_CLASS_WEIGHT[POOL_CLASS_NUM] = {8, 4, 1};
+// 每个类别每这么多个任务记录一次入队时间（读一次时钟），用于统计延迟和判断要不要增加线程
+// 每个任务都读时钟，空任务的吞吐会下降三分之一，抽样之后的分位数在任务多的时候一样准确
+const int POOL_LATENCY_SAMPLE = 8;
+// 延迟直方图的桶数：16微秒以下每微秒一个桶，之后每个2的幂区间分8个桶（误差不超过12.5%），最大约67秒
+const int POOL_LATENCY_BUCKETS = 16 + 23 * 8;
+
+// 一个类别在一段时间内执行完的任务数和延迟（从入队到执行完，单位微秒，按抽样的任务统计，没有抽样到时为-1）
+struct Latency_Stat {
+    unsigned long count;
+    long p50_us;
+    long p99_us;
+};
+
 /**
  * 线程池类，保存了一定数量的线程，用于处理业务
  * 为了让任务更加通用，采用模板的形式定义线程池，为了使得任务类型可以通用
+ *
+ * 任务队列由第二个模板参数决定（见queue_policy.h）：默认是工作窃取的Steal_Queue，
+ * 也可以换成更轻的无锁环形队列Ring_Queue
+ * 没有任务的工作线程先自旋一会儿再睡眠在futex上（见parker.h），
+ * 提交任务时只有存在睡眠的线程才会有系统调用
+ * 所有队列中的任务总数不超过max_request，超过时addRequest返回false（和原来一样由调用者处理）
+ *
+ * 线程数在min_thread和thread_number之间伸缩（min_thread不指定时线程数固定）：
+ *  - 任务入队时记下时间，出队时就知道它在队列中等了多久，超过POOL_GROW_WAIT_MS就增加一个线程
+ *  - 所有线程都卡在慢任务上时不会有任务出队，所以入队时也看一下队头的任务等了多久
+ *  - 空闲超过POOL_IDLE_TIMEOUT_MS的线程退出
+ * 析构时不再接受新任务，线程把队列中剩下的任务执行完再退出，析构函数等待（join）所有线程
+ *
+ * 任务按代价类别（TASK_CLASS）放进不同的队列，便宜的任务不会排在昂贵的任务后面：
+ *  - 每个工作线程用平滑加权轮询（和nginx的upstream一样）决定这一次先取哪个类别，
+ *    选中的类别是空的就按优先级取其他类别，实际取到的类别扣除份额
+ *  - 每个工作线程按类别记录任务数和抽样任务的延迟直方图（只有自己写，没有竞争），
+ *    latency_report汇总出每个类别的p50和p99
 */
-template <class T>
+template <class T, class Queue = Steal_Queue<T>>
 class ThreadPool {
 public:
     // 初始化线程池的默认构造函数
-    ThreadPool(int thread_number = 8, int max_request = 10000);
+    // thread_number是线程数的上限，min_thread是下限，小于等于0时和上限相同
+    ThreadPool(int thread_number = 8, int max_request = 10000, int min_thread = 0);
 
-    // 析构函数
+    // 析构函数：执行完已经提交的任务，等待所有线程退出
     ~ThreadPool();
 
     // 添加任务（请求）到线程池的请求队列中
     bool addRequest(T * request);
 
+    // Reactor模式下添加任务，state表示工作线程要做的事情 0:读 1:写
+    bool addRequest(T * request, int state);
+
+    // 按代价类别添加任务，cls取值见TASK_CLASS（不指定时是TASK_NORMAL）
+    bool addRequest(T * request, int state, int cls);
+
+    // 上一次调用之后执行完的任务，每个类别的任务数和延迟，只能由一个线程调用
+    void latency_report(Latency_Stat stats[POOL_CLASS_NUM]);
+
+    // 当前的线程数
+    int thread_count() const { return m_live.load(memory_order_relaxed); }
+
 private:
+    // 线程槽位的状态
+    enum SLOT_STATE { SLOT_FREE = 0, SLOT_RUNNING, SLOT_EXITED };
+
+    // 一个线程槽位，下标就是这个线程在任务队列中的下标
+    // 轮询的状态和直方图只有这个线程写，槽位按缓存行对齐，线程之间不会伪共享
+    struct alignas(64) Slot {
+        ThreadPool * pool;
+        int index;
+        pthread_t thread;
+        SLOT_STATE state;   // 由m_resize_locker保护
+        int credit[POOL_CLASS_NUM];
+        atomic<unsigned long> tasks[POOL_CLASS_NUM];
+        atomic<unsigned> latency[POOL_CLASS_NUM][POOL_LATENCY_BUCKETS];
+    };
+
+    // 一个类别的队列
+    // 抽样任务的入队时间按入队序号存放，第n个出队的任务近似当作第n个入队的（窃取会打乱顺序，这里只需要估计）
+    // 入队和出队的计数也用来判断这个类别是不是空的，取任务时跳过空的类别
+    struct Lane {
+        Queue * queue;
+        atomic<long> * stamps;
+        alignas(64) atomic<unsigned long> enqueued;
+        alignas(64) atomic<unsigned long> dequeued;
+    };
+
     // 每隔线程池的业务处理函数
     static void * worker(void * arg);
 
     // 线程池取数据的函数
-    void run();
+    void run(int index);
+
+    // 占用一个任务名额，任务总数已经到上限或者线程池正在结束返回false
+    bool reserve();
+
+    // 放入任务并唤醒一个睡眠的工作线程
+    void enqueue(T * request, int cls);
+
+    // 按加权轮询取一个任务，cls返回它的类别，stamp返回它的入队时间（不是抽样的任务为0）
+    // filter为true时跳过看起来是空的类别（按入队出队计数判断），线程池结束前最后一次取不跳过
+    T * take(Slot & self, bool filter, int & cls, long & stamp);
+
+    // 所有类别的队列都是空的
+    bool empty() const;
+
+    // 在一个空闲的槽位上创建线程，调用者持有m_resize_locker
+    bool spawn();
+
+    // 任务等待太久时增加一个线程
+    void grow(long now);
+
+    // 空闲超时的线程退出前调用，线程数已经到下限时返回false（继续等待任务）
+    bool retire(int index);
+
+    // 停止接受任务，等所有线程执行完剩下的任务并退出，释放资源
+    void shutdown();
+
+    // 微秒级的单调时间，由vDSO直接读取，不进入内核
+    // 粗粒度的时钟精度只有几毫秒，量不出便宜任务的延迟
+    static long now_us() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    // 延迟（微秒）和直方图桶的对应关系
+    static int bucket_of(long us);
+    static long bucket_value(int bucket);
 
 private:
     // 定义线程属性
-    // 线程的数量
+    // 线程数的上限和下限
     int m_thread_number;
-
-    // 线程池数组
-    pthread_t * m_threads;
+    int m_min_thread;
 
     // 请求队列中的最大数量
     int m_max_request;
 
-    // 请求队列
-    list<T *> m_work_queue;
+    // 线程槽位数组，按上限分配
+    Slot * m_slots;
 
-    // 互斥锁
-    Locker m_queue_locker;
+    // 每个类别的任务队列
+    Lane m_lanes[POOL_CLASS_NUM];
+    unsigned long m_stamp_mask;
 
-    // 信号量，用来判断是否有任务需要处理
-    Semaphore m_queue_stat;
+    // 所有队列中还没有开始执行的任务数
+    atomic<int> m_pending;
+
+    // 上一次latency_report时每个类别的累计任务数、每个桶的累计抽样数
+    unsigned long m_reported_tasks[POOL_CLASS_NUM];
+    unsigned long * m_reported;
+
+    // 正在运行的线程数，上一次增加线程的时间
+    atomic<int> m_live;
+    atomic<long> m_last_grow;
+
+    // 创建和回收线程时加锁（很少发生）
+    Locker m_resize_locker;
+
+    // 工作线程的睡眠和唤醒
+    Parker m_parker;
 
     // 是否结束线程
-    bool m_stop;
+    atomic<bool> m_stop;
+
+    // 当前线程属于哪个线程池、是第几个工作线程（不是工作线程时t_pool为NULL）
+    static thread_local ThreadPool * t_pool;
+    static thread_local int t_index;
 };
 
-template <typename T>
-ThreadPool<T>::ThreadPool(int thread_number, int max_request) : 
-    m_thread_number(thread_number), m_max_request(max_request), m_threads(NULL) {
-        
+template <typename T, typename Queue>
+thread_local ThreadPool<T, Queue> * ThreadPool<T, Queue>::t_pool = NULL;
+
+template <typename T, typename Queue>
+thread_local int ThreadPool<T, Queue>::t_index = -1;
+
+template <typename T, typename Queue>
+ThreadPool<T, Queue>::ThreadPool(int thread_number, int max_request, int min_thread) :
+    m_thread_number(thread_number), m_min_thread(min_thread), m_max_request(max_request), m_slots(NULL),
+    m_stamp_mask(0), m_pending(0), m_reported(NULL), m_live(0), m_last_grow(0), m_stop(false) {
+
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        m_lanes[c].queue = NULL;
+        m_lanes[c].stamps = NULL;
+        m_lanes[c].enqueued.store(0, memory_order_relaxed);
+        m_lanes[c].dequeued.store(0, memory_order_relaxed);
+        m_reported_tasks[c] = 0;
+    }
+
     // 如果传入的数据都不正确，直接抛出异常
     if(thread_number <= 0 || max_request <= 0) {
         throw exception();
     }
+    if(m_min_thread <= 0 || m_min_thread > m_thread_number) {
+        m_min_thread = m_thread_number;
+    }
 
-    // 初始化m_thread_number大小的thread
-    m_threads = new pthread_t[m_thread_number];
-    if(!m_threads) {
-        throw exception();
+    // 队列按任务上限一次分配好，之后入队出队都不再分配内存
+    unsigned long size = 1;
+    while(size < (unsigned long)m_max_request) {
+        size <<= 1;
+    }
+    m_stamp_mask = size - 1;
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        m_lanes[c].queue = new Queue(m_thread_number, m_max_request);
+        m_lanes[c].stamps = new atomic<long>[size];
+        for(unsigned long i = 0; i < size; i++) {
+            m_lanes[c].stamps[i].store(0, memory_order_relaxed);
+        }
     }
+    m_reported = new unsigned long[POOL_CLASS_NUM * POOL_LATENCY_BUCKETS]();
 
-    // 创建m_thread_number个线程，并将它们设置为线程分离（销毁了自己释放资源）
+    // 先创建min_thread个线程，其余的等负载高了再创建
+    m_slots = new Slot[m_thread_number];
     for(int i = 0; i < m_thread_number; i++) {
-        printf("create the %d thread now...\n", i);
-        // 这里就是巧妙点，在创建线程时，直接利用m_threads + i创建到数组中
-        // 属性设置为NULL
-        // worker必须为静态方法（反正必须在全局区）
-        // 参数现在就传递NULL
-        if(pthread_create(m_threads + i, NULL, worker, this) != 0) {
-            delete [] m_threads; // 创建失败了，会把线程池的线程都释放掉，再抛出异常
+        m_slots[i].pool = this;
+        m_slots[i].index = i;
+        m_slots[i].state = SLOT_FREE;
+        for(int c = 0; c < POOL_CLASS_NUM; c++) {
+            m_slots[i].credit[c] = 0;
+            m_slots[i].tasks[c].store(0, memory_order_relaxed);
+            for(int b = 0; b < POOL_LATENCY_BUCKETS; b++) {
+                m_slots[i].latency[c][b].store(0, memory_order_relaxed);
+            }
+        }
+    }
+    m_resize_locker.lock();
+    for(int i = 0; i < m_min_thread; i++) {
+        if(!spawn()) {
+            m_resize_locker.unlock();
+            shutdown(); // 创建失败了，会把线程池的线程都回收掉，再抛出异常
             throw exception();
         }
+    }
+    m_resize_locker.unlock();
+}
 
-        // 线程分离
-        if(pthread_detach(m_threads[i])) {
-            delete [] m_threads; // 创建失败了，会把线程池的线程都释放掉，再抛出异常
-            throw exception();
+template <typename T, typename Queue>
+ThreadPool<T, Queue>::~ThreadPool() {
+    shutdown();
+}
+
+template <typename T, typename Queue>
+void ThreadPool<T, Queue>::shutdown() {
+    // 1.不再接受新任务，也不再创建线程（和grow互斥，之后不会有新的槽位被占用）
+    m_resize_locker.lock();
+    m_stop = true;
+    m_resize_locker.unlock();
+    // 2.唤醒所有睡眠的线程，它们把队列中剩下的任务执行完之后退出
+    m_parker.unpark_all(m_thread_number);
+    // 3.等待所有线程退出，包括之前空闲退出、还没有回收的
+    for(int i = 0; i < m_thread_number; i++) {
+        if(m_slots[i].state != SLOT_FREE) {
+            pthread_join(m_slots[i].thread, NULL);
+            m_slots[i].state = SLOT_FREE;
+        }
+    }
+    // 4.已经没有线程访问了，释放资源
+    delete [] m_slots;
+    m_slots = NULL;
+    delete [] m_reported;
+    m_reported = NULL;
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        delete [] m_lanes[c].stamps;
+        m_lanes[c].stamps = NULL;
+        delete m_lanes[c].queue;
+        m_lanes[c].queue = NULL;
+    }
+}
+
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::spawn() {
+    for(int i = 0; i < m_thread_number; i++) {
+        Slot & slot = m_slots[i];
+        if(slot.state == SLOT_RUNNING) {
+            continue;
+        }
+        if(slot.state == SLOT_EXITED) {
+            // 回收之前空闲退出的线程，它已经离开run了，join不会等多久
+            pthread_join(slot.thread, NULL);
+            slot.state = SLOT_FREE;
+        }
+        printf("create the %d thread now...\n", i);
+        // worker必须为静态方法，参数是这个线程的槽位
+        if(pthread_create(&slot.thread, NULL, worker, &slot) != 0) {
+            return false;
         }
+        slot.state = SLOT_RUNNING;
+        m_live.fetch_add(1, memory_order_relaxed);
+        return true;
     }
+    return false;
 }
 
-template <typename T>
-ThreadPool<T>::~ThreadPool() {
-    delete [] m_threads; // 释放线程池资源
-    m_stop = true; // 设置线程池结束，否则就会循环执行代码（后续代码会体现）
+template <typename T, typename Queue>
+void ThreadPool<T, Queue>::grow(long now) {
+    // 同一时间只有一个线程去创建，并且限制创建的速度
+    long last = m_last_grow.load(memory_order_relaxed);
+    if(now - last < POOL_GROW_INTERVAL_MS * 1000L || !m_last_grow.compare_exchange_strong(last, now, memory_order_relaxed)) {
+        return;
+    }
+    m_resize_locker.lock();
+    if(!m_stop.load(memory_order_relaxed) && m_live.load(memory_order_relaxed) < m_thread_number) {
+        spawn();
+    }
+    m_resize_locker.unlock();
 }
 
-template <typename T>
-bool ThreadPool<T>::addRequest(T * request) {
-    // 目的是向队列中添加数据（但要保证线程同步的）
-    m_queue_locker.lock(); // 上锁
-    
-    if(m_work_queue.size() > m_max_request) {
-        // 如果任务队列已经不能放了，就解锁返回
-        m_queue_locker.unlock();
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::retire(int index) {
+    m_resize_locker.lock();
+    if(m_stop.load(memory_order_relaxed) || m_live.load(memory_order_relaxed) <= m_min_thread) {
+        m_resize_locker.unlock();
         return false;
     }
-    // 否则向任务队列里添加一个任务
-    m_work_queue.push_back(request);
-    m_queue_locker.unlock(); // 解锁
-    // 信号量要增加，因为后续取数据的时候，需要根据信号量判断是否阻塞
-    m_queue_stat.post();
+    // 线程不能join自己，标记之后由下一次创建线程或者析构函数回收
+    m_slots[index].state = SLOT_EXITED;
+    m_live.fetch_sub(1, memory_order_relaxed);
+    m_resize_locker.unlock();
     return true;
 }
 
-template <typename T>
-void ThreadPool<T>::run() {
-    // 线程池的运行函数
-    // 线程池的线程需要一直循环，直到m_stop为false的时候停止
-    // ***相当于主线程或者就是为了判断是否执行结束的
-    while(!m_stop) {
-        // 1.从任务队列取一个任务
-        // 这里通过信号量来判断一下
-        m_queue_stat.wait();
-        // 2.上锁
-        m_queue_locker.lock();
-        // 3.操作队列
-        if(m_work_queue.empty()){
-            // 如果说队列都没有数据了，就不用做了
-            m_queue_locker.unlock();
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::reserve() {
+    if(m_stop.load(memory_order_relaxed)) {
+        return false;
+    }
+    if(m_pending.fetch_add(1, memory_order_relaxed) >= m_max_request) {
+        // 如果任务队列已经不能放了，就返回
+        m_pending.fetch_sub(1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+template <typename T, typename Queue>
+void ThreadPool<T, Queue>::enqueue(T * request, int cls) {
+    Lane & lane = m_lanes[cls];
+    unsigned long seq = lane.enqueued.fetch_add(1, memory_order_relaxed);
+    if(seq % POOL_LATENCY_SAMPLE != 0) {
+        lane.queue->push(request, (t_pool == this) ? t_index : -1);
+        m_parker.unpark_one();
+        return;
+    }
+    long now = now_us();
+    lane.stamps[seq & m_stamp_mask].store(now, memory_order_relaxed);
+    lane.queue->push(request, (t_pool == this) ? t_index : -1);
+    m_parker.unpark_one();
+    // 所有线程都在执行慢任务时没有任务出队，看一下队头之后第一个抽样的任务已经等了多久
+    if(m_live.load(memory_order_relaxed) < m_thread_number) {
+        unsigned long head = lane.dequeued.load(memory_order_relaxed);
+        head = (head + POOL_LATENCY_SAMPLE - 1) / POOL_LATENCY_SAMPLE * POOL_LATENCY_SAMPLE;
+        if(head < seq && now - lane.stamps[head & m_stamp_mask].load(memory_order_relaxed) >= POOL_GROW_WAIT_MS * 1000L) {
+            grow(now);
+        }
+    }
+}
+
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::addRequest(T * request) {
+    if(!reserve()) {
+        return false;
+    }
+    enqueue(request, TASK_NORMAL);
+    return true;
+}
+
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::addRequest(T * request, int state) {
+    return addRequest(request, state, TASK_NORMAL);
+}
+
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::addRequest(T * request, int state, int cls) {
+    if(cls < 0 || cls >= POOL_CLASS_NUM) {
+        cls = TASK_NORMAL;
+    }
+    if(!reserve()) {
+        return false;
+    }
+    // 在入队之前设置任务类型，入队的release语义保证工作线程取出任务时一定能看到
+    request->m_state = state;
+    enqueue(request, cls);
+    return true;
+}
+
+template <typename T, typename Queue>
+bool ThreadPool<T, Queue>::empty() const {
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        if(!m_lanes[c].queue->empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, typename Queue>
+T * ThreadPool<T, Queue>::take(Slot & self, bool filter, int & cls, long & stamp) {
+    // 1.平滑加权轮询：每个类别加上自己的权重，选累计最多的
+    int best = 0;
+    int total = 0;
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        self.credit[c] += POOL_CLASS_WEIGHT[c];
+        total += POOL_CLASS_WEIGHT[c];
+        if(self.credit[c] > self.credit[best]) {
+            best = c;
+        }
+    }
+    // 2.先取选中的类别，它是空的就按优先级取其他类别
+    T * task = NULL;
+    for(int i = -1; !task && i < POOL_CLASS_NUM; i++) {
+        cls = (i < 0) ? best : i;
+        if(i == best) {
             continue;
         }
-        T * request = m_work_queue.front(); // 当前子线程从前面获取一个任务
-        m_work_queue.pop_front(); // 删除最前面一个
-        // 4.解锁(可以和5交换)
-        m_queue_locker.unlock();
-        // 5.判断是否获取到请求
-        if(!request) {
+        Lane & lane = m_lanes[cls];
+        if(filter && lane.dequeued.load(memory_order_relaxed) >= lane.enqueued.load(memory_order_relaxed)) {
             continue;
         }
-        // 6.当前子线程执行任务函数
+        task = lane.queue->pop(self.index);
+    }
+    if(!task) {
+        // 没有取到任务，这一轮不算
+        for(int c = 0; c < POOL_CLASS_NUM; c++) {
+            self.credit[c] -= POOL_CLASS_WEIGHT[c];
+        }
+        return NULL;
+    }
+    // 3.实际取到的类别扣除一整轮的份额
+    self.credit[cls] -= total;
+    Lane & lane = m_lanes[cls];
+    unsigned long seq = lane.dequeued.fetch_add(1, memory_order_relaxed);
+    // 入队时间在这里读出来，任务执行期间这个位置可能被新入队的任务覆盖
+    stamp = (seq % POOL_LATENCY_SAMPLE == 0) ? lane.stamps[seq & m_stamp_mask].load(memory_order_relaxed) : 0;
+    return task;
+}
+
+template <typename T, typename Queue>
+void ThreadPool<T, Queue>::run(int index) {
+    // 线程池的运行函数
+    // 线程池结束时不再立即退出，先把队列中剩下的任务执行完
+    bool elastic = (m_min_thread < m_thread_number);
+    Slot & self = m_slots[index];
+    t_pool = this;
+    t_index = index;
+    while(true) {
+        // 1.从任务队列取一个任务
+        int cls;
+        long stamp;
+        T * request = take(self, true, cls, stamp);
+        if(!request) {
+            // 队列空了并且线程池要结束了，退出（最后一次不按计数跳过，保证没有漏掉的任务）
+            if(m_stop.load(memory_order_acquire)) {
+                request = take(self, false, cls, stamp);
+                if(!request) {
+                    break;
+                }
+            } else {
+                // 2.没有任务就自旋，然后睡眠，被唤醒后重新取；空闲太久并且线程数多于下限时退出
+                bool woken = m_parker.park([this] { return !empty() || m_stop.load(memory_order_relaxed); },
+                                           elastic ? POOL_IDLE_TIMEOUT_MS : -1);
+                if(!woken && retire(index)) {
+                    break;
+                }
+                continue;
+            }
+        }
+        m_pending.fetch_sub(1, memory_order_relaxed);
+        // 3.抽样的任务在队列中等了太久，增加线程
+        if(stamp && elastic && m_live.load(memory_order_relaxed) < m_thread_number) {
+            long now = now_us();
+            if(now - stamp >= POOL_GROW_WAIT_MS * 1000L) {
+                grow(now);
+            }
+        }
+        // 4.当前子线程执行任务函数
         request->process();
+        // 5.记录任务数和抽样任务从入队到执行完的延迟，只有本线程写这些计数，不需要原子加
+        self.tasks[cls].store(self.tasks[cls].load(memory_order_relaxed) + 1, memory_order_relaxed);
+        if(stamp) {
+            atomic<unsigned> & counter = self.latency[cls][bucket_of(now_us() - stamp)];
+            counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
     }
+    t_pool = NULL;
 }
 
-template <typename T>
-void * ThreadPool<T>::worker(void * arg) {
-    // this通过参数传递到worker中（因为这个worker是一个静态函数，静态函数无法取成员属性的值），现在解析出线程池
-    ThreadPool * pool = (ThreadPool *)arg;
-    pool->run(); // 直接开跑线程池
-    return pool;
+template <typename T, typename Queue>
+void * ThreadPool<T, Queue>::worker(void * arg) {
+    // 静态函数无法取成员属性的值，通过参数传入这个线程的槽位，再找到线程池
+    Slot * slot = (Slot *)arg;
+    slot->pool->run(slot->index);
+    return NULL;
+}
+
+template <typename T, typename Queue>
+int ThreadPool<T, Queue>::bucket_of(long us) {
+    if(us < 16) {
+        return (us < 0) ? 0 : (int)us;
+    }
+    // 最高位在第e位，再用接下来的3位分成8个桶
+    int e = 63 - __builtin_clzl((unsigned long)us);
+    int bucket = 16 + (e - 4) * 8 + (int)((us >> (e - 3)) & 7);
+    return (bucket < POOL_LATENCY_BUCKETS) ? bucket : POOL_LATENCY_BUCKETS - 1;
+}
+
+template <typename T, typename Queue>
+long ThreadPool<T, Queue>::bucket_value(int bucket) {
+    if(bucket < 16) {
+        return bucket;
+    }
+    // 返回桶的上界，报告出来的分位数不会比实际的小
+    int e = (bucket - 16) / 8 + 4;
+    long low = (long)(8 + (bucket - 16) % 8) << (e - 3);
+    return low + (1L << (e - 3)) - 1;
+}
+
+template <typename T, typename Queue>
+void ThreadPool<T, Queue>::latency_report(Latency_Stat stats[POOL_CLASS_NUM]) {
+    // 计数只增不减，和上一次的累计值相减就是这段时间的分布，不需要清零（工作线程可能同时在写）
+    unsigned long window[POOL_LATENCY_BUCKETS];
+    for(int c = 0; c < POOL_CLASS_NUM; c++) {
+        unsigned long tasks = 0;
+        for(int i = 0; i < m_thread_number; i++) {
+            tasks += m_slots[i].tasks[c].load(memory_order_relaxed);
+        }
+        stats[c].count = tasks - m_reported_tasks[c];
+        m_reported_tasks[c] = tasks;
+        unsigned long count = 0;
+        for(int b = 0; b < POOL_LATENCY_BUCKETS; b++) {
+            unsigned long sum = 0;
+            for(int i = 0; i < m_thread_number; i++) {
+                sum += m_slots[i].latency[c][b].load(memory_order_relaxed);
+            }
+            unsigned long & reported = m_reported[c * POOL_LATENCY_BUCKETS + b];
+            window[b] = sum - reported;
+            reported = sum;
+            count += window[b];
+        }
+        stats[c].p50_us = -1;
+        stats[c].p99_us = -1;
+        if(count == 0) {
+            continue;
+        }
+        unsigned long seen = 0;
+        unsigned long p50 = (count + 1) / 2;
+        unsigned long p99 = count - count / 100;
+        for(int b = 0; b < POOL_LATENCY_BUCKETS; b++) {
+            if(stats[c].p50_us < 0 && seen + window[b] >= p50) {
+                stats[c].p50_us = bucket_value(b);
+            }
+            seen += window[b];
+            if(seen >= p99) {
+                stats[c].p99_us = bucket_value(b);
+                break;
+            }
+        }
+    }
 }
 
 
-#endif
\ No newline at end of file
+#endif
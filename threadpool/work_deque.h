@@ -0,0 +1,125 @@
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <atomic>
+#include <exception>
+using namespace std;
+
+/**
+ * Chase-Lev工作窃取双端队列（固定容量）
+ * 只有拥有它的工作线程在底部push/pop（后进先出，刚放进去的任务还在缓存里），
+ * 其他线程从顶部steal（先进先出），只有最后一个元素上才会和窃取者竞争一次CAS
+ * 内存序按照 Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP 2013)
+ * 线程池的任务总数有上限，容量固定就够了，满了由调用者放到全局队列，不需要扩容
+*/
+template <class T>
+class Work_Deque {
+public:
+    // 容量向上取整到2的幂
+    explicit Work_Deque(int capacity);
+    ~Work_Deque();
+
+    Work_Deque(const Work_Deque &) = delete;
+    Work_Deque & operator=(const Work_Deque &) = delete;
+
+    // 只能由拥有者调用：满了返回false
+    bool push(T * item);
+
+    // 只能由拥有者调用：取最后放进去的任务，空了返回NULL
+    T * pop();
+
+    // 任意线程调用：取最早放进去的任务，空了或者和别人竞争失败返回NULL
+    T * steal();
+
+    // 近似的元素个数（其他线程看到的可能已经过时）
+    int size() const {
+        long b = m_bottom.load(memory_order_relaxed);
+        long t = m_top.load(memory_order_relaxed);
+        return (b > t) ? (int)(b - t) : 0;
+    }
+
+    int capacity() const { return (int)(m_mask + 1); }
+
+private:
+    // top被窃取者修改，bottom被拥有者修改，放在不同的缓存行上避免伪共享
+    alignas(64) atomic<long> m_top;
+    alignas(64) atomic<long> m_bottom;
+    alignas(64) atomic<T *> * m_items;
+    long m_mask;
+};
+
+template <class T>
+Work_Deque<T>::Work_Deque(int capacity) : m_top(0), m_bottom(0), m_items(NULL), m_mask(0) {
+    if(capacity <= 0) {
+        throw exception();
+    }
+    long size = 1;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_items = new atomic<T *>[size];
+    for(long i = 0; i < size; i++) {
+        m_items[i].store(NULL, memory_order_relaxed);
+    }
+}
+
+template <class T>
+Work_Deque<T>::~Work_Deque() {
+    delete [] m_items;
+}
+
+template <class T>
+bool Work_Deque<T>::push(T * item) {
+    long b = m_bottom.load(memory_order_relaxed);
+    long t = m_top.load(memory_order_acquire);
+    if(b - t > m_mask) {
+        return false;
+    }
+    m_items[b & m_mask].store(item, memory_order_relaxed);
+    // 先写元素再移动bottom，窃取者看到新的bottom时一定能看到元素
+    atomic_thread_fence(memory_order_release);
+    m_bottom.store(b + 1, memory_order_relaxed);
+    return true;
+}
+
+template <class T>
+T * Work_Deque<T>::pop() {
+    long b = m_bottom.load(memory_order_relaxed) - 1;
+    m_bottom.store(b, memory_order_relaxed);
+    // 先占住最后一个位置再读top，和steal中的全屏障配对
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = m_top.load(memory_order_relaxed);
+    if(t > b) {
+        // 空的
+        m_bottom.store(b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    T * item = m_items[b & m_mask].load(memory_order_relaxed);
+    if(t == b) {
+        // 只剩一个元素，和窃取者用CAS竞争
+        if(!m_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            item = NULL;
+        }
+        m_bottom.store(b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+template <class T>
+T * Work_Deque<T>::steal() {
+    long t = m_top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = m_bottom.load(memory_order_acquire);
+    if(t >= b) {
+        return NULL;
+    }
+    T * item = m_items[t & m_mask].load(memory_order_relaxed);
+    if(!m_top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        // 被拥有者或者其他窃取者抢先了
+        return NULL;
+    }
+    return item;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "coarse_clock.h"
+
+atomic<time_t> Coarse_Clock::m_now(0);
+atomic<unsigned> Coarse_Clock::m_seq(0);
+char Coarse_Clock::m_date[2][DATE_LEN + 1];
+atomic<bool> Coarse_Clock::m_started(false);
+
+void Coarse_Clock::init() {
+    if(m_started.exchange(true)) {
+        return;
+    }
+    update();
+    pthread_t tid;
+    if(pthread_create(&tid, NULL, worker, NULL) == 0) {
+        pthread_detach(tid);
+    }
+}
+
+void Coarse_Clock::update() {
+    time_t t = time(NULL);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    // 写到当前没有被读的那一份，再切换序号
+    unsigned seq = m_seq.load(memory_order_relaxed) + 1;
+    strftime(m_date[seq & 1], DATE_LEN + 1, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    m_seq.store(seq, memory_order_release);
+    m_now.store(t, memory_order_relaxed);
+}
+
+void * Coarse_Clock::worker(void * arg) {
+    while(true) {
+        // 睡到下一秒开始的时候再更新，Date和now最多落后实际时间几毫秒
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        ts.tv_nsec = 0;
+        while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL) != 0) {
+        }
+        update();
+    }
+    return arg;
+}
@@ -0,0 +1,51 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+using namespace std;
+
+/**
+ * 进程内共享的粗粒度时钟（秒级）
+ * 由一个后台线程在每一秒开始的时候更新一次，同时生成好Date响应头，
+ * 事件循环、定时器、文件缓存和生成响应的工作线程都从这里读取时间，不再各自调用time()和strftime()
+ * Date字符串有两份，更新线程写另一份后再切换序号，读的一方发现序号变了就重新拷贝（顺序锁）
+*/
+class Coarse_Clock {
+public:
+    // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"的长度
+    static const int DATE_LEN = 37;
+
+    // 初始化当前时间并启动更新线程（只有第一次调用有效）
+    static void init();
+
+    // 当前时间（秒）
+    static time_t now() { return m_now.load(memory_order_relaxed); }
+
+    // 把Date响应头拷贝到out（不写'\0'），返回长度，out至少要有DATE_LEN个字节
+    static int date(char * out) {
+        while(true) {
+            unsigned seq = m_seq.load(memory_order_acquire);
+            memcpy(out, m_date[seq & 1], DATE_LEN);
+            atomic_thread_fence(memory_order_acquire);
+            if(m_seq.load(memory_order_relaxed) == seq) {
+                return DATE_LEN;
+            }
+        }
+    }
+
+private:
+    // 用当前时间更新now和Date
+    static void update();
+    static void * worker(void * arg);
+
+private:
+    static atomic<time_t> m_now;
+    static atomic<unsigned> m_seq;
+    static char m_date[2][DATE_LEN + 1];
+    static atomic<bool> m_started;
+};
+
+#endif
@@ -53,6 +53,8 @@ bool Sort_Timer_List::add_timer(Util_Timer * timer, Util_Timer * head) {
             tmp->prev = timer;
             break;
         }
+        prev = tmp;
+        tmp = tmp->next;
     }
     // 直到最后都没有找到合适位置插入，就放入到尾部
     if(!tmp) {
@@ -120,6 +122,7 @@ bool Sort_Timer_List::update_timer(Util_Timer * timer) {
         timer->next->prev = timer->prev;
         add_timer(timer, timer->next);
     }
+    return true;
 }
 
 //SIGALARM信号每次触发就会在其信号处理函数中执行一次tick函数，以处理链表上的到期任务
@@ -128,8 +131,8 @@ void Sort_Timer_List::tick() {
     if (!head) {
         return;
     }
-    //获取系统当前时间
-    time_t cur = time(NULL);
+    //获取当前时间（共享的秒级时钟，不需要系统调用）
+    time_t cur = Coarse_Clock::now();
     //头节点
     Util_Timer *tmp = head;
     while (tmp) {
@@ -157,14 +160,21 @@ void Sort_Timer_List::tick() {
 */
 class Utils;
 void cb_func(Client_Data * user_data) {
-    //删除非活动连接在socket上的注册事件
-    epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
+    //删除非活动连接在socket上的注册事件（从该连接所属事件循环的epoll树上删除）
+    epoll_ctl(user_data->epfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     //关闭文件描述符
     close(user_data->sockfd);
     http_conn::m_user_cout--;
 }
 
+void uring_cb_func(Client_Data * user_data) {
+    assert(user_data);
+    shutdown(user_data->sockfd, SHUT_RDWR);
+    // tick会释放这个定时器，事件循环关闭连接时就不要再删除了
+    user_data->timer = NULL;
+}
+
 void Utils::init(int timeslot) { m_TIMESLOT = timeslot; }
 
 // 对文件描述符设置非阻塞
@@ -178,7 +188,7 @@ int Utils::setnonblocking(int fd) {
 // 将内核事件表注册读事件，ET模式，选择开启EPOLLONESHOT
 void Utils::addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     epoll_event event;
-    event.data.fd = fd;
+    event.data.u64 = fd;
 
     if (1 == TRIGMode)
         // 读事件 | 边沿触发 | 异常断开会处理
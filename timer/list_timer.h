@@ -12,17 +12,23 @@
 
 #include "../log/log.h"
 #include "../http/http_conn.h"
+#include "coarse_clock.h"
 
 // 定时器类
 class Util_Timer;
+class Event_Loop;
 
 struct Client_Data {
     // 保存某个客户端的数据
     sockaddr_in address;
     // 保存socket通信文件描述符
     int sockfd; // 时间到期就关闭sockfd
+    // 该连接所属事件循环的epoll树，到期时从这棵树上删除sockfd
+    int epfd;
     // 定时器
     Util_Timer * timer; // 每个连接的客户端都有一个定时器
+    // 所属的事件循环，定时器到期时由它关闭连接
+    Event_Loop * loop;
 };
 
 // 可以理解为，这是双向链表的一个节点
@@ -106,7 +112,11 @@ public:
     int m_TIMESLOT;
 };
 
-//这是一个实际的回调函数
+//关闭连接的socket：从epoll上删除并close，连接的其他资源由事件循环释放
 void cb_func(Client_Data *user_data);
 
+//io_uring后端的回调函数：socket上还挂着multishot recv，不能直接close，只shutdown，
+//recv结束后由事件循环关闭
+void uring_cb_func(Client_Data *user_data);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "tls_context.h"
+
+// 服务端会话缓存最多保存多少个会话，超过后OpenSSL淘汰最旧的
+static const long SESSION_CACHE_SIZE = 20480;
+// 会话（包括票据）的有效期，单位秒
+static const long SESSION_TIMEOUT = 3600;
+// ALPN中服务端支持的协议，按优先级排列（长度前缀格式）
+static const unsigned char ALPN_PROTOCOLS[] = "\x02h2\x08http/1.1";
+
+Tls_Context::Tls_Context() : m_ctx(NULL) {}
+
+Tls_Context::~Tls_Context() {
+    SSL_CTX_free(m_ctx);
+}
+
+Tls_Context * Tls_Context::get_instance() {
+    // C++11以后局部静态变量的初始化是线程安全的
+    static Tls_Context instance;
+    return &instance;
+}
+
+bool Tls_Context::init(const string & cert_file, const string & key_file) {
+    SSL_CTX * ctx = SSL_CTX_new(TLS_server_method());
+    if(!ctx) {
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 内核支持时握手后切换到kTLS；不需要重协商
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // 非阻塞写：允许只写出一部分（和sendmsg的语义一致），EAGAIN后重试时iovec的地址可以变化（写缓冲区可能扩容），
+    // 空闲连接不保留OpenSSL的读写缓冲区（和连接的读写缓冲区一样按需借用）
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    if(SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1
+       || SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1
+       || SSL_CTX_check_private_key(ctx) != 1) {
+        ERR_print_errors_fp(stdout);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // 会话恢复：TLS 1.2用服务端会话缓存，TLS 1.3用会话票据（票据密钥由OpenSSL生成，进程内所有连接共用）
+    static const unsigned char sid_ctx[] = "webserver";
+    SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, NULL);
+    m_ctx = ctx;
+    return true;
+}
+
+SSL * Tls_Context::create(int fd) {
+    SSL * ssl = SSL_new(m_ctx);
+    if(!ssl) {
+        return NULL;
+    }
+    // socket BIO直接读写fd，kTLS也要求使用socket BIO
+    if(SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+bool Tls_Context::ktls_send(SSL * ssl) {
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+#else
+    return false;
+#endif
+}
+
+bool Tls_Context::ktls_recv(SSL * ssl) {
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_recv(SSL_get_rbio(ssl)) > 0;
+#else
+    return false;
+#endif
+}
+
+int Tls_Context::select_alpn(SSL *, const unsigned char ** out, unsigned char * outlen,
+                             const unsigned char * in, unsigned int inlen, void *) {
+    unsigned char * selected = NULL;
+    if(SSL_select_next_proto(&selected, outlen, ALPN_PROTOCOLS, sizeof(ALPN_PROTOCOLS) - 1, in, inlen)
+       != OPENSSL_NPN_NEGOTIATED) {
+        // 客户端的协议我们都不支持，不使用ALPN，按HTTP/1.1处理
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
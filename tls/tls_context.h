@@ -0,0 +1,48 @@
+#ifndef TLS_CONTEXT_H
+#define TLS_CONTEXT_H
+
+#include <string>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+using namespace std;
+
+/**
+ * TLS监听端口共享的SSL_CTX（单例）
+ * - 证书和私钥启动时加载一次，所有事件循环的连接共用
+ * - 会话恢复：服务端会话缓存（TLS 1.2的session id）和会话票据（TLS 1.3的ticket），
+ *   客户端重新连接时跳过完整握手的非对称运算
+ * - ALPN优先协商h2，协商成功后客户端直接发送连接前言，由H2_Session处理
+ * - 打开SSL_OP_ENABLE_KTLS：内核支持kTLS时，握手完成后OpenSSL把密钥交给内核，
+ *   之后加解密在内核中完成，连接可以继续用recv/sendmsg/sendfile，文件内容不经过用户态；
+ *   内核不支持时退回到SSL_read/SSL_write
+*/
+class Tls_Context {
+public:
+    static Tls_Context * get_instance();
+
+    // 加载证书链和私钥，失败返回false
+    bool init(const string & cert_file, const string & key_file);
+
+    // 是否已经初始化（配置了TLS端口）
+    bool enabled() const { return m_ctx != NULL; }
+
+    // 为一个新接收的连接创建SSL对象（服务端状态，绑定到fd上）
+    SSL * create(int fd);
+
+    // 握手完成后，发送/接收方向是否已经交给了内核（kTLS）
+    static bool ktls_send(SSL * ssl);
+    static bool ktls_recv(SSL * ssl);
+
+private:
+    Tls_Context();
+    ~Tls_Context();
+
+    // ALPN回调：客户端支持h2就选h2，否则选http/1.1
+    static int select_alpn(SSL * ssl, const unsigned char ** out, unsigned char * outlen,
+                           const unsigned char * in, unsigned int inlen, void * arg);
+
+private:
+    SSL_CTX * m_ctx;
+};
+
+#endif